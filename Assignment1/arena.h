@@ -0,0 +1,222 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Bump allocator and heap accounting for the Maverick Shell.
+ *
+ * Everything that only lives for one command (the input line, the words,
+ * the argv arrays of every stage) comes out of an arena that is reset at
+ * the top of every prompt. Resetting keeps the memory, so once the arena
+ * has grown to fit the longest command seen, running commands costs no
+ * heap calls at all. If a command needed more than one chunk, the reset
+ * folds them into a single chunk of the combined size.
+ *
+ * The rest of msh allocates through xmalloc() and friends, which count
+ * every call so memstats can show where the heap is still being used.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN      16
+#define ARENA_MIN_CHUNK  4096
+
+struct arena_chunk {
+  struct arena_chunk *next;
+  size_t              size;  // bytes available in data
+  size_t              used;
+  char                data[];
+};
+
+struct arena {
+  struct arena_chunk *chunks;   // current chunk first
+  void               *last;     // most recent allocation, which can grow in place
+  size_t              used;     // bytes handed out since the last reset
+  size_t              peak;     // most bytes a single command has needed
+  unsigned long       allocs;   // allocations since the last reset
+};
+
+/*
+ * Heap calls made by msh, counted by the wrappers below and by the arena.
+ */
+static unsigned long heap_calls = 0;
+
+/*
+ * malloc, realloc and strdup that count the call and exit if memory runs out.
+ * where is printed in the error, like the rest of msh does.
+ */
+void* xmalloc(size_t size, const char *where);
+void* xrealloc(void *ptr, size_t size, const char *where);
+char* xstrdup(const char *s, const char *where);
+
+/*
+ * Returns size bytes from the arena, aligned to ARENA_ALIGN.
+ */
+void* arena_alloc(struct arena *a, size_t size);
+
+/*
+ * Makes an arena allocation bigger, keeping its contents. Grows in place when
+ * ptr is the most recent allocation and its chunk has room.
+ */
+void* arena_grow(struct arena *a, void *ptr, size_t old_size, size_t new_size);
+
+/*
+ * Copies a string into the arena.
+ */
+char* arena_strdup(struct arena *a, const char *s);
+
+/*
+ * Forgets every allocation but keeps the memory for the next command.
+ */
+void arena_reset(struct arena *a);
+
+/*
+ * Returns the bytes the arena holds from the heap and the number of chunks.
+ */
+size_t arena_capacity(struct arena *a, int *nchunks);
+
+/*
+ * Gives all chunks back to the heap.
+ */
+void arena_free(struct arena *a);
+
+
+void* xmalloc(size_t size, const char *where){
+  void *p = malloc(size);
+  if(!p){
+    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN %s.\n", where);
+    exit(1);
+  }
+  heap_calls++;
+  return p;
+}
+
+void* xrealloc(void *ptr, size_t size, const char *where){
+  void *p = realloc(ptr, size);
+  if(!p){
+    printf("ERROR IN ALLOCATING MEMORY FOR REALLOC IN %s.\n", where);
+    exit(1);
+  }
+  heap_calls++;
+  return p;
+}
+
+char* xstrdup(const char *s, const char *where){
+  size_t len = strlen(s) + 1;
+  char *p = xmalloc(len, where);
+  memcpy(p, s, len);
+  return p;
+}
+
+struct arena_chunk* arena_new_chunk(size_t size){
+  struct arena_chunk *c = xmalloc(sizeof(struct arena_chunk) + size, "ARENA_NEW_CHUNK");
+  c->next = NULL;
+  c->size = size;
+  c->used = 0;
+  return c;
+}
+
+void* arena_alloc(struct arena *a, size_t size){
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  struct arena_chunk *c = a->chunks;
+  if(c == NULL || c->size - c->used < size){
+    // Each new chunk at least doubles what we had, so a long line needs few of them.
+    size_t want = c ? c->size * 2 : ARENA_MIN_CHUNK;
+    while(want < size)
+      want *= 2;
+    struct arena_chunk *n = arena_new_chunk(want);
+    n->next = c;
+    a->chunks = n;
+    c = n;
+  }
+
+  void *p = c->data + c->used;
+  c->used += size;
+  a->used += size;
+  a->allocs++;
+  a->last = p;
+  return p;
+}
+
+void* arena_grow(struct arena *a, void *ptr, size_t old_size, size_t new_size){
+  if(ptr == NULL)
+    return arena_alloc(a, new_size);
+
+  struct arena_chunk *c = a->chunks;
+  old_size = (old_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  new_size = (new_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  if(ptr == a->last && c != NULL && (char *)ptr + old_size == c->data + c->used &&
+     c->size - c->used >= new_size - old_size){
+    c->used += new_size - old_size;
+    a->used += new_size - old_size;
+    return ptr;
+  }
+
+  void *p = arena_alloc(a, new_size);
+  memcpy(p, ptr, old_size);
+  return p;
+}
+
+char* arena_strdup(struct arena *a, const char *s){
+  size_t len = strlen(s) + 1;
+  char *p = arena_alloc(a, len);
+  memcpy(p, s, len);
+  return p;
+}
+
+void arena_reset(struct arena *a){
+  if(a->used > a->peak)
+    a->peak = a->used;
+
+  if(a->chunks != NULL && a->chunks->next != NULL){
+    // Fold the chunks into one big enough for everything the last command used.
+    size_t total = 0;
+    struct arena_chunk *c = a->chunks;
+    while(c != NULL){
+      struct arena_chunk *next = c->next;
+      total += c->size;
+      free(c);
+      c = next;
+    }
+    a->chunks = arena_new_chunk(total);
+  }
+  else if(a->chunks != NULL){
+    a->chunks->used = 0;
+  }
+
+  a->last = NULL;
+  a->used = 0;
+  a->allocs = 0;
+}
+
+size_t arena_capacity(struct arena *a, int *nchunks){
+  size_t total = 0;
+  int n = 0;
+  struct arena_chunk *c;
+  for(c = a->chunks; c != NULL; c = c->next){
+    total += c->size;
+    n++;
+  }
+  if(nchunks)
+    *nchunks = n;
+  return total;
+}
+
+void arena_free(struct arena *a){
+  struct arena_chunk *c = a->chunks;
+  while(c != NULL){
+    struct arena_chunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  memset(a, 0, sizeof(struct arena));
+}
+
+#endif
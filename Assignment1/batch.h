@@ -0,0 +1,288 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Parallel script runner for the Maverick Shell (msh -P N).
+ *
+ * Every line of the script is run by a forked copy of msh in a slot, up to
+ * N slots at a time, so independent lines keep every core busy like xargs
+ * -P does. Each slot's stdout and stderr go to a pipe msh reads. By default
+ * the output of each line is held back until every earlier line has been
+ * printed, so the result reads like a sequential run; with -T lines are
+ * printed as soon as they arrive, each prefixed with its script line number.
+ *
+ * This file uses read_line(), run_line() and the state declared before it
+ * in msh.c, so it is included after those.
+ */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "jobs.h"
+
+struct batch_slot {
+  int     busy;
+  int     lineno;   // line of the script, used for -T tags
+  int     seq;      // order among the lines actually run, used to keep output in order
+  pid_t   pid;
+  int     job_id;
+  int     fd;       // read end of the output pipe, -1 once it hit end of file
+  int     exited;
+  int     status;
+  char   *out;      // output held back, or the unfinished last line with -T
+  size_t  len;
+  size_t  cap;
+};
+
+/*
+ * Runs the lines from read_line() nslots at a time. Returns 0 if every line
+ * succeeded and 1 otherwise.
+ */
+int run_parallel(int nslots, int tagged);
+
+
+/*
+ * Forks a copy of msh to run line in slot s.
+ */
+void batch_start(struct batch_slot *s, char *line, int lineno, int seq){
+  int p[2];
+  if(pipe2(p, O_CLOEXEC) != 0){
+    perror("pipe");
+    exit(1);
+  }
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid < 0){
+    perror("fork");
+    exit(1);
+  }
+  if(pid == 0){
+    // Own process group so an interrupted run can take down everything the line started.
+    setpgid(0, 0);
+    // Lines do not get to read the script, which may be our stdin.
+    int null = open("/dev/null", O_RDONLY);
+    if(null >= 0 && null != 0){
+      dup2(null, 0);
+      close(null);
+    }
+    dup2(p[1], 1);
+    dup2(p[1], 2);
+    jobs_reset_child();
+    run_line(line);
+    fflush(stdout);
+    _exit(exit_code(last_status));
+  }
+  setpgid(pid, pid);
+  close(p[1]);
+  fcntl(p[0], F_SETFL, O_NONBLOCK);
+
+  line[strcspn(line, "\n")] = '\0';
+  struct job *job = job_create(line, 1);
+  job_add_pid(job, pid, NULL);
+
+  s->busy = 1;
+  s->lineno = lineno;
+  s->seq = seq;
+  s->pid = pid;
+  s->job_id = job->id;
+  s->fd = p[0];
+  s->exited = 0;
+  s->status = 0;
+  s->len = 0;
+}
+
+void batch_append(struct batch_slot *s, const char *buf, size_t n){
+  if(s->len + n > s->cap){
+    s->cap = s->cap ? s->cap : 4096;
+    while(s->cap < s->len + n)
+      s->cap *= 2;
+    s->out = xrealloc(s->out, s->cap, "BATCH_APPEND");
+  }
+  memcpy(s->out + s->len, buf, n);
+  s->len += n;
+}
+
+/*
+ * With -T, prints every complete line held by the slot with its tag. At the end
+ * of the output a last line without a newline is printed too.
+ */
+void batch_print_tagged(struct batch_slot *s, int at_eof){
+  size_t start = 0;
+  size_t i;
+  for(i = 0; i < s->len; i++){
+    if(s->out[i] == '\n'){
+      printf("[%d] %.*s\n", s->lineno, (int)(i - start), s->out + start);
+      start = i + 1;
+    }
+  }
+  if(at_eof && start < s->len){
+    printf("[%d] %.*s\n", s->lineno, (int)(s->len - start), s->out + start);
+    start = s->len;
+  }
+  memmove(s->out, s->out + start, s->len - start);
+  s->len -= start;
+}
+
+/*
+ * Prints the finished output in done that is next in script order and frees it. With
+ * all set it also prints what is left after a gap, still in script order, which
+ * happens when an interrupted run gives up on the lines in between.
+ */
+void batch_print_done(struct batch_slot *done, int *ndone, int *next_seq, int all){
+  int i;
+  while(*ndone > 0){
+    int next = 0;
+    for(i = 1; i < *ndone; i++){
+      if(done[i].seq < done[next].seq)
+        next = i;
+    }
+    if(done[next].seq != *next_seq && !all)
+      break;
+    fwrite(done[next].out, 1, done[next].len, stdout);
+    free(done[next].out);
+    *next_seq = done[next].seq + 1;
+    done[next] = done[--(*ndone)];
+  }
+  fflush(stdout);
+}
+
+int run_parallel(int nslots, int tagged){
+  struct batch_slot *slots = xmalloc(nslots * sizeof(struct batch_slot), "RUN_PARALLEL");
+  memset(slots, 0, nslots * sizeof(struct batch_slot));
+
+  // Finished output waiting for an earlier line, when keeping script order. No new line starts
+  // while nslots are waiting, and at most nslots more can finish after that.
+  struct batch_slot *done = xmalloc(2 * nslots * sizeof(struct batch_slot), "RUN_PARALLEL");
+  int ndone = 0;
+
+  struct pollfd *fds = xmalloc((nslots + 1) * sizeof(struct pollfd), "RUN_PARALLEL");
+
+  int eof = 0;
+  int lineno = 0;
+  int seq = 0;
+  int next_seq = 0;
+  int running = 0;
+  int failed = 0;
+  int i;
+
+  while(!eof || running > 0){
+
+    // Keep every slot busy while there are lines left.
+    while(!eof && running < nslots && ndone < nslots){
+      arena_reset(&command_arena);
+      char *line = read_line();
+      if(line == NULL || interrupted){
+        eof = 1;
+        break;
+      }
+      lineno++;
+
+      char *p = line + strspn(line, " \t\n");
+      if(*p == '\0' || *p == '#')
+        continue;
+
+      for(i = 0; slots[i].busy; i++){
+      }
+      batch_start(&slots[i], line, lineno, seq++);
+      running++;
+    }
+    if(running == 0)
+      continue;
+
+    int nfds = 0;
+    fds[nfds].fd = job_table.sigchld_pipe[0];
+    fds[nfds++].events = POLLIN;
+    for(i = 0; i < nslots; i++){
+      if(slots[i].busy && slots[i].fd >= 0){
+        fds[nfds].fd = slots[i].fd;
+        fds[nfds++].events = POLLIN;
+      }
+    }
+
+    if(poll(fds, nfds, -1) < 0){
+      if(errno == EINTR && interrupted){
+        // ctrl-C: stop everything that is still running and start nothing new.
+        for(i = 0; i < nslots; i++){
+          if(slots[i].busy && !slots[i].exited)
+            kill(-slots[i].pid, SIGTERM);
+        }
+        eof = 1;
+      }
+      continue;
+    }
+
+    if(fds[0].revents)
+      jobs_reap();
+
+    for(i = 0; i < nslots; i++){
+      struct batch_slot *s = &slots[i];
+      if(!s->busy)
+        continue;
+
+      if(s->fd >= 0){
+        char buf[65536];
+        ssize_t n = read(s->fd, buf, sizeof(buf));
+        if(n > 0){
+          batch_append(s, buf, n);
+          if(tagged)
+            batch_print_tagged(s, 0);
+        }
+        else if(n == 0 || (errno != EAGAIN && errno != EINTR)){
+          close(s->fd);
+          s->fd = -1;
+          if(tagged)
+            batch_print_tagged(s, 1);
+        }
+      }
+
+      if(!s->exited){
+        struct job *job = job_find_id(s->job_id);
+        if(job != NULL && job->state == JOB_DONE){
+          s->exited = 1;
+          s->status = job->status[0];
+          job_remove(job);
+        }
+      }
+
+      if(s->exited && s->fd < 0){
+        if(s->status != 0)
+          failed = 1;
+        running--;
+        s->busy = 0;
+        if(!tagged){
+          // Hand the buffer over to the done list; the slot starts a new one next time.
+          done[ndone++] = *s;
+          s->out = NULL;
+          s->cap = 0;
+          s->len = 0;
+        }
+      }
+    }
+
+    // Print whatever is next in script order.
+    batch_print_done(done, &ndone, &next_seq, 0);
+  }
+
+  // Nothing is left to wait for, so whatever is still held back goes out now.
+  batch_print_done(done, &ndone, &next_seq, 1);
+
+  for(i = 0; i < nslots; i++){
+    free(slots[i].out);
+  }
+  free(slots);
+  free(done);
+  free(fds);
+  return failed;
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Builtin versus external command benchmark for the Maverick Shell.
+ *
+ * Build and run:
+ *   gcc -O2 -o msh msh.c
+ *   gcc -O2 -o builtinbench builtinbench.c
+ *   ./builtinbench [-s path/to/msh] [-n lines] [-d dir]
+ *
+ * For each pair of commands below, writes a script that runs the command n
+ * times (10000 by default) and times msh -f on it, once with the builtin and
+ * once with the same utility from /bin. Reports microseconds per command and
+ * how much faster the builtin was.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+struct bench_case {
+  const char *builtin;
+  const char *external;
+};
+
+/*
+ * Returns the monotonic clock in seconds.
+ */
+double now_s();
+
+/*
+ * Writes line to path n times.
+ */
+void make_script(const char *path, const char *line, long n);
+
+/*
+ * Runs msh -f script and returns the wall time it took, or -1 if msh failed.
+ */
+double run_script(const char *msh, const char *script);
+
+
+struct bench_case cases[] =
+{
+  { "true",                       "/bin/true"                         },
+  { "echo hello > /dev/null",     "/bin/echo hello > /dev/null"       },
+  { "test -d /tmp",               "/usr/bin/test -d /tmp"             },
+  { "printf %d 42 > /dev/null",   "/usr/bin/printf %d 42 > /dev/null" },
+  { NULL,                         NULL                                }
+};
+
+double now_s(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void make_script(const char *path, const char *line, long n){
+  FILE *fp = fopen(path, "w");
+  if(fp == NULL){
+    perror(path);
+    exit(1);
+  }
+  long i;
+  for(i = 0; i < n; i++){
+    fprintf(fp, "%s\n", line);
+  }
+  fclose(fp);
+}
+
+double run_script(const char *msh, const char *script){
+  fflush(stdout);
+  double start = now_s();
+  pid_t pid = fork();
+  if(pid == 0){
+    execl(msh, msh, "-f", script, (char *)NULL);
+    perror(msh);
+    _exit(127);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  double t = now_s() - start;
+  if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    return -1;
+  return t;
+}
+
+int main(int argc, char **argv){
+  char *msh = "./msh";
+  char *dir = "/tmp";
+  long n = 10000;
+  int opt;
+
+  while((opt = getopt(argc, argv, "s:n:d:")) != -1){
+    switch(opt){
+      case 's':
+        msh = optarg;
+        break;
+      case 'n':
+        n = atol(optarg);
+        break;
+      case 'd':
+        dir = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-s msh] [-n lines] [-d dir]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(n <= 0){
+    fprintf(stderr, "ERROR: line count must be positive.\n");
+    return 1;
+  }
+
+  char script[4096];
+  snprintf(script, sizeof(script), "%s/builtinbench.%d.msh", dir, (int)getpid());
+
+  printf("%ld commands per script\n", n);
+  printf("%-28s %12s %12s %9s\n", "command", "builtin us", "external us", "speedup");
+
+  int failed = 0;
+  struct bench_case *c;
+  for(c = cases; c->builtin != NULL; c++){
+    make_script(script, c->builtin, n);
+    double tb = run_script(msh, script);
+    make_script(script, c->external, n);
+    double te = run_script(msh, script);
+
+    if(tb < 0 || te < 0){
+      printf("%-28s failed\n", c->builtin);
+      failed = 1;
+      continue;
+    }
+    printf("%-28s %12.2f %12.2f %8.1fx\n", c->builtin, tb * 1e6 / n, te * 1e6 / n, te / tb);
+  }
+
+  unlink(script);
+  return failed;
+}
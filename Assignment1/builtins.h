@@ -0,0 +1,484 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Builtin commands for the Maverick Shell.
+ *
+ * Every command name is looked up in builtin_table before the path index.
+ * A builtin on its own runs inside msh, with any redirections installed on
+ * msh's own descriptors for the duration, so glue like echo, test and
+ * printf costs a function call instead of a fork and exec. Inside a
+ * pipeline or in the background a builtin runs in a forked child like any
+ * other stage.
+ *
+ * This file uses the state and functions declared before it in msh.c, so
+ * it is included after those.
+ */
+
+#ifndef __BUILTINS_H__
+#define __BUILTINS_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "spawn.h"
+
+struct builtin {
+  const char *name;
+  int       (*run)(char **argv);  // returns the exit status
+};
+
+/*
+ * Looks name up in the table. Returns NULL if it is not a builtin.
+ */
+const struct builtin* builtin_find(const char *name);
+
+/*
+ * Runs a builtin inside msh with fds[0..2] (or -1 to keep ours) installed as
+ * its stdin, stdout and stderr, and returns its exit status.
+ */
+int builtin_run(const struct builtin *b, char **argv, const int *fds);
+
+/*
+ * Runs a builtin in a forked child, for builtins inside a pipeline or in the
+ * background. Takes the same fds and pgid as spawn_command and returns the pid
+ * of the child, or 0 if it could not be started.
+ */
+pid_t builtin_spawn(const struct builtin *b, char **argv, const int *fds, pid_t pgid);
+
+/*
+ * The builtins that are not part of job control.
+ */
+int builtin_exit(char **argv);
+int builtin_echo(char **argv);
+int builtin_pwd(char **argv);
+int builtin_true(char **argv);
+int builtin_false(char **argv);
+int builtin_test(char **argv);
+int builtin_printf(char **argv);
+
+
+struct builtin builtin_table[] =
+{
+  { "exit",     builtin_exit     },
+  { "quit",     builtin_exit     },
+  { "cd",       change_dir       },
+  { "showpid",  builtin_showpid  },
+  { "jobs",     builtin_jobs     },
+  { "fg",       builtin_fg       },
+  { "bg",       builtin_bg       },
+  { "wait",     builtin_wait     },
+  { "memstats", memstats         },
+  { "stats",    builtin_stats    },
+  { "history",  builtin_history  },
+  { "echo",     builtin_echo     },
+  { "pwd",      builtin_pwd      },
+  { "true",     builtin_true     },
+  { "false",    builtin_false    },
+  { "test",     builtin_test     },
+  { "[",        builtin_test     },
+  { "printf",   builtin_printf   },
+  { NULL,       NULL             }
+};
+
+const struct builtin* builtin_find(const char *name){
+  const struct builtin *b;
+  for(b = builtin_table; b->name != NULL; b++){
+    if(b->name[0] == name[0] && !strcmp(b->name, name))
+      return b;
+  }
+  return NULL;
+}
+
+int builtin_run(const struct builtin *b, char **argv, const int *fds){
+  int saved[3] = { -1, -1, -1 };
+  int i;
+
+  fflush(stdout);
+  for(i = 0; i < 3; i++){
+    if(fds[i] >= 0 && fds[i] != i){
+      saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+      dup2(fds[i], i);
+    }
+  }
+
+  int status = b->run(argv);
+
+  fflush(stdout);
+  fflush(stderr);
+  for(i = 0; i < 3; i++){
+    if(saved[i] >= 0){
+      dup2(saved[i], i);
+      close(saved[i]);
+    }
+  }
+  return status;
+}
+
+pid_t builtin_spawn(const struct builtin *b, char **argv, const int *fds, pid_t pgid){
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0){
+    spawn_child_setup(pgid);
+    spawn_install_fds(fds);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    jobs_reset_child();
+    int status = b->run(argv);
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+  }
+  if(pid < 0){
+    perror("fork");
+    return 0;
+  }
+  spawn_parent_setup(pid, pgid);
+  return pid;
+}
+
+int builtin_exit(char **argv){
+  // With a status it becomes ours, otherwise we keep the one of the last command.
+  shell_exit = 1;
+  if(argv[1] != NULL)
+    return atoi(argv[1]) & 0xff;
+  return exit_code(last_status);
+}
+
+/*
+ * Prints s, interpreting backslash escapes. Returns 0 if \c asked to stop all
+ * output right here.
+ */
+int echo_escapes(const char *s){
+  for(; *s; s++){
+    if(*s != '\\' || s[1] == '\0'){
+      putchar(*s);
+      continue;
+    }
+    s++;
+    switch(*s){
+      case 'n':  putchar('\n'); break;
+      case 't':  putchar('\t'); break;
+      case 'r':  putchar('\r'); break;
+      case 'a':  putchar('\a'); break;
+      case 'b':  putchar('\b'); break;
+      case 'f':  putchar('\f'); break;
+      case 'v':  putchar('\v'); break;
+      case 'e':  putchar(27);   break;
+      case '\\': putchar('\\'); break;
+      case 'c':  return 0;
+      case '0': {
+        // \0nnn is an octal byte.
+        int v = 0, n = 0;
+        while(n < 3 && s[1] >= '0' && s[1] <= '7'){
+          v = v * 8 + (*++s - '0');
+          n++;
+        }
+        putchar(v);
+        break;
+      }
+      default:
+        putchar('\\');
+        putchar(*s);
+        break;
+    }
+  }
+  return 1;
+}
+
+int builtin_echo(char **argv){
+  int newline = 1;
+  int escapes = 0;
+  int i = 1;
+
+  // Leading -n, -e and -E (and combinations like -ne) are options, anything else is text.
+  while(argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0' &&
+        strspn(argv[i] + 1, "neE") == strlen(argv[i] + 1)){
+    const char *f;
+    for(f = argv[i] + 1; *f; f++){
+      if(*f == 'n')
+        newline = 0;
+      else if(*f == 'e')
+        escapes = 1;
+      else
+        escapes = 0;
+    }
+    i++;
+  }
+
+  for(; argv[i] != NULL; i++){
+    if(escapes){
+      if(!echo_escapes(argv[i]))
+        return 0;
+    }
+    else{
+      fputs(argv[i], stdout);
+    }
+    if(argv[i+1] != NULL)
+      putchar(' ');
+  }
+  if(newline)
+    putchar('\n');
+  return 0;
+}
+
+int builtin_pwd(char **argv){
+  (void)argv;
+  char buf[PATH_MAX];
+  if(getcwd(buf, sizeof(buf)) == NULL){
+    fprintf(stderr, "pwd: %s.\n", strerror(errno));
+    return 1;
+  }
+  printf("%s\n", buf);
+  return 0;
+}
+
+int builtin_true(char **argv){
+  (void)argv;
+  return 0;
+}
+
+int builtin_false(char **argv){
+  (void)argv;
+  return 1;
+}
+
+/*
+ * Parses an integer operand for test. Returns 0 and complains if it is not one.
+ */
+int test_integer(const char *s, long long *v){
+  char *end;
+  errno = 0;
+  *v = strtoll(s, &end, 10);
+  if(*s == '\0' || *end != '\0' || errno != 0){
+    fprintf(stderr, "test: %s: integer expression expected.\n", s);
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * test with one operator and one operand, like -f file. Returns 0 for true,
+ * 1 for false and 2 for an unknown operator.
+ */
+int test_unary(const char *op, const char *arg){
+  struct stat st;
+
+  if(op[0] != '-' || op[1] == '\0' || op[2] != '\0')
+    return 2;
+
+  switch(op[1]){
+    case 'z': return arg[0] != '\0';
+    case 'n': return arg[0] == '\0';
+    case 'e': return stat(arg, &st) != 0;
+    case 'f': return !(stat(arg, &st) == 0 && S_ISREG(st.st_mode));
+    case 'd': return !(stat(arg, &st) == 0 && S_ISDIR(st.st_mode));
+    case 'p': return !(stat(arg, &st) == 0 && S_ISFIFO(st.st_mode));
+    case 's': return !(stat(arg, &st) == 0 && st.st_size > 0);
+    case 'h':
+    case 'L': return !(lstat(arg, &st) == 0 && S_ISLNK(st.st_mode));
+    case 'r': return access(arg, R_OK) != 0;
+    case 'w': return access(arg, W_OK) != 0;
+    case 'x': return access(arg, X_OK) != 0;
+    case 't': return !isatty(atoi(arg));
+  }
+  return 2;
+}
+
+/*
+ * test with a binary operator, like a = b or 3 -lt 4. Same results as
+ * test_unary, plus 3 if an operand was not a number, which has been reported.
+ */
+int test_binary(const char *a, const char *op, const char *b){
+  if(!strcmp(op, "="))
+    return strcmp(a, b) != 0;
+  if(!strcmp(op, "!="))
+    return strcmp(a, b) == 0;
+
+  static const char *ops[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+  int i;
+  for(i = 0; i < 6; i++){
+    if(strcmp(op, ops[i]) != 0)
+      continue;
+
+    long long x, y;
+    if(!test_integer(a, &x) || !test_integer(b, &y))
+      return 3;
+    switch(i){
+      case 0: return !(x == y);
+      case 1: return !(x != y);
+      case 2: return !(x <  y);
+      case 3: return !(x <= y);
+      case 4: return !(x >  y);
+      default: return !(x >= y);
+    }
+  }
+  return 2;
+}
+
+/*
+ * The POSIX rules for test, which only depend on how many operands there are.
+ */
+int test_eval(int argc, char **argv){
+  int r;
+  switch(argc){
+    case 0:
+      return 1;
+    case 1:
+      return argv[0][0] == '\0';
+    case 2:
+      if(!strcmp(argv[0], "!"))
+        return argv[1][0] != '\0';
+      return test_unary(argv[0], argv[1]);
+    case 3:
+      r = test_binary(argv[0], argv[1], argv[2]);
+      if(r != 2)
+        return r;
+      if(!strcmp(argv[0], "!")){
+        r = test_eval(2, argv + 1);
+        return r >= 2 ? r : !r;
+      }
+      if(!strcmp(argv[0], "(") && !strcmp(argv[2], ")"))
+        return test_eval(1, argv + 1);
+      return 2;
+    case 4:
+      if(!strcmp(argv[0], "!")){
+        r = test_eval(3, argv + 1);
+        return r >= 2 ? r : !r;
+      }
+      return 2;
+  }
+  return 2;
+}
+
+int builtin_test(char **argv){
+  int argc = 0;
+  while(argv[argc] != NULL)
+    argc++;
+
+  // [ ... ] needs its closing bracket, which is not an operand.
+  if(!strcmp(argv[0], "[")){
+    if(strcmp(argv[argc-1], "]") != 0){
+      fprintf(stderr, "[: missing ']'.\n");
+      return 2;
+    }
+    argc--;
+  }
+
+  int r = test_eval(argc - 1, argv + 1);
+  if(r == 2)
+    fprintf(stderr, "%s: syntax error.\n", argv[0]);
+  return r > 2 ? 2 : r;
+}
+
+int builtin_printf(char **argv){
+  if(argv[1] == NULL){
+    fprintf(stderr, "printf: usage: printf format [arguments]\n");
+    return 2;
+  }
+
+  const char *format = argv[1];
+  char **args = argv + 2;
+  int status = 0;
+
+  // Like printf(1) the format is used again until every argument is consumed.
+  do{
+    const char *f;
+    for(f = format; *f; f++){
+      if(*f == '\\'){
+        char one[3] = { '\\', f[1], '\0' };
+        if(f[1] == '\0')
+          one[1] = '\0';
+        else
+          f++;
+        if(!echo_escapes(one))
+          return status;
+        continue;
+      }
+      if(*f != '%'){
+        putchar(*f);
+        continue;
+      }
+      if(f[1] == '%'){
+        putchar('%');
+        f++;
+        continue;
+      }
+
+      // Copy the flags, width and precision so the C printf can do the work.
+      char spec[32];
+      size_t n = 0;
+      spec[n++] = *f++;
+      while(*f && strchr("-+ #0123456789.", *f) && n < sizeof(spec) - 4)
+        spec[n++] = *f++;
+      if(*f == '\0')
+        break;
+
+      const char *arg = *args ? *args++ : NULL;
+      char conv = *f;
+      char *end;
+
+      switch(conv){
+        case 'd':
+        case 'i': {
+          long long v = arg ? strtoll(arg, &end, 0) : 0;
+          if(arg && (*arg == '\0' || *end != '\0')){
+            fprintf(stderr, "printf: %s: invalid number.\n", arg);
+            status = 1;
+          }
+          spec[n++] = 'l';
+          spec[n++] = 'l';
+          spec[n++] = conv;
+          spec[n] = '\0';
+          printf(spec, v);
+          break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X': {
+          unsigned long long v = arg ? strtoull(arg, &end, 0) : 0;
+          if(arg && (*arg == '\0' || *end != '\0')){
+            fprintf(stderr, "printf: %s: invalid number.\n", arg);
+            status = 1;
+          }
+          spec[n++] = 'l';
+          spec[n++] = 'l';
+          spec[n++] = conv;
+          spec[n] = '\0';
+          printf(spec, v);
+          break;
+        }
+        case 'c':
+          spec[n++] = 'c';
+          spec[n] = '\0';
+          printf(spec, arg ? arg[0] : '\0');
+          break;
+        case 's':
+          spec[n++] = 's';
+          spec[n] = '\0';
+          printf(spec, arg ? arg : "");
+          break;
+        case 'b':
+          if(arg && !echo_escapes(arg))
+            return status;
+          break;
+        default:
+          fprintf(stderr, "printf: %%%c: invalid conversion.\n", conv);
+          return 1;
+      }
+    }
+  }while(*args != NULL && args != argv + 2);
+
+  return status;
+}
+
+#endif
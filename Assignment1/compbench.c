@@ -0,0 +1,238 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Benchmark for the Maverick Shell command completion trie.
+ *
+ * Build and run:
+ *   gcc -O2 -o compbench compbench.c
+ *   ./compbench [-n commands] [-q queries] [-c changes] [-d dir]
+ *
+ * Fills a scratch directory under dir with n executables (50000 by
+ * default) and points complete.h at it as the whole search path. Times
+ * the first build of the trie, then q completions (10000 by default) of
+ * random 1 to 4 character prefixes of the names, each finding the node,
+ * the common continuation and up to 100 names, as a Tab press does
+ * (p50/p99/max). Then c executables are added and c removed behind the
+ * trie's back and the time it takes to catch up through inotify is
+ * reported, along with a check that the trie now has exactly the names
+ * on disk.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "complete.h"
+
+static char   scratch[PATH_MAX];
+static char **names;   // names[i] is the i'th executable made
+
+/*
+ * Returns the monotonic clock in seconds.
+ */
+double now_s();
+
+/*
+ * Creates an executable called name in the scratch directory.
+ */
+void make_command(const char *name);
+
+/*
+ * Times q completions of random prefixes and prints the latencies.
+ */
+void bench_complete(long q, long n);
+
+/*
+ * Returns 1 if every name in [0, n) other than the removed ones is in the
+ * trie and the trie has nothing else.
+ */
+int check_trie(long n, long removed_below);
+
+
+double now_s(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void make_command(const char *name){
+  char path[PATH_MAX + NAME_MAX + 2];
+  snprintf(path, sizeof(path), "%s/%s", scratch, name);
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+  if(fd < 0){
+    perror(path);
+    exit(1);
+  }
+  close(fd);
+}
+
+/*
+ * Names that look like commands: mostly letters, some with a dash or
+ * digits, many sharing their first few letters.
+ */
+char* random_name(long i){
+  static const char *stems[] = { "git", "x", "py", "gcc", "lib", "k", "perl", "apt", "sys", "z" };
+  char buf[64];
+  int len = snprintf(buf, sizeof(buf), "%s", stems[rand() % 10]);
+  int extra = 2 + rand() % 8;
+  while(extra-- > 0)
+    buf[len++] = 'a' + rand() % 26;
+  len += snprintf(buf + len, sizeof(buf) - len, "-%ld", i);
+  char *name = strdup(buf);
+  if(!name){
+    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN RANDOM_NAME.\n");
+    exit(1);
+  }
+  return name;
+}
+
+void count_name(const char *name, void *arg){
+  (void)name;
+  (*(long *)arg)++;
+}
+
+int cmp_double(const void *a, const void *b){
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+void bench_complete(long q, long n){
+  double *t = malloc(q * sizeof(double));
+  if(!t){
+    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN BENCH_COMPLETE.\n");
+    exit(1);
+  }
+
+  long i, listed = 0;
+  for(i = 0; i < q; i++){
+    const char *name = names[rand() % n];
+    size_t plen = 1 + rand() % 4;
+    if(plen > strlen(name))
+      plen = strlen(name);
+
+    double start = now_s();
+    completion_update();
+    uint32_t node = trie_find(&completion.path, name, plen);
+    if(node != TRIE_NONE){
+      char common[NAME_MAX + 1];
+      memcpy(common, name, plen);
+      common[plen] = '\0';
+      trie_common(&completion.path, node, common, sizeof(common));
+      trie_each(&completion.path, node, name, plen, count_name, &listed, 100);
+    }
+    t[i] = now_s() - start;
+  }
+
+  qsort(t, q, sizeof(double), cmp_double);
+  printf("complete   p50 %8.1f us   p99 %8.1f us   max %8.1f us   %ld names listed\n",
+         t[q / 2] * 1e6, t[(long)(q * 0.99)] * 1e6, t[q - 1] * 1e6, listed);
+  free(t);
+}
+
+int check_trie(long n, long removed_below){
+  long i;
+  for(i = 0; i < n; i++){
+    uint32_t node = trie_find(&completion.path, names[i], strlen(names[i]));
+    int present = node != TRIE_NONE && completion.path.nodes[node].terminal;
+    if(present != (i >= removed_below))
+      return 0;
+  }
+  return completion.path.nodes[0].count == (uint32_t)(n - removed_below);
+}
+
+int main(int argc, char **argv){
+  char *dir = "/tmp";
+  long n = 50000;
+  long q = 10000;
+  long changes = 1000;
+  int opt;
+
+  while((opt = getopt(argc, argv, "n:q:c:d:")) != -1){
+    switch(opt){
+      case 'n':
+        n = atol(optarg);
+        break;
+      case 'q':
+        q = atol(optarg);
+        break;
+      case 'c':
+        changes = atol(optarg);
+        break;
+      case 'd':
+        dir = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n commands] [-q queries] [-c changes] [-d dir]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(n <= 0 || q <= 0 || changes < 0 || changes > n){
+    fprintf(stderr, "ERROR: counts must be positive and changes at most commands.\n");
+    return 1;
+  }
+
+  snprintf(scratch, sizeof(scratch), "%s/compbench.%d", dir, (int)getpid());
+  if(mkdir(scratch, 0755) != 0){
+    perror(scratch);
+    return 1;
+  }
+  names = malloc((n + changes) * sizeof(char *));
+  if(!names){
+    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN MAIN.\n");
+    return 1;
+  }
+  srand(1);
+  long i;
+  for(i = 0; i < n; i++){
+    names[i] = random_name(i);
+    make_command(names[i]);
+  }
+
+  completion_init(scratch);
+  double start = now_s();
+  completion_update();
+  double t_build = now_s() - start;
+  printf("%ld commands, %u trie nodes\n", n, completion.path.n);
+  printf("build      %10.1f ms   readdir and stat of every command\n", t_build * 1e3);
+
+  bench_complete(q, n);
+
+  // Add and remove commands while msh is "at the prompt", then press Tab.
+  for(i = 0; i < changes; i++){
+    char path[PATH_MAX + NAME_MAX + 2];
+    names[n + i] = random_name(n + i);
+    make_command(names[n + i]);
+    snprintf(path, sizeof(path), "%s/%s", scratch, names[i]);
+    unlink(path);
+  }
+  unsigned long rebuilds = completion.rebuilds;
+  start = now_s();
+  completion_update();
+  double t_update = now_s() - start;
+  printf("update     %10.1f ms   %ld added, %ld removed, %lu events, %lu rebuilds\n", t_update * 1e3,
+         changes, changes, completion.events, completion.rebuilds - rebuilds);
+
+  int ok = check_trie(n + changes, changes);
+  printf("update     %s\n", ok ? "trie matches the directory" : "TRIE OUT OF DATE");
+
+  for(i = changes; i < n + changes; i++){
+    char path[PATH_MAX + NAME_MAX + 2];
+    snprintf(path, sizeof(path), "%s/%s", scratch, names[i]);
+    unlink(path);
+  }
+  for(i = 0; i < n + changes; i++){
+    free(names[i]);
+  }
+  free(names);
+  rmdir(scratch);
+  completion_free();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,420 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Command name completion for the Maverick Shell.
+ *
+ * The executables of the search path are kept in a prefix trie. Every
+ * node counts the names below it, so the number of completions of a
+ * prefix is known as soon as the prefix is found, and the longest common
+ * continuation is a walk down nodes with a single live child. Nothing is
+ * rescanned after the first Tab: an inotify watch on every search
+ * directory reports each file added, removed, renamed or chmodded, and
+ * only that name is looked up again in the directories. The current
+ * directory has a trie of its own, which is rebuilt after a cd.
+ *
+ * Names that disappear keep their nodes, with a count of zero, so a
+ * reinstalled program does not allocate again.
+ */
+
+#ifndef __COMPLETE_H__
+#define __COMPLETE_H__
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+#define TRIE_NONE    UINT32_MAX
+#define TRIE_EVENTS  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                      IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct trie_node {
+  uint32_t  child;      // first child, children are sorted by c
+  uint32_t  sibling;
+  uint32_t  count;      // names that end at or below this node
+  uint8_t   terminal;   // a name ends here
+  char      c;
+};
+
+struct trie {
+  struct trie_node *nodes;   // nodes[0] is the root
+  uint32_t          n;
+  uint32_t          cap;
+  char            **dirs;    // directories the names come from, each ending with '/'
+  int              *wds;     // inotify watch of each directory, -1 if there is none
+  int               ndirs;
+};
+
+struct completion {
+  int           inotify_fd;
+  int           built;
+  struct trie   path;       // the search path
+  struct trie   cwd;        // the current directory
+  dev_t         cwd_dev;
+  ino_t         cwd_ino;
+  unsigned long events;     // inotify events applied, for the curious
+  unsigned long rebuilds;
+};
+
+static struct completion completion = { .inotify_fd = -1 };
+
+/*
+ * Splits search_path into the directories to complete from. Nothing is read
+ * until the first completion_update().
+ */
+void completion_init(const char *search_path);
+
+/*
+ * Builds the tries the first time, then applies whatever inotify reported and
+ * rebuilds the current directory's trie if we are somewhere else now. Cheap
+ * when nothing changed.
+ */
+void completion_update();
+
+/*
+ * Returns the node prefix ends at, or TRIE_NONE if no name starts with it.
+ */
+uint32_t trie_find(struct trie *t, const char *prefix, size_t plen);
+
+/*
+ * Appends to out (of size cap, kept NUL terminated) the characters every name
+ * below node continues with. Returns how many were appended.
+ */
+size_t trie_common(struct trie *t, uint32_t node, char *out, size_t cap);
+
+/*
+ * Calls fn with every name below node, in order, each one being prefix plus
+ * the rest, until max names have been given. Returns the number given.
+ */
+int trie_each(struct trie *t, uint32_t node, const char *prefix, size_t plen,
+              void (*fn)(const char *name, void *arg), void *arg, int max);
+
+/*
+ * Frees the tries and closes the inotify descriptor.
+ */
+void completion_free();
+
+
+uint32_t trie_new_node(struct trie *t, char c){
+  if(t->n == t->cap){
+    t->cap = t->cap ? t->cap * 2 : 1024;
+    t->nodes = xrealloc(t->nodes, t->cap * sizeof(struct trie_node), "TRIE_NEW_NODE");
+  }
+  struct trie_node *node = &t->nodes[t->n];
+  node->child = TRIE_NONE;
+  node->sibling = TRIE_NONE;
+  node->count = 0;
+  node->terminal = 0;
+  node->c = c;
+  return t->n++;
+}
+
+void trie_clear(struct trie *t){
+  t->n = 0;
+  trie_new_node(t, '\0');
+}
+
+/*
+ * Marks name as present or absent, creating its nodes only if it is present.
+ */
+void trie_set(struct trie *t, const char *name, int present){
+  uint32_t path[NAME_MAX + 2];
+  int depth = 0;
+  uint32_t node = 0;
+  const char *p;
+
+  path[depth++] = 0;
+  for(p = name; *p && depth < NAME_MAX + 1; p++){
+    uint32_t prev = TRIE_NONE;
+    uint32_t child = t->nodes[node].child;
+    while(child != TRIE_NONE && (unsigned char)t->nodes[child].c < (unsigned char)*p){
+      prev = child;
+      child = t->nodes[child].sibling;
+    }
+    if(child == TRIE_NONE || t->nodes[child].c != *p){
+      if(!present)
+        return;
+      // t->nodes may move here, so link the new node in by index afterwards.
+      uint32_t created = trie_new_node(t, *p);
+      t->nodes[created].sibling = child;
+      if(prev == TRIE_NONE)
+        t->nodes[node].child = created;
+      else
+        t->nodes[prev].sibling = created;
+      child = created;
+    }
+    node = child;
+    path[depth++] = node;
+  }
+
+  if(t->nodes[node].terminal == present)
+    return;
+  t->nodes[node].terminal = present;
+  int i;
+  for(i = 0; i < depth; i++){
+    if(present)
+      t->nodes[path[i]].count++;
+    else
+      t->nodes[path[i]].count--;
+  }
+}
+
+/*
+ * Returns 1 if dir/name is a file we could run.
+ */
+int trie_is_command(const char *dir, const char *name){
+  char full[PATH_MAX];
+  struct stat st;
+  if(snprintf(full, sizeof(full), "%s%s", dir, name) >= (int)sizeof(full))
+    return 0;
+  return stat(full, &st) == 0 && S_ISREG(st.st_mode) && access(full, X_OK) == 0;
+}
+
+/*
+ * Looks name up again in every directory of the trie after something happened to it.
+ */
+void trie_refresh(struct trie *t, const char *name){
+  int i;
+  int present = 0;
+  for(i = 0; i < t->ndirs && !present; i++){
+    present = trie_is_command(t->dirs[i], name);
+  }
+  trie_set(t, name, present);
+}
+
+/*
+ * Starts watching every directory of the trie and then reads them all, so
+ * nothing that changes while we read is missed.
+ */
+void trie_build(struct trie *t){
+  int i;
+  trie_clear(t);
+  for(i = 0; i < t->ndirs; i++){
+    if(t->wds[i] >= 0)
+      inotify_rm_watch(completion.inotify_fd, t->wds[i]);
+    t->wds[i] = completion.inotify_fd >= 0 ?
+                inotify_add_watch(completion.inotify_fd, t->dirs[i], TRIE_EVENTS | IN_ONLYDIR) : -1;
+  }
+  for(i = 0; i < t->ndirs; i++){
+    DIR *dir = opendir(t->dirs[i]);
+    struct dirent *entry;
+    if(dir == NULL)
+      continue;
+    while((entry = readdir(dir)) != NULL){
+      if(entry->d_name[0] == '.' && (entry->d_name[1] == '\0' ||
+         (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+        continue;
+      if(entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+        continue;
+      if(trie_is_command(t->dirs[i], entry->d_name))
+        trie_set(t, entry->d_name, 1);
+    }
+    closedir(dir);
+  }
+  completion.rebuilds++;
+}
+
+void trie_add_dir(struct trie *t, const char *dir, size_t len){
+  int i;
+  char *copy = xmalloc(len + 2, "TRIE_ADD_DIR");
+  memcpy(copy, dir, len);
+  copy[len] = '\0';
+  if(len == 0 || copy[len-1] != '/')
+    strcat(copy, "/");
+  // The same directory twice would only be read twice.
+  for(i = 0; i < t->ndirs; i++){
+    if(!strcmp(t->dirs[i], copy)){
+      free(copy);
+      return;
+    }
+  }
+  t->dirs = xrealloc(t->dirs, (t->ndirs + 1) * sizeof(char *), "TRIE_ADD_DIR");
+  t->wds = xrealloc(t->wds, (t->ndirs + 1) * sizeof(int), "TRIE_ADD_DIR");
+  t->dirs[t->ndirs] = copy;
+  t->wds[t->ndirs] = -1;
+  t->ndirs++;
+}
+
+void completion_init(const char *search_path){
+  const char *p = search_path;
+  completion_free();
+  while(*p){
+    size_t len = strcspn(p, ":");
+    // "." and "./" are the current directory, which has its own trie.
+    if(len > 0 && !(len == 1 && p[0] == '.') && !(len == 2 && !strncmp(p, "./", 2)))
+      trie_add_dir(&completion.path, p, len);
+    p += len;
+    if(*p == ':')
+      p++;
+  }
+  trie_add_dir(&completion.cwd, "./", 2);
+}
+
+/*
+ * Finds the trie and directory an inotify watch belongs to.
+ */
+struct trie* completion_watch(int wd){
+  struct trie *tries[2] = { &completion.path, &completion.cwd };
+  int i, j;
+  for(i = 0; i < 2; i++){
+    for(j = 0; j < tries[i]->ndirs; j++){
+      if(tries[i]->wds[j] == wd)
+        return tries[i];
+    }
+  }
+  return NULL;
+}
+
+void completion_update(){
+  struct stat st;
+
+  if(!completion.built){
+    completion.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    trie_build(&completion.path);
+    if(stat(".", &st) == 0){
+      completion.cwd_dev = st.st_dev;
+      completion.cwd_ino = st.st_ino;
+    }
+    trie_build(&completion.cwd);
+    completion.built = 1;
+    return;
+  }
+
+  // A watch on "./" follows the directory it was made on, not the name, so check for cd.
+  if(stat(".", &st) == 0 && (st.st_dev != completion.cwd_dev || st.st_ino != completion.cwd_ino)){
+    completion.cwd_dev = st.st_dev;
+    completion.cwd_ino = st.st_ino;
+    trie_build(&completion.cwd);
+  }
+
+  if(completion.inotify_fd < 0)
+    return;
+
+  char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+  while((n = read(completion.inotify_fd, buf, sizeof(buf))) > 0){
+    char *p = buf;
+    while(p < buf + n){
+      struct inotify_event *ev = (struct inotify_event *)p;
+      p += sizeof(struct inotify_event) + ev->len;
+      completion.events++;
+
+      if(ev->mask & IN_Q_OVERFLOW){
+        // Events were lost, so we no longer know what changed.
+        trie_build(&completion.path);
+        trie_build(&completion.cwd);
+        continue;
+      }
+      struct trie *t = completion_watch(ev->wd);
+      if(t == NULL)
+        continue;
+      if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)){
+        trie_build(t);
+        continue;
+      }
+      if(ev->len > 0 && !(ev->mask & IN_ISDIR))
+        trie_refresh(t, ev->name);
+    }
+  }
+}
+
+uint32_t trie_find(struct trie *t, const char *prefix, size_t plen){
+  uint32_t node = 0;
+  size_t i;
+  if(t->n == 0)
+    return TRIE_NONE;
+  for(i = 0; i < plen; i++){
+    uint32_t child = t->nodes[node].child;
+    while(child != TRIE_NONE && t->nodes[child].c != prefix[i])
+      child = t->nodes[child].sibling;
+    if(child == TRIE_NONE)
+      return TRIE_NONE;
+    node = child;
+  }
+  return t->nodes[node].count > 0 ? node : TRIE_NONE;
+}
+
+size_t trie_common(struct trie *t, uint32_t node, char *out, size_t cap){
+  size_t n = strlen(out);
+  size_t added = 0;
+  while(!t->nodes[node].terminal && n + 1 < cap){
+    // Exactly one child still has names below it, or we stop.
+    uint32_t only = TRIE_NONE;
+    uint32_t child;
+    for(child = t->nodes[node].child; child != TRIE_NONE; child = t->nodes[child].sibling){
+      if(t->nodes[child].count == 0)
+        continue;
+      if(only != TRIE_NONE){
+        only = TRIE_NONE;
+        break;
+      }
+      only = child;
+    }
+    if(only == TRIE_NONE)
+      break;
+    out[n++] = t->nodes[only].c;
+    out[n] = '\0';
+    added++;
+    node = only;
+  }
+  return added;
+}
+
+void trie_each_from(struct trie *t, uint32_t node, char *buf, size_t len,
+                    void (*fn)(const char *name, void *arg), void *arg, int *left){
+  if(t->nodes[node].terminal && *left > 0){
+    buf[len] = '\0';
+    fn(buf, arg);
+    (*left)--;
+  }
+  uint32_t child;
+  for(child = t->nodes[node].child; child != TRIE_NONE && *left > 0; child = t->nodes[child].sibling){
+    if(t->nodes[child].count == 0 || len + 1 >= NAME_MAX + 1)
+      continue;
+    buf[len] = t->nodes[child].c;
+    trie_each_from(t, child, buf, len + 1, fn, arg, left);
+  }
+}
+
+int trie_each(struct trie *t, uint32_t node, const char *prefix, size_t plen,
+              void (*fn)(const char *name, void *arg), void *arg, int max){
+  char buf[NAME_MAX + 1];
+  int left = max;
+  if(plen > NAME_MAX)
+    return 0;
+  memcpy(buf, prefix, plen);
+  trie_each_from(t, node, buf, plen, fn, arg, &left);
+  return max - left;
+}
+
+void trie_free(struct trie *t){
+  int i;
+  for(i = 0; i < t->ndirs; i++){
+    free(t->dirs[i]);
+  }
+  free(t->dirs);
+  free(t->wds);
+  free(t->nodes);
+  memset(t, 0, sizeof(struct trie));
+}
+
+void completion_free(){
+  if(completion.inotify_fd >= 0)
+    close(completion.inotify_fd);
+  trie_free(&completion.path);
+  trie_free(&completion.cwd);
+  memset(&completion, 0, sizeof(completion));
+  completion.inotify_fd = -1;
+}
+
+#endif
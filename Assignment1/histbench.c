@@ -0,0 +1,231 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Benchmark for the Maverick Shell history file and its search.
+ *
+ * Build and run:
+ *   gcc -O2 -o histbench histbench.c
+ *   ./histbench [-n lines] [-q queries] [-w writers] [-a appends] [-d dir]
+ *
+ * Writes a history file of n made up command lines (2 million by
+ * default) and times, through history.h itself, opening it, finding the
+ * line starts, building the trigram index and q searches for text taken
+ * from random lines (p50/p99/max). Then w processes append a lines each to
+ * the same file at once, and every line they wrote is checked to be there
+ * in one piece.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "history.h"
+
+/*
+ * Returns the monotonic clock in seconds.
+ */
+double now_s();
+
+/*
+ * Writes n lines that look like what people type at a shell.
+ */
+void make_history(const char *path, long n);
+
+/*
+ * Times q searches for substrings of random lines and prints the latencies.
+ */
+void bench_search(long q);
+
+/*
+ * Has writers processes append appends lines each, then checks them all.
+ * Returns 1 if every line is there exactly once.
+ */
+int bench_appends(const char *path, int writers, long appends);
+
+
+static const char *verbs[] = { "ls -l", "cd", "grep -rn", "make", "git log --oneline", "vim",
+                               "cat", "ssh", "tail -f", "find . -name", "gcc -O2 -o", "python3" };
+static const char *nouns[] = { "src", "build", "main.c", "README", "deploy.sh", "/var/log/syslog",
+                               "include", "tests", "prod-db-01", "Makefile", "notes.txt", "tmp" };
+
+double now_s(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void make_history(const char *path, long n){
+  FILE *fp = fopen(path, "w");
+  if(fp == NULL){
+    perror(path);
+    exit(1);
+  }
+  long i;
+  for(i = 0; i < n; i++){
+    fprintf(fp, "%s %s %s-%ld\n", verbs[rand() % 12], nouns[rand() % 12], nouns[rand() % 12],
+            (long)(rand() % 100000));
+  }
+  fclose(fp);
+}
+
+int cmp_double(const void *a, const void *b){
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+void bench_search(long q){
+  double *t = malloc(q * sizeof(double));
+  if(!t){
+    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN BENCH_SEARCH.\n");
+    exit(1);
+  }
+
+  size_t count = history_count();
+  long i, found = 0;
+  for(i = 0; i < q; i++){
+    // Up to 12 bytes from the end of a random line, which is the rare part.
+    size_t len;
+    const char *line = history_line(1 + rand() % count, &len);
+    size_t qlen = len < 12 ? len : (size_t)(4 + rand() % 9);
+    char query[16];
+    memcpy(query, line + len - qlen, qlen);
+
+    double start = now_s();
+    size_t n = history_search(query, qlen, count + 1);
+    t[i] = now_s() - start;
+    found += n != 0;
+  }
+
+  qsort(t, q, sizeof(double), cmp_double);
+  printf("search     p50 %8.1f us   p99 %8.1f us   max %8.1f us   %ld/%ld found\n",
+         t[q / 2] * 1e6, t[(long)(q * 0.99)] * 1e6, t[q - 1] * 1e6, found, q);
+  free(t);
+}
+
+int bench_appends(const char *path, int writers, long appends){
+  int w;
+  long i;
+  double start = now_s();
+
+  for(w = 0; w < writers; w++){
+    pid_t pid = fork();
+    if(pid == 0){
+      if(history_open(path) != 0)
+        _exit(1);
+      char line[64];
+      for(i = 0; i < appends; i++){
+        int len = snprintf(line, sizeof(line), "echo writer %d line %ld", w, i);
+        history_add(line, len);
+      }
+      _exit(0);
+    }
+  }
+  while(wait(NULL) > 0){
+  }
+  double t = now_s() - start;
+  printf("appends    %d writers x %ld lines   %10.0f lines/s\n", writers, appends, writers * appends / t);
+
+  // Every writer's lines must all be there, whole and in order.
+  long *next = calloc(writers, sizeof(long));
+  size_t count = history_count();
+  size_t n;
+  int ok = 1;
+  for(n = 1; n <= count; n++){
+    size_t len;
+    const char *line = history_line(n, &len);
+    int who;
+    long seq;
+    char buf[64];
+    if(len >= sizeof(buf) || strncmp(line, "echo writer ", 12) != 0)
+      continue;
+    memcpy(buf, line, len);
+    buf[len] = '\0';
+    if(sscanf(buf, "echo writer %d line %ld", &who, &seq) != 2 || who < 0 || who >= writers ||
+       seq != next[who]){
+      ok = 0;
+      break;
+    }
+    next[who]++;
+  }
+  for(w = 0; w < writers && ok; w++){
+    if(next[w] != appends)
+      ok = 0;
+  }
+  printf("appends    %s\n", ok ? "every line intact" : "LINES MISSING OR TORN");
+  free(next);
+  return ok;
+}
+
+int main(int argc, char **argv){
+  char *dir = "/tmp";
+  long n = 2000000;
+  long q = 1000;
+  int writers = 4;
+  long appends = 10000;
+  int opt;
+
+  while((opt = getopt(argc, argv, "n:q:w:a:d:")) != -1){
+    switch(opt){
+      case 'n':
+        n = atol(optarg);
+        break;
+      case 'q':
+        q = atol(optarg);
+        break;
+      case 'w':
+        writers = atoi(optarg);
+        break;
+      case 'a':
+        appends = atol(optarg);
+        break;
+      case 'd':
+        dir = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n lines] [-q queries] [-w writers] [-a appends] [-d dir]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(n <= 0 || q <= 0 || writers <= 0 || appends <= 0){
+    fprintf(stderr, "ERROR: every count must be positive.\n");
+    return 1;
+  }
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/histbench.%d", dir, (int)getpid());
+  srand(1);
+  make_history(path, n);
+
+  double start = now_s();
+  if(history_open(path) != 0){
+    perror(path);
+    return 1;
+  }
+  double t_open = now_s() - start;
+
+  start = now_s();
+  size_t count = history_count();
+  double t_count = now_s() - start;
+
+  start = now_s();
+  history_search("no such text anywhere", 21, count + 1);
+  double t_index = now_s() - start;
+
+  printf("%zu lines\n", count);
+  printf("open       %10.1f us\n", t_open * 1e6);
+  printf("lines      %10.1f ms   first !n or search\n", t_count * 1e3);
+  printf("trigrams   %10.1f ms   first search, %u trigrams\n", t_index * 1e3, history.ntrigrams);
+  bench_search(q);
+
+  int ok = bench_appends(path, writers, appends);
+  history_close();
+  unlink(path);
+  return ok ? 0 : 1;
+}
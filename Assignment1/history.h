@@ -0,0 +1,477 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Persistent command history for the Maverick Shell.
+ *
+ * History is a plain text file, one command per line, that is only ever
+ * appended to. Opening it is an open and an mmap, whatever its size; the
+ * lines are not looked at until something needs them. The first !n or
+ * search finds the line starts, and the first search builds a trigram
+ * index: for every three byte sequence, the lines it occurs in. A search
+ * only checks the lines listed for the rarest trigram of the query, so it
+ * stays well under a millisecond with millions of lines. Both indexes are
+ * extended, never rebuilt, as the file grows.
+ *
+ * Several msh instances can share the file. Each line is added with a
+ * single write() to a file opened with O_APPEND, under flock(), so lines
+ * never interleave. Lines other instances add show up the next time the
+ * history is looked at: the map is grown to the new size of the file and
+ * the new lines are indexed.
+ */
+
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+#define HISTORY_FILE  ".msh_history"
+
+struct history_trigram {
+  uint32_t  key;     // the three bytes plus one, 0 marks an empty slot
+  uint32_t  n;
+  uint32_t  cap;
+  uint32_t *lines;   // line numbers in increasing order
+};
+
+struct history {
+  int                     fd;          // -1 when there is no history file
+  char                   *map;
+  size_t                  mapped;      // bytes of the file in map
+  uint64_t               *starts;      // offset of every line, starts[0] is line 1
+  size_t                  nlines;
+  size_t                  starts_cap;
+  size_t                  indexed;     // bytes of the file covered by starts
+  struct history_trigram *trigrams;
+  uint32_t                ntrigrams;
+  uint32_t                trigrams_cap;   // power of two
+  size_t                  tri_lines;      // lines in the trigram index
+};
+
+static struct history history = { .fd = -1 };
+
+/*
+ * Opens (creating it if needed) the history file at path. Takes the same time
+ * for any file size. Returns -1 if it could not be opened.
+ */
+int history_open(const char *path);
+
+/*
+ * Returns the history file to use: MSH_HISTORY, or ~/.msh_history. NULL if
+ * there is neither.
+ */
+const char* history_default_path();
+
+/*
+ * Appends the first len bytes of line, which should not include the newline.
+ */
+void history_add(const char *line, size_t len);
+
+/*
+ * Catches up with the file: maps what other instances appended and finds the
+ * new line starts. Returns the number of lines.
+ */
+size_t history_count();
+
+/*
+ * Returns line n (from 1) and its length, not NUL terminated. NULL if there is
+ * no such line.
+ */
+const char* history_line(size_t n, size_t *len);
+
+/*
+ * Returns the number of the most recent line before line before that contains
+ * query, or 0 if there is none. before past the last line searches everything.
+ */
+size_t history_search(const char *query, size_t qlen, size_t before);
+
+/*
+ * Replaces !!, !n, !-n and !prefix outside single quotes with the lines they
+ * name. Returns line itself if there was nothing to replace, a new string from
+ * arena if there was, and NULL after printing a message if a line does not
+ * exist.
+ */
+char* history_expand(struct arena *arena, char *line);
+
+/*
+ * Unmaps and closes the file and frees the indexes.
+ */
+void history_close();
+
+/*
+ * Builtin: history prints every line, history n the last n, and history -s text
+ * the lines containing text, most recent first.
+ */
+int builtin_history(char **token);
+
+
+int history_open(const char *path){
+  int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  if(fd < 0)
+    return -1;
+  history_close();
+  history.fd = fd;
+  return 0;
+}
+
+const char* history_default_path(){
+  static char *path = NULL;
+  const char *env = getenv("MSH_HISTORY");
+  if(env != NULL)
+    return env[0] != '\0' ? env : NULL;
+  const char *home = getenv("HOME");
+  if(home == NULL)
+    return NULL;
+  if(path == NULL){
+    path = xmalloc(strlen(home) + strlen(HISTORY_FILE) + 2, "HISTORY_DEFAULT_PATH");
+    sprintf(path, "%s/%s", home, HISTORY_FILE);
+  }
+  return path;
+}
+
+void history_add(const char *line, size_t len){
+  if(history.fd < 0 || len == 0)
+    return;
+
+  char stack[4096];
+  char *buf = len + 2 <= sizeof(stack) ? stack : xmalloc(len + 2, "HISTORY_ADD");
+  size_t n = 0;
+
+  flock(history.fd, LOCK_EX);
+  // A line left without its newline by a crash would swallow ours.
+  struct stat st;
+  char last = '\n';
+  if(fstat(history.fd, &st) == 0 && st.st_size > 0)
+    if(pread(history.fd, &last, 1, st.st_size - 1) != 1)
+      last = '\n';
+  if(last != '\n')
+    buf[n++] = '\n';
+  memcpy(buf + n, line, len);
+  n += len;
+  buf[n++] = '\n';
+  if(write(history.fd, buf, n) != (ssize_t)n)
+    perror("history");
+  flock(history.fd, LOCK_UN);
+
+  if(buf != stack)
+    free(buf);
+}
+
+/*
+ * Grows the map to the size of the file.
+ */
+void history_remap(){
+  struct stat st;
+  if(fstat(history.fd, &st) != 0 || (size_t)st.st_size <= history.mapped)
+    return;
+
+  void *map;
+  if(history.map == NULL)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, history.fd, 0);
+  else
+    map = mremap(history.map, history.mapped, st.st_size, MREMAP_MAYMOVE);
+  if(map == MAP_FAILED)
+    return;
+  history.map = map;
+  history.mapped = st.st_size;
+}
+
+size_t history_count(){
+  if(history.fd < 0)
+    return 0;
+  history_remap();
+
+  // Only complete lines count; another instance may be half way through a write.
+  while(history.indexed < history.mapped){
+    char *nl = memchr(history.map + history.indexed, '\n', history.mapped - history.indexed);
+    if(nl == NULL)
+      break;
+    if(history.nlines == history.starts_cap){
+      history.starts_cap = history.starts_cap ? history.starts_cap * 2 : 4096;
+      history.starts = xrealloc(history.starts, history.starts_cap * sizeof(uint64_t), "HISTORY_COUNT");
+    }
+    history.starts[history.nlines++] = history.indexed;
+    history.indexed = nl - history.map + 1;
+  }
+  return history.nlines;
+}
+
+const char* history_line(size_t n, size_t *len){
+  if(n == 0 || n > history.nlines)
+    return NULL;
+  uint64_t start = history.starts[n - 1];
+  uint64_t end = n < history.nlines ? history.starts[n] : history.indexed;
+  *len = end - start - 1;
+  return history.map + start;
+}
+
+uint32_t history_trigram_key(const char *s){
+  return (((uint32_t)(unsigned char)s[0] << 16) | ((uint32_t)(unsigned char)s[1] << 8) |
+          (unsigned char)s[2]) + 1;
+}
+
+/*
+ * Returns the slot for key, which is empty if key has no lines yet.
+ */
+struct history_trigram* history_trigram_slot(uint32_t key){
+  uint32_t mask = history.trigrams_cap - 1;
+  uint32_t h = key * 2654435761u;
+  uint32_t i = (h ^ (h >> 16)) & mask;
+  while(history.trigrams[i].key != 0 && history.trigrams[i].key != key)
+    i = (i + 1) & mask;
+  return &history.trigrams[i];
+}
+
+void history_trigram_grow(){
+  struct history_trigram *old = history.trigrams;
+  uint32_t old_cap = history.trigrams_cap;
+  uint32_t i;
+
+  history.trigrams_cap = old_cap ? old_cap * 2 : 4096;
+  history.trigrams = xmalloc(history.trigrams_cap * sizeof(struct history_trigram), "HISTORY_TRIGRAM_GROW");
+  memset(history.trigrams, 0, history.trigrams_cap * sizeof(struct history_trigram));
+  for(i = 0; i < old_cap; i++){
+    if(old[i].key != 0)
+      *history_trigram_slot(old[i].key) = old[i];
+  }
+  free(old);
+}
+
+/*
+ * Adds the lines not in the trigram index yet.
+ */
+void history_index_trigrams(){
+  while(history.tri_lines < history.nlines){
+    size_t n = ++history.tri_lines;
+    size_t len;
+    const char *line = history_line(n, &len);
+    size_t i;
+
+    for(i = 0; i + 3 <= len; i++){
+      if((history.ntrigrams + 1) * 2 > history.trigrams_cap)
+        history_trigram_grow();
+      uint32_t key = history_trigram_key(line + i);
+      struct history_trigram *t = history_trigram_slot(key);
+      if(t->key == 0){
+        t->key = key;
+        history.ntrigrams++;
+      }
+      // A trigram seen twice in the same line is listed once.
+      if(t->n > 0 && t->lines[t->n - 1] == n)
+        continue;
+      if(t->n == t->cap){
+        t->cap = t->cap ? t->cap * 2 : 4;
+        t->lines = xrealloc(t->lines, t->cap * sizeof(uint32_t), "HISTORY_INDEX_TRIGRAMS");
+      }
+      t->lines[t->n++] = n;
+    }
+  }
+}
+
+/*
+ * Returns 1 if line n contains query.
+ */
+int history_matches(size_t n, const char *query, size_t qlen){
+  size_t len;
+  const char *line = history_line(n, &len);
+  return line != NULL && memmem(line, len, query, qlen) != NULL;
+}
+
+size_t history_search(const char *query, size_t qlen, size_t before){
+  size_t count = history_count();
+  size_t n;
+  size_t i;
+
+  if(before > count + 1)
+    before = count + 1;
+
+  // Too short for a trigram: check every line, newest first.
+  if(qlen < 3){
+    for(n = before - 1; n >= 1; n--){
+      if(history_matches(n, query, qlen))
+        return n;
+    }
+    return 0;
+  }
+
+  history_index_trigrams();
+  if(history.trigrams_cap == 0)
+    return 0;
+
+  // Every match is in the list of each trigram of the query, so walking the shortest is enough.
+  struct history_trigram *best = NULL;
+  for(i = 0; i + 3 <= qlen; i++){
+    struct history_trigram *t = history_trigram_slot(history_trigram_key(query + i));
+    if(t->key == 0)
+      return 0;
+    if(best == NULL || t->n < best->n)
+      best = t;
+  }
+
+  // Start from the last line listed before before.
+  size_t lo = 0, hi = best->n;
+  while(lo < hi){
+    size_t mid = (lo + hi) / 2;
+    if(best->lines[mid] < before)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  while(lo > 0){
+    n = best->lines[--lo];
+    if(history_matches(n, query, qlen))
+      return n;
+  }
+  return 0;
+}
+
+/*
+ * Returns the line a reference after '!' names and how many bytes it took, or
+ * 0 if it is not a reference at all. Sets *missing if the line does not exist.
+ */
+size_t history_reference(const char *p, size_t *used, int *missing){
+  size_t count = history_count();
+  size_t n = 0;
+  char *end;
+
+  *used = 0;
+  *missing = 0;
+  if(p[0] == '!'){
+    *used = 1;
+    n = count;
+  }
+  else if(p[0] >= '0' && p[0] <= '9'){
+    n = strtoul(p, &end, 10);
+    *used = end - p;
+  }
+  else if(p[0] == '-' && p[1] >= '0' && p[1] <= '9'){
+    size_t back = strtoul(p + 1, &end, 10);
+    *used = end - p;
+    n = back <= count ? count + 1 - back : 0;
+  }
+  else if(p[0] != '\0' && strchr(" \t\n=(", p[0]) == NULL){
+    // !prefix: the most recent line starting with the word.
+    size_t plen = strcspn(p, " \t\n;|&<>'\"");
+    size_t len;
+    *used = plen;
+    for(n = count; n >= 1; n--){
+      const char *line = history_line(n, &len);
+      if(len >= plen && !memcmp(line, p, plen))
+        break;
+    }
+  }
+  else{
+    return 0;
+  }
+
+  if(n == 0 || n > count)
+    *missing = 1;
+  return n;
+}
+
+char* history_expand(struct arena *arena, char *line){
+  char *out = NULL;
+  size_t len = 0, cap = 0;
+  int quoted = 0;
+  char *p;
+  char *copied = line;   // line up to here is in out already
+
+  for(p = line; *p; p++){
+    if(*p == '\'')
+      quoted = !quoted;
+    if(quoted || *p != '!' || (p > line && p[-1] == '\\'))
+      continue;
+
+    size_t used;
+    int missing;
+    size_t n = history_reference(p + 1, &used, &missing);
+    if(used == 0 || (n == 0 && !missing))
+      continue;
+    if(missing){
+      printf("!%.*s: event not found.\n", (int)used, p + 1);
+      return NULL;
+    }
+
+    size_t hlen;
+    const char *h = history_line(n, &hlen);
+    size_t before = p - copied;
+    size_t want = len + before + hlen + strlen(p) + 1;
+    if(want > cap){
+      size_t new_cap = want * 2;
+      out = arena_grow(arena, out, cap, new_cap);
+      cap = new_cap;
+    }
+    memcpy(out + len, copied, before);
+    len += before;
+    memcpy(out + len, h, hlen);
+    len += hlen;
+    p += used;
+    copied = p + 1;
+  }
+
+  if(out == NULL)
+    return line;
+  strcpy(out + len, copied);
+  return out;
+}
+
+void history_close(){
+  uint32_t i;
+  if(history.map != NULL)
+    munmap(history.map, history.mapped);
+  if(history.fd >= 0)
+    close(history.fd);
+  for(i = 0; i < history.trigrams_cap; i++){
+    free(history.trigrams[i].lines);
+  }
+  free(history.trigrams);
+  free(history.starts);
+  memset(&history, 0, sizeof(history));
+  history.fd = -1;
+}
+
+int builtin_history(char **token){
+  size_t count = history_count();
+  size_t len;
+  const char *line;
+  size_t n;
+
+  if(token[1] != NULL && !strcmp(token[1], "-s")){
+    if(token[2] == NULL){
+      printf("history: -s needs the text to look for.\n");
+      return 2;
+    }
+    size_t qlen = strlen(token[2]);
+    int found = 0;
+    for(n = history_search(token[2], qlen, count + 1); n != 0; n = history_search(token[2], qlen, n)){
+      line = history_line(n, &len);
+      printf("%5zu  %.*s\n", n, (int)len, line);
+      found = 1;
+    }
+    return !found;
+  }
+
+  size_t first = 1;
+  if(token[1] != NULL){
+    size_t last = strtoul(token[1], NULL, 10);
+    if(last < count)
+      first = count - last + 1;
+  }
+  for(n = first; n <= count; n++){
+    line = history_line(n, &len);
+    printf("%5zu  %.*s\n", n, (int)len, line);
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,587 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Job control for the Maverick Shell.
+ *
+ * Every pipeline msh starts becomes a job in its own process group. Children
+ * are never waited for directly: the SIGCHLD handler only writes a byte to a
+ * pipe, and whoever is waiting (the prompt, fg or wait) polls that pipe and
+ * calls jobs_reap(), which collects every child that changed state. That way
+ * background jobs are reaped while msh sits at the prompt and a foreground
+ * job is just a job msh chose to wait on.
+ */
+
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "stats.h"
+
+/*
+ * showpid prints at most this many pids.
+ */
+#define SHOWPID_MAX 10
+
+enum JOB_STATE
+{
+  JOB_RUNNING = 0,
+  JOB_STOPPED = 1,
+  JOB_DONE    = 2
+};
+
+char * jobStateAsString[ 3 ] =
+{
+  "Running",
+  "Stopped",
+  "Done"
+};
+
+struct job {
+  int     id;          // number shown as [n], 0 marks a free slot
+  pid_t   pgid;        // the first stage; its process group only if grouped
+  int     grouped;     // has a process group of its own
+  pid_t  *pids;        // one per stage that was started
+  int    *status;      // wait status of each stage, -1 until it is reaped
+  char   *names;       // STATS_NAME_MAX bytes per stage, the name its stats go under
+  int     npids;
+  int     pids_cap;
+  int     live;        // stages that have not exited yet
+  int     state;
+  int     background;
+  int     notify;      // state changed while nobody was watching
+  char   *cmd;
+  size_t  cmd_cap;     // the slot keeps its buffers, so reusing it costs no heap calls
+  double  started;     // stats_now() when the job was created
+  struct cmd_usage usage;  // of the stages that have exited so far
+};
+
+struct job_table {
+  struct job *jobs;
+  int         cap;
+  pid_t       recent_pids[SHOWPID_MAX];  // ring of the last pids started, for showpid
+  int         nrecent;
+  int         next_recent;
+  int         sigchld_pipe[2];
+  int         interactive;
+  pid_t       shell_pgid;
+};
+
+static struct job_table job_table;
+
+/*
+ * Set by the SIGINT handler so a blocking wait can give up.
+ */
+static volatile sig_atomic_t interrupted = 0;
+
+/*
+ * Creates the SIGCHLD pipe and handler. If stdin is a terminal msh takes it over
+ * so it can hand it to foreground jobs.
+ */
+void jobs_init();
+
+/*
+ * Called in a child msh forks to run a line on its own: it gets a SIGCHLD pipe of
+ * its own and an empty job table, and never touches the terminal.
+ */
+void jobs_reset_child();
+
+/*
+ * Turns a wait status into an exit status the way sh does: 128 plus the signal
+ * for a child that was killed.
+ */
+int exit_code(int status);
+
+/*
+ * Collects every child that exited, stopped or continued without blocking and
+ * updates its job. Stages that exited are added to the stats.
+ */
+void jobs_reap();
+
+/*
+ * Blocks until SIGCHLD arrives, or until fd (if not -1) is readable. Returns 1 if
+ * fd is readable, 0 after reaping children and -1 if a signal interrupted the
+ * wait.
+ */
+int jobs_wait_event(int fd);
+
+/*
+ * Takes a free slot for a new job running cmd.
+ */
+struct job* job_create(const char *cmd, int background);
+
+/*
+ * Records a stage of the job. The first pid becomes the process group. The stats
+ * of the stage go under name, or nowhere if name is NULL.
+ */
+void job_add_pid(struct job *job, pid_t pid, const char *name);
+
+/*
+ * The pgid to start the job's next stage with. With a terminal every job gets a
+ * process group of its own so the terminal can be handed to it. Without one a
+ * foreground job stays in msh's group, where ctrl-C reaches it as it did before
+ * job control, and only background jobs are kept apart from it.
+ */
+pid_t job_spawn_pgid(struct job *job);
+
+/*
+ * Sends sig to the job: to its process group if it has one, otherwise to each
+ * stage that has not been reaped yet.
+ */
+void job_signal(struct job *job, int sig);
+
+/*
+ * Gives the terminal to the job and waits until it is done or stopped. Done jobs
+ * are removed. Returns the wait status of the last stage, and if usage is not
+ * NULL fills it in with what the job used.
+ */
+int job_wait_fg(struct job *job, struct cmd_usage *usage);
+
+/*
+ * Removes jobs that finished in the background since the last prompt. If verbose
+ * they are printed, along with jobs that stopped.
+ */
+void jobs_notify(int verbose);
+
+/*
+ * Finds a job from "%n" or "n". NULL spec means the most recent job. Returns NULL
+ * if there is no such job.
+ */
+struct job* job_find(const char *spec);
+
+/*
+ * Finds a job by its number. Returns NULL if there is no such job.
+ */
+struct job* job_find_id(int id);
+
+/*
+ * Frees the slot.
+ */
+void job_remove(struct job *job);
+
+/*
+ * Prints "[n] State<tab>cmd", with a trailing & for jobs running in the background.
+ */
+void job_print(struct job *job);
+
+/*
+ * Builtins: jobs, fg, bg, wait and showpid. Each takes the argv of the command and returns its
+ * exit status; fg returns the one of the job it waited for.
+ */
+int builtin_jobs(char **token);
+int builtin_fg(char **token);
+int builtin_bg(char **token);
+int builtin_wait(char **token);
+int builtin_showpid(char **token);
+
+
+static void handle_sigchld(int sig){
+  (void)sig;
+  int saved = errno;
+  char c = 0;
+  // Non blocking: if the pipe is full a wakeup is already pending.
+  if(write(job_table.sigchld_pipe[1], &c, 1) < 0){
+  }
+  errno = saved;
+}
+
+void jobs_init(){
+  if(pipe2(job_table.sigchld_pipe, O_CLOEXEC | O_NONBLOCK) != 0){
+    perror("pipe");
+    exit(1);
+  }
+
+  struct sigaction act;
+  memset(&act, '\0', sizeof(act));
+  act.sa_handler = &handle_sigchld;
+  act.sa_flags = SA_RESTART;
+  if(sigaction(SIGCHLD, &act, NULL) < 0){
+    perror("sigaction:");
+    exit(1);
+  }
+
+  job_table.interactive = isatty(0);
+  job_table.shell_pgid = getpgrp();
+  if(job_table.interactive){
+    // Needed to move the terminal between jobs while not in the foreground ourselves.
+    signal(SIGTTOU, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    if(setpgid(0, 0) == 0)
+      job_table.shell_pgid = getpid();
+    tcsetpgrp(0, job_table.shell_pgid);
+  }
+}
+
+void jobs_reset_child(){
+  int i;
+  close(job_table.sigchld_pipe[0]);
+  close(job_table.sigchld_pipe[1]);
+  if(pipe2(job_table.sigchld_pipe, O_CLOEXEC | O_NONBLOCK) != 0){
+    perror("pipe");
+    _exit(1);
+  }
+  for(i = 0; i < job_table.cap; i++){
+    job_table.jobs[i].id = 0;
+  }
+  job_table.interactive = 0;
+}
+
+int exit_code(int status){
+  if(WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return WEXITSTATUS(status);
+}
+
+struct job* job_by_pid(pid_t pid, int *stage){
+  int i, j;
+  for(i = 0; i < job_table.cap; i++){
+    struct job *job = &job_table.jobs[i];
+    if(job->id == 0)
+      continue;
+    for(j = 0; j < job->npids; j++){
+      if(job->pids[j] == pid){
+        *stage = j;
+        return job;
+      }
+    }
+  }
+  return NULL;
+}
+
+void jobs_reap(){
+  char drain[64];
+  while(read(job_table.sigchld_pipe[0], drain, sizeof(drain)) > 0){
+  }
+
+  pid_t pid;
+  int status;
+  struct rusage ru;
+  while((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0){
+    int stage;
+    struct job *job = job_by_pid(pid, &stage);
+    if(job == NULL)
+      continue;
+
+    if(WIFSTOPPED(status)){
+      job->state = JOB_STOPPED;
+      job->notify = 1;
+    }
+    else if(WIFCONTINUED(status)){
+      job->state = JOB_RUNNING;
+    }
+    else{
+      double wall = stats_now() - job->started;
+      job->status[stage] = status;
+      usage_add(&job->usage, &ru);
+      job->usage.wall = wall;
+      if(job->names[stage * STATS_NAME_MAX] != '\0')
+        stats_record(&job->names[stage * STATS_NAME_MAX], pid, exit_code(status), wall, &ru);
+      job->live--;
+      if(job->live == 0){
+        job->state = JOB_DONE;
+        job->notify = 1;
+      }
+    }
+  }
+}
+
+int jobs_wait_event(int fd){
+  struct pollfd fds[2];
+  fds[0].fd = job_table.sigchld_pipe[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = fd;
+  fds[1].events = POLLIN;
+
+  while(1){
+    int n = poll(fds, fd >= 0 ? 2 : 1, -1);
+    if(n < 0){
+      if(errno == EINTR && interrupted)
+        return -1;
+      continue;
+    }
+    if(fds[0].revents){
+      jobs_reap();
+      return 0;
+    }
+    if(fd >= 0 && fds[1].revents)
+      return 1;
+  }
+}
+
+struct job* job_create(const char *cmd, int background){
+  int i;
+  int max_id = 0;
+  struct job *job = NULL;
+
+  for(i = 0; i < job_table.cap; i++){
+    if(job_table.jobs[i].id > max_id)
+      max_id = job_table.jobs[i].id;
+    else if(job_table.jobs[i].id == 0 && job == NULL)
+      job = &job_table.jobs[i];
+  }
+
+  if(job == NULL){
+    int old = job_table.cap;
+    job_table.cap = old ? old * 2 : 8;
+    job_table.jobs = xrealloc(job_table.jobs, job_table.cap * sizeof(struct job), "JOB_CREATE");
+    memset(&job_table.jobs[old], 0, (job_table.cap - old) * sizeof(struct job));
+    job = &job_table.jobs[old];
+  }
+
+  job->id = max_id + 1;
+  job->pgid = 0;
+  job->grouped = job_table.interactive || background;
+  job->npids = 0;
+  job->live = 0;
+  job->state = JOB_RUNNING;
+  job->background = background;
+  job->notify = 0;
+  job->started = stats_now();
+  memset(&job->usage, 0, sizeof(job->usage));
+  size_t len = strlen(cmd) + 1;
+  if(len > job->cmd_cap){
+    job->cmd_cap = len < 64 ? 64 : len;
+    job->cmd = xrealloc(job->cmd, job->cmd_cap, "JOB_CREATE");
+  }
+  memcpy(job->cmd, cmd, len);
+  return job;
+}
+
+void job_add_pid(struct job *job, pid_t pid, const char *name){
+  if(job->npids == job->pids_cap){
+    job->pids_cap = job->pids_cap ? job->pids_cap * 2 : 4;
+    job->pids = xrealloc(job->pids, job->pids_cap * sizeof(pid_t), "JOB_ADD_PID");
+    job->status = xrealloc(job->status, job->pids_cap * sizeof(int), "JOB_ADD_PID");
+    job->names = xrealloc(job->names, job->pids_cap * STATS_NAME_MAX, "JOB_ADD_PID");
+  }
+  if(job->npids == 0)
+    job->pgid = pid;
+  job->pids[job->npids] = pid;
+  job->status[job->npids] = -1;
+  // Stats go under the name without its directory, so /bin/ls and ls count together.
+  if(name != NULL){
+    const char *base = strrchr(name, '/');
+    snprintf(&job->names[job->npids * STATS_NAME_MAX], STATS_NAME_MAX, "%s", base ? base + 1 : name);
+  }
+  else{
+    job->names[job->npids * STATS_NAME_MAX] = '\0';
+  }
+  job->npids++;
+  job->live++;
+
+  job_table.recent_pids[job_table.next_recent] = pid;
+  job_table.next_recent = (job_table.next_recent + 1) % SHOWPID_MAX;
+  if(job_table.nrecent < SHOWPID_MAX)
+    job_table.nrecent++;
+}
+
+pid_t job_spawn_pgid(struct job *job){
+  return job->grouped ? job->pgid : -1;
+}
+
+void job_signal(struct job *job, int sig){
+  int i;
+  if(job->grouped){
+    kill(-job->pgid, sig);
+    return;
+  }
+  for(i = 0; i < job->npids; i++){
+    if(job->status[i] == -1)
+      kill(job->pids[i], sig);
+  }
+}
+
+void job_remove(struct job *job){
+  job->id = 0;
+  job->npids = 0;
+  job->live = 0;
+}
+
+int job_wait_fg(struct job *job, struct cmd_usage *usage){
+  job->background = 0;
+  if(job_table.interactive)
+    tcsetpgrp(0, job->pgid);
+
+  while(job->state == JOB_RUNNING){
+    // Without a terminal ctrl-C only reaches msh's own group, so a job with a group
+    // of its own (one started in the background) is passed it.
+    if(jobs_wait_event(-1) < 0 && !job_table.interactive && job->grouped){
+      interrupted = 0;
+      job_signal(job, SIGINT);
+    }
+  }
+
+  if(job_table.interactive)
+    tcsetpgrp(0, job_table.shell_pgid);
+
+  // A stopped job's last stage may not have been reaped.
+  int status = job->npids && job->status[job->npids - 1] != -1 ? job->status[job->npids - 1] : 0;
+  if(usage != NULL)
+    *usage = job->usage;
+  if(job->state == JOB_DONE){
+    // The terminal sent ctrl-C to the job, not to us, so end the ^C line here.
+    if(WIFSIGNALED(status) && WTERMSIG(status) == SIGINT)
+      printf("\n");
+    job_remove(job);
+  }
+  else{
+    job->background = 1;
+    job->notify = 0;
+    printf("\n");
+    job_print(job);
+  }
+  return status;
+}
+
+void job_print(struct job *job){
+  printf("[%d] %s\t%s%s\n", job->id, jobStateAsString[job->state], job->cmd,
+         job->background && job->state == JOB_RUNNING ? " &" : "");
+}
+
+void jobs_notify(int verbose){
+  int i;
+  for(i = 0; i < job_table.cap; i++){
+    struct job *job = &job_table.jobs[i];
+    if(job->id == 0 || !job->notify || !job->background)
+      continue;
+    if(verbose)
+      job_print(job);
+    job->notify = 0;
+    if(job->state == JOB_DONE)
+      job_remove(job);
+  }
+}
+
+struct job* job_find(const char *spec){
+  int i;
+  struct job *best = NULL;
+
+  if(spec == NULL){
+    for(i = 0; i < job_table.cap; i++){
+      if(job_table.jobs[i].id != 0 && (best == NULL || job_table.jobs[i].id > best->id))
+        best = &job_table.jobs[i];
+    }
+    return best;
+  }
+
+  if(spec[0] == '%')
+    spec++;
+  return job_find_id(atoi(spec));
+}
+
+struct job* job_find_id(int id){
+  int i;
+  for(i = 0; i < job_table.cap; i++){
+    if(job_table.jobs[i].id == id && id != 0)
+      return &job_table.jobs[i];
+  }
+  return NULL;
+}
+
+int builtin_jobs(char **token){
+  (void)token;
+  int i;
+  for(i = 0; i < job_table.cap; i++){
+    struct job *job = &job_table.jobs[i];
+    if(job->id == 0)
+      continue;
+    job_print(job);
+    if(job->state == JOB_DONE){
+      job_remove(job);
+    }
+    else{
+      job->notify = 0;
+    }
+  }
+  return 0;
+}
+
+int builtin_fg(char **token){
+  struct job *job = job_find(token[1]);
+  if(job == NULL){
+    printf("fg: %s: no such job.\n", token[1] ? token[1] : "current");
+    return 1;
+  }
+  printf("%s\n", job->cmd);
+  if(job_table.interactive)
+    tcsetpgrp(0, job->pgid);
+  if(job->state == JOB_STOPPED){
+    job->state = JOB_RUNNING;
+    job_signal(job, SIGCONT);
+  }
+  return exit_code(job_wait_fg(job, NULL));
+}
+
+int builtin_bg(char **token){
+  struct job *job = job_find(token[1]);
+  if(job == NULL){
+    printf("bg: %s: no such job.\n", token[1] ? token[1] : "current");
+    return 1;
+  }
+  if(job->state == JOB_STOPPED){
+    job->state = JOB_RUNNING;
+    job_signal(job, SIGCONT);
+  }
+  job->background = 1;
+  printf("[%d] %s &\n", job->id, job->cmd);
+  return 0;
+}
+
+int builtin_wait(char **token){
+  int i;
+  struct job *target = NULL;
+
+  if(token[1] != NULL){
+    target = job_find(token[1]);
+    if(target == NULL){
+      printf("wait: %s: no such job.\n", token[1]);
+      return 127;
+    }
+  }
+
+  // Stopped jobs would never finish, so only running ones are waited for.
+  while(1){
+    int running = 0;
+    for(i = 0; i < job_table.cap; i++){
+      struct job *job = &job_table.jobs[i];
+      if(job->id != 0 && job->state == JOB_RUNNING && (target == NULL || job == target))
+        running = 1;
+    }
+    if(!running)
+      break;
+    if(jobs_wait_event(-1) < 0)
+      return 130;
+  }
+
+  // Like the shell's wait: the status of the job waited for, 0 when waiting for all.
+  int status = 0;
+  if(target != NULL && target->state == JOB_DONE)
+    status = exit_code(target->status[target->npids - 1]);
+  jobs_notify(1);
+  return status;
+}
+
+int builtin_showpid(char **token){
+  (void)token;
+  // Since we want most recent print the last pid first.
+  int counter;
+  for(counter = 1; counter <= job_table.nrecent; counter++){
+    printf("%d\n", job_table.recent_pids[(job_table.next_recent - counter + SHOWPID_MAX) % SHOWPID_MAX]);
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,681 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Line editor for the Maverick Shell prompt.
+ *
+ * When stdin is a terminal the prompt reads keys in raw mode instead of
+ * lines, so the line can be edited in place: the arrow keys and the usual
+ * emacs keys move and delete, up and down step through the history,
+ * ctrl-R searches it and Tab completes. The first word completes from the
+ * command trie in complete.h and the builtins, later words from the files
+ * in their directory. The terminal is put back in cooked mode before the
+ * line is returned, so commands never see the raw mode.
+ *
+ * This file uses the state and functions declared before it in msh.c, so
+ * it is included after those.
+ */
+
+#ifndef __LINEEDIT_H__
+#define __LINEEDIT_H__
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "complete.h"
+#include "history.h"
+#include "jobs.h"
+
+#define LINEEDIT_MAX_LIST  500   // more completions than this are counted, not listed
+#define LINEEDIT_KEY_EOF   -1
+#define LINEEDIT_KEY_INTR  -2
+
+/*
+ * A growable string that keeps its memory between lines.
+ */
+struct edit_buf {
+  char   *s;
+  size_t  len;
+  size_t  cap;
+};
+
+struct lineedit {
+  int             enabled;
+  const char     *prompt;
+  struct termios  cooked;
+  struct edit_buf line;
+  size_t          pos;         // cursor, as an offset into line
+  struct edit_buf saved;       // what was typed before stepping into the history
+  size_t          hist_pos;    // history line shown, or one past the last for the typed one
+  int             last_tab;    // the previous key was Tab, so a second one lists
+  struct edit_buf out;         // screen update being put together
+  char            pending[64]; // keys read but not handled yet
+  size_t          pending_len;
+  size_t          pending_pos;
+};
+
+static struct lineedit lineedit;
+
+/*
+ * Turns the editor on if stdin is a terminal that can take it. prompt is what
+ * msh prints before every line.
+ */
+void lineedit_init(const char *prompt);
+
+/*
+ * Reads and edits one line at the terminal. Returns it with its newline, from
+ * arena, an empty line after ctrl-C, or NULL for ctrl-D on an empty line.
+ */
+char* lineedit_read(struct arena *arena);
+
+/*
+ * Tab: completes the word before the cursor.
+ */
+void lineedit_complete();
+
+/*
+ * ctrl-R: searches the history as the query is typed. Returns the key that
+ * ended the search, which the caller still handles, or 0 if it was used up.
+ */
+int lineedit_search();
+
+
+void edit_reserve(struct edit_buf *b, size_t want){
+  if(want + 1 <= b->cap)
+    return;
+  b->cap = b->cap ? b->cap : 256;
+  while(b->cap < want + 1)
+    b->cap *= 2;
+  b->s = xrealloc(b->s, b->cap, "EDIT_RESERVE");
+}
+
+void edit_set(struct edit_buf *b, const char *s, size_t len){
+  edit_reserve(b, len);
+  memcpy(b->s, s, len);
+  b->len = len;
+  b->s[len] = '\0';
+}
+
+void edit_append(struct edit_buf *b, const char *s, size_t len){
+  edit_reserve(b, b->len + len);
+  memcpy(b->s + b->len, s, len);
+  b->len += len;
+  b->s[b->len] = '\0';
+}
+
+void edit_insert(const char *s, size_t len){
+  struct edit_buf *b = &lineedit.line;
+  edit_reserve(b, b->len + len);
+  memmove(b->s + lineedit.pos + len, b->s + lineedit.pos, b->len - lineedit.pos + 1);
+  memcpy(b->s + lineedit.pos, s, len);
+  b->len += len;
+  lineedit.pos += len;
+}
+
+void edit_delete(size_t from, size_t to){
+  struct edit_buf *b = &lineedit.line;
+  memmove(b->s + from, b->s + to, b->len - to + 1);
+  b->len -= to - from;
+  if(lineedit.pos > to)
+    lineedit.pos -= to - from;
+  else if(lineedit.pos > from)
+    lineedit.pos = from;
+}
+
+void lineedit_init(const char *prompt){
+  const char *term = getenv("TERM");
+  lineedit.prompt = prompt;
+  lineedit.enabled = isatty(0) && isatty(1) && !(term != NULL && !strcmp(term, "dumb")) &&
+                     tcgetattr(0, &lineedit.cooked) == 0;
+  if(lineedit.enabled)
+    completion_init(path_index_source());
+}
+
+void lineedit_raw(){
+  struct termios raw;
+  tcgetattr(0, &lineedit.cooked);
+  raw = lineedit.cooked;
+  // Signals stay on, so ctrl-C and ctrl-Z still reach msh the way they always have.
+  raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+  raw.c_iflag &= ~(IXON | ICRNL);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  tcsetattr(0, TCSADRAIN, &raw);
+}
+
+void lineedit_cooked(){
+  tcsetattr(0, TCSADRAIN, &lineedit.cooked);
+}
+
+void lineedit_flush(){
+  size_t done = 0;
+  fflush(stdout);
+  while(done < lineedit.out.len){
+    ssize_t w = write(1, lineedit.out.s + done, lineedit.out.len - done);
+    if(w < 0 && errno == EINTR)
+      continue;
+    if(w <= 0)
+      break;
+    done += w;
+  }
+  lineedit.out.len = 0;
+}
+
+/*
+ * Redraws the prompt and the line and puts the cursor back where it belongs.
+ */
+void lineedit_refresh(){
+  char move[32];
+  edit_append(&lineedit.out, "\r", 1);
+  edit_append(&lineedit.out, lineedit.prompt, strlen(lineedit.prompt));
+  edit_append(&lineedit.out, lineedit.line.s, lineedit.line.len);
+  edit_append(&lineedit.out, "\x1b[K\r", 4);
+  size_t col = strlen(lineedit.prompt) + lineedit.pos;
+  if(col > 0)
+    edit_append(&lineedit.out, move, snprintf(move, sizeof(move), "\x1b[%zuC", col));
+  lineedit_flush();
+}
+
+/*
+ * Returns the next key byte, LINEEDIT_KEY_EOF at the end of input or
+ * LINEEDIT_KEY_INTR after ctrl-C. Background jobs are reaped while we wait.
+ */
+int lineedit_key(){
+  while(lineedit.pending_pos == lineedit.pending_len){
+    int ready = jobs_wait_event(0);
+    if(ready < 0)
+      return LINEEDIT_KEY_INTR;
+    if(ready == 0)
+      continue;
+    ssize_t got = read(0, lineedit.pending, sizeof(lineedit.pending));
+    if(got < 0 && errno == EINTR)
+      continue;
+    if(got <= 0)
+      return LINEEDIT_KEY_EOF;
+    lineedit.pending_len = got;
+    lineedit.pending_pos = 0;
+  }
+  return (unsigned char)lineedit.pending[lineedit.pending_pos++];
+}
+
+/*
+ * Shows history line n, or the line that was being typed if n is past the end.
+ */
+void lineedit_history(size_t n){
+  size_t count = history_count();
+  if(n < 1 || n > count + 1)
+    return;
+  if(lineedit.hist_pos == count + 1)
+    edit_set(&lineedit.saved, lineedit.line.s, lineedit.line.len);
+  if(n == count + 1){
+    edit_set(&lineedit.line, lineedit.saved.s, lineedit.saved.len);
+  }
+  else{
+    size_t len;
+    const char *h = history_line(n, &len);
+    edit_set(&lineedit.line, h, len);
+  }
+  lineedit.hist_pos = n;
+  lineedit.pos = lineedit.line.len;
+}
+
+int lineedit_search(){
+  char query[256];
+  size_t qlen = 0;
+  size_t count = history_count();
+  size_t match = 0;
+  int failed = 0;
+
+  while(1){
+    size_t len = 0;
+    const char *h = match ? history_line(match, &len) : "";
+    edit_append(&lineedit.out, "\r", 1);
+    edit_append(&lineedit.out, failed ? "(failed reverse-i-search)`" : "(reverse-i-search)`",
+                failed ? 26 : 19);
+    edit_append(&lineedit.out, query, qlen);
+    edit_append(&lineedit.out, "': ", 3);
+    edit_append(&lineedit.out, h, len);
+    edit_append(&lineedit.out, "\x1b[K", 3);
+    lineedit_flush();
+
+    int key = lineedit_key();
+    if(key == 18){
+      // ctrl-R again: the next older match.
+      size_t older = qlen ? history_search(query, qlen, match ? match : count + 1) : 0;
+      if(older)
+        match = older;
+      failed = qlen && !older;
+      continue;
+    }
+    if(key == 127 || key == 8){
+      if(qlen > 0)
+        qlen--;
+      match = qlen ? history_search(query, qlen, count + 1) : 0;
+      failed = qlen && !match;
+      continue;
+    }
+    if(key >= 32 && key != 127 && qlen < sizeof(query)){
+      query[qlen++] = key;
+      // The current match may still do; otherwise look further back.
+      size_t from = match ? match + 1 : count + 1;
+      size_t found = history_search(query, qlen, from);
+      if(found)
+        match = found;
+      failed = !found;
+      continue;
+    }
+
+    // Anything else ends the search. ctrl-G and ESC give the old line back.
+    if(key == 7 || key == 27 || key < 0){
+      lineedit_refresh();
+      return key == 7 || key == 27 ? 0 : key;
+    }
+    if(match){
+      const char *found = history_line(match, &len);
+      const char *at = qlen ? memmem(found, len, query, qlen) : NULL;
+      edit_set(&lineedit.line, found, len);
+      lineedit.pos = at ? (size_t)(at - found) : len;
+      lineedit.hist_pos = match;
+    }
+    lineedit_refresh();
+    return key;
+  }
+}
+
+/*
+ * Completion candidates, gathered for one Tab.
+ */
+struct edit_matches {
+  char   **names;
+  int      n;
+  int      cap;
+  int      dirs;   // names of directories end with '/'
+};
+
+void lineedit_add_match(const char *name, void *arg){
+  struct edit_matches *m = arg;
+  if(m->n == m->cap){
+    int cap = m->cap ? m->cap * 2 : 64;
+    m->names = arena_grow(&command_arena, m->names, m->cap * sizeof(char *), cap * sizeof(char *));
+    m->cap = cap;
+  }
+  m->names[m->n++] = arena_strdup(&command_arena, name);
+}
+
+int lineedit_cmp(const void *a, const void *b){
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * Lists the matches in columns under the line, then redraws the line.
+ */
+void lineedit_list(struct edit_matches *m, long total){
+  struct winsize ws;
+  int width = ioctl(1, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 ? ws.ws_col : 80;
+  int longest = 1;
+  int i;
+  char line[64];
+
+  edit_append(&lineedit.out, "\n", 1);
+  if(total > m->n){
+    edit_append(&lineedit.out, line, snprintf(line, sizeof(line), "%ld possibilities\n", total));
+  }
+  else{
+    for(i = 0; i < m->n; i++){
+      int len = strlen(m->names[i]);
+      if(len + 2 > longest)
+        longest = len + 2;
+    }
+    int cols = width / longest > 0 ? width / longest : 1;
+    for(i = 0; i < m->n; i++){
+      int len = strlen(m->names[i]);
+      edit_append(&lineedit.out, m->names[i], len);
+      if((i + 1) % cols == 0 || i == m->n - 1){
+        edit_append(&lineedit.out, "\n", 1);
+      }
+      else{
+        while(len++ < longest)
+          edit_append(&lineedit.out, " ", 1);
+      }
+    }
+  }
+  lineedit_refresh();
+}
+
+/*
+ * Files in the directory part of word whose names start with the rest.
+ */
+void lineedit_files(const char *word, size_t wlen, struct edit_matches *m){
+  char dir[PATH_MAX];
+  const char *slash = NULL;
+  size_t i;
+  for(i = 0; i < wlen; i++){
+    if(word[i] == '/')
+      slash = word + i;
+  }
+  size_t dlen = slash ? (size_t)(slash - word) + 1 : 0;
+  if(dlen >= sizeof(dir))
+    return;
+  memcpy(dir, word, dlen);
+  dir[dlen] = '\0';
+  const char *base = word + dlen;
+  size_t blen = wlen - dlen;
+
+  DIR *d = opendir(dlen ? dir : ".");
+  struct dirent *entry;
+  if(d == NULL)
+    return;
+  while((entry = readdir(d)) != NULL){
+    if(strncmp(entry->d_name, base, blen) != 0)
+      continue;
+    // Hidden files only when asked for, and never . or ..
+    if(entry->d_name[0] == '.' && (blen == 0 || !strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")))
+      continue;
+    char full[PATH_MAX + NAME_MAX + 2];
+    struct stat st;
+    snprintf(full, sizeof(full), "%s%s", dlen ? dir : "", entry->d_name);
+    int is_dir = entry->d_type == DT_DIR ||
+                 ((entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) &&
+                  stat(full, &st) == 0 && S_ISDIR(st.st_mode));
+    if(is_dir)
+      strcat(full, "/");
+    lineedit_add_match(full, m);
+    m->dirs += is_dir;
+  }
+  closedir(d);
+}
+
+/*
+ * Inserts what every command starting with word continues with, asking the
+ * tries rather than listing the names.
+ */
+void lineedit_common(const char *word, size_t wlen){
+  char common[NAME_MAX + 1];
+  char next[NAME_MAX + 1];
+  struct trie *tries[2] = { &completion.path, &completion.cwd };
+  int have = 0;
+  int i;
+
+  if(wlen > NAME_MAX)
+    return;
+  for(i = 0; i < 2; i++){
+    uint32_t node = trie_find(tries[i], word, wlen);
+    if(node == TRIE_NONE)
+      continue;
+    memcpy(next, word, wlen);
+    next[wlen] = '\0';
+    trie_common(tries[i], node, next, sizeof(next));
+    if(!have){
+      strcpy(common, next);
+      have = 1;
+    }
+    else{
+      size_t k = 0;
+      while(common[k] && common[k] == next[k])
+        k++;
+      common[k] = '\0';
+    }
+  }
+  const struct builtin *b;
+  for(b = builtin_table; b->name != NULL && have; b++){
+    if(!strncmp(b->name, word, wlen)){
+      size_t k = 0;
+      while(common[k] && common[k] == b->name[k])
+        k++;
+      common[k] = '\0';
+    }
+  }
+  if(have && strlen(common) > wlen)
+    edit_insert(common + wlen, strlen(common) - wlen);
+}
+
+void lineedit_complete(){
+  struct edit_matches m;
+  memset(&m, 0, sizeof(m));
+  char *s = lineedit.line.s;
+
+  size_t start = lineedit.pos;
+  while(start > 0 && !strchr(" \t|;&<>", s[start-1]))
+    start--;
+  size_t wlen = lineedit.pos - start;
+  const char *word = s + start;
+
+  // The first word of a stage names a command, unless it is a path.
+  size_t before = start;
+  while(before > 0 && (s[before-1] == ' ' || s[before-1] == '\t'))
+    before--;
+  int command = (before == 0 || strchr("|;&", s[before-1])) && memchr(word, '/', wlen) == NULL;
+
+  long total = 0;
+  if(command){
+    completion_update();
+    struct trie *tries[2] = { &completion.path, &completion.cwd };
+    uint32_t nodes[2];
+    int i;
+    for(i = 0; i < 2; i++){
+      nodes[i] = trie_find(tries[i], word, wlen);
+      if(nodes[i] != TRIE_NONE)
+        total += tries[i]->nodes[nodes[i]].count;
+    }
+    const struct builtin *b;
+    for(b = builtin_table; b->name != NULL; b++){
+      if(!strncmp(b->name, word, wlen))
+        total++;
+    }
+    if(total <= LINEEDIT_MAX_LIST){
+      for(i = 0; i < 2; i++){
+        if(nodes[i] != TRIE_NONE)
+          trie_each(tries[i], nodes[i], word, wlen, lineedit_add_match, &m, LINEEDIT_MAX_LIST);
+      }
+      for(b = builtin_table; b->name != NULL; b++){
+        if(!strncmp(b->name, word, wlen))
+          lineedit_add_match(b->name, &m);
+      }
+    }
+  }
+  else{
+    lineedit_files(word, wlen, &m);
+    total = m.n;
+  }
+
+  // The same name can come from a builtin, the path and the current directory.
+  if(m.n > 1){
+    int i, j = 1;
+    qsort(m.names, m.n, sizeof(char *), lineedit_cmp);
+    for(i = 1; i < m.n; i++){
+      if(strcmp(m.names[i], m.names[j-1]) != 0)
+        m.names[j++] = m.names[i];
+    }
+    total -= m.n - j;
+    m.n = j;
+  }
+
+  if(total == 0){
+    edit_append(&lineedit.out, "\a", 1);
+    lineedit_flush();
+    return;
+  }
+  if(m.n == 0){
+    // Too many to gather, but the tries still know what they all share.
+    lineedit_common(word, wlen);
+    if(lineedit.pos == start + wlen && lineedit.last_tab)
+      lineedit_list(&m, total);
+    else
+      lineedit_refresh();
+    return;
+  }
+
+  // Everything the matches have in common after the word goes in right away.
+  size_t common = strlen(m.names[0]);
+  int i;
+  for(i = 1; i < m.n; i++){
+    size_t k = 0;
+    while(k < common && m.names[i][k] == m.names[0][k])
+      k++;
+    common = k;
+  }
+  if(common > wlen)
+    edit_insert(m.names[0] + wlen, common - wlen);
+
+  if(m.n == 1){
+    // A finished word gets its space, a directory waits for more.
+    size_t len = strlen(m.names[0]);
+    if(len == 0 || m.names[0][len-1] != '/')
+      edit_insert(" ", 1);
+  }
+  else if(common == wlen && lineedit.last_tab){
+    lineedit_list(&m, total);
+    return;
+  }
+  lineedit_refresh();
+}
+
+char* lineedit_read(struct arena *arena){
+  char *result = NULL;
+  int tab = 0;
+
+  edit_set(&lineedit.line, "", 0);
+  lineedit.pos = 0;
+  lineedit.hist_pos = history_count() + 1;
+  lineedit.last_tab = 0;
+  interrupted = 0;
+  lineedit_raw();
+
+  int key = 0;
+  while(1){
+    lineedit.last_tab = tab;
+    tab = 0;
+    if(key == 0)
+      key = lineedit_key();
+
+    size_t len = lineedit.line.len;
+    size_t pos = lineedit.pos;
+    int next = 0;
+
+    switch(key){
+      case LINEEDIT_KEY_INTR:
+        lineedit_cooked();
+        result = arena_strdup(arena, "");
+        return result;
+      case LINEEDIT_KEY_EOF:
+        lineedit_cooked();
+        return NULL;
+      case '\r':
+      case '\n':
+        edit_append(&lineedit.out, "\n", 1);
+        lineedit_flush();
+        lineedit_cooked();
+        result = arena_alloc(arena, len + 2);
+        memcpy(result, lineedit.line.s, len);
+        result[len] = '\n';
+        result[len+1] = '\0';
+        return result;
+      case 4:   // ctrl-D
+        if(len == 0){
+          edit_append(&lineedit.out, "\n", 1);
+          lineedit_flush();
+          lineedit_cooked();
+          return NULL;
+        }
+        if(pos < len)
+          edit_delete(pos, pos + 1);
+        break;
+      case 1:   // ctrl-A
+        lineedit.pos = 0;
+        break;
+      case 5:   // ctrl-E
+        lineedit.pos = len;
+        break;
+      case 2:   // ctrl-B
+        if(pos > 0)
+          lineedit.pos--;
+        break;
+      case 6:   // ctrl-F
+        if(pos < len)
+          lineedit.pos++;
+        break;
+      case 8:
+      case 127:
+        if(pos > 0)
+          edit_delete(pos - 1, pos);
+        break;
+      case 11:  // ctrl-K
+        edit_delete(pos, len);
+        break;
+      case 21:  // ctrl-U
+        edit_delete(0, pos);
+        break;
+      case 23: {  // ctrl-W
+        size_t from = pos;
+        while(from > 0 && lineedit.line.s[from-1] == ' ')
+          from--;
+        while(from > 0 && lineedit.line.s[from-1] != ' ')
+          from--;
+        edit_delete(from, pos);
+        break;
+      }
+      case 12:  // ctrl-L
+        edit_append(&lineedit.out, "\x1b[H\x1b[2J", 7);
+        break;
+      case 16:  // ctrl-P
+        lineedit_history(lineedit.hist_pos - 1);
+        break;
+      case 14:  // ctrl-N
+        lineedit_history(lineedit.hist_pos + 1);
+        break;
+      case 18:  // ctrl-R
+        next = lineedit_search();
+        break;
+      case '\t':
+        lineedit_complete();
+        tab = 1;
+        key = 0;
+        continue;
+      case 27: {
+        // Escape sequences for the arrows, Home, End and Delete.
+        int a = lineedit_key();
+        int b = a == '[' || a == 'O' ? lineedit_key() : 0;
+        if(b == 'A')
+          lineedit_history(lineedit.hist_pos - 1);
+        else if(b == 'B')
+          lineedit_history(lineedit.hist_pos + 1);
+        else if(b == 'C' && pos < len)
+          lineedit.pos++;
+        else if(b == 'D' && pos > 0)
+          lineedit.pos--;
+        else if(b == 'H')
+          lineedit.pos = 0;
+        else if(b == 'F')
+          lineedit.pos = len;
+        else if(b >= '0' && b <= '9'){
+          int c = lineedit_key();
+          if(b == '3' && c == '~' && pos < len)
+            edit_delete(pos, pos + 1);
+          else if((b == '1' || b == '7') && c == '~')
+            lineedit.pos = 0;
+          else if((b == '4' || b == '8') && c == '~')
+            lineedit.pos = len;
+        }
+        break;
+      }
+      default:
+        if(key >= 32){
+          char c = key;
+          edit_insert(&c, 1);
+        }
+        break;
+    }
+    lineedit_refresh();
+    key = next;
+  }
+}
+
+#endif
@@ -6,6 +6,8 @@
  *
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,25 +15,129 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "arena.h"
+#include "history.h"
+#include "pathidx.h"
+#include "spawn.h"
+#include "jobs.h"
+
+
+/*
+ * Redirections a single command can carry, e.g. "sort < in > out 2>&1".
+ */
+#define MAX_REDIRS 8
+
+enum redirect_kind {
+  REDIR_IN,         // < file
+  REDIR_OUT,        // > file and 2> file
+  REDIR_APPEND,     // >> file
+  REDIR_ERR_TO_OUT  // 2>&1
+};
+
+struct redirect {
+  int   fd;    // descriptor in the child this redirect replaces
+  int   kind;
+  char *file;  // NULL for 2>&1
+};
+
+/*
+ * One stage of a pipeline. argv is NULL terminated so it can go straight to execv.
+ */
+struct command {
+  char          **argv;
+  int             argc;
+  int             cap;
+  struct redirect redirs[MAX_REDIRS];
+  int             nredirs;
+};
+
+/*
+ * A whole input line: stages separated by '|', optionally ending in '&'. The words all live
+ * in buf.
+ */
+struct pipeline {
+  struct command *cmds;
+  int             ncmds;
+  int             cap;
+  int             background;
+  char           *buf;
+};
+
+/*
+ * Everything that belongs to a single command line is allocated from here and let go at the next
+ * prompt in one go.
+ */
+static struct arena command_arena;
+
+/*
+ * heap_calls as it was at the previous prompt, so memstats can tell what the last command cost.
+ */
+static unsigned long heap_calls_at_prompt = 0;
+static unsigned long heap_calls_last_command = 0;
+
+/*
+ * Where read_line gets its input: the -c string if there is one, otherwise input_fd, which is
+ * stdin or the -f script. The prompt is only printed when reading commands from stdin.
+ */
+static int         input_fd = 0;
+static const char *input_text = NULL;
+static int         show_prompt = 1;
 
+/*
+ * Wait status of the last command, which becomes the exit status of msh in -c and -f mode.
+ */
+static int last_status = 0;
+
+/*
+ * Set by the exit builtin so run_line can tell the loop in main to stop.
+ */
+static int shell_exit = 0;
 
 /*
  * This is the most important function. It is called in main inside a loop everytime it passes.
  * This exits out of the loop only when "exit" or "quit" is entered in msh.
  */
-int shell(int* show_pid);
+int shell();
 
 /*
- * This function is used to read input entered by the user. It uses malloc for allocation and 
- * fgets for storing input from stdin
+ * Parses and runs one line of input, either a builtin or a job. Returns 0 if the line was exit
+ * or quit and 1 otherwise.
+ */
+int run_line(char* input);
+
+/*
+ * This function is used to read input entered by the user. The line comes from the command arena
+ * and grows as long as it needs to. It reads stdin itself so it can poll stdin and the SIGCHLD
+ * pipe together: background jobs are reaped while we wait for the user. Returns an empty line if
+ * ctrl-C was pressed and NULL at the end of input.
  */
 char* read_line();
 
 /*
- * This function is used to tokenize the input. It uses strtok to create an array of strings for
- * the given input.
+ * This function is used to parse the input into a pipeline. Words are split on whitespace and on
+ * the operators | < > >> 2> 2>&1 and a final &, which do not need spaces around them. Quotes and backslash
+ * keep operators and spaces inside a word. Returns 0 on success and -1 after printing a message
+ * if the line is not a valid pipeline.
  */
-char** tokenize(char* input);
+int parse_pipeline(char* input, struct pipeline* pl);
+
+/*
+ * Opens the files named by the redirects of cmd and puts them into fds[0..2], which start out
+ * holding the pipe ends for the stage. Every descriptor opened is added to opened so the caller
+ * can close it once the child has it. Returns -1 if a file could not be opened.
+ */
+int open_redirects(struct command* cmd, int* fds, int* opened, int* nopened);
+
+/*
+ * Starts every stage of the pipeline at the same time, connected by pipes, as one process group
+ * and adds their pids to job. The child gets the pipe and file descriptors directly, so data
+ * moving between stages or to and from files never passes through msh. Returns the number of
+ * stages started.
+ */
+int run_pipeline(struct pipeline* pl, struct job* job);
 
 /*
  * This function is defined to concatenate two strings. It is used to join path with first string
@@ -40,28 +146,105 @@ char** tokenize(char* input);
 char* concat(const char *s1, const char *s2);
 
 /*
- * Calls execv on the path and tokens provided. It used execv because we already have an array of 
- * tokens.
+ * Starts the full path with the tokens provided through the selected spawn backend, with fds[0..2]
+ * (or -1 to inherit) as its stdin, stdout and stderr, in process group pgid (0 for a new one, -1 to stay in ours).
+ * Returns the pid of the child, or 0 if it could not be started.
  */
-int exec_path(char** token,char* path);
+int exec_path(char** token,const char* path,const int* fds,pid_t pgid);
 
 /*
  * This functions performs checks and then uses chdir(...) to cd.
  */
-void change_dir(char** token);
+int change_dir(char** token);
 
 /*
- * Used to catch ctrl-C and ctrl-Z as we dont want to exit.
+ * Prints how much the command arena holds and how many heap calls msh made, in total and for
+ * the last command. Once the arena has grown to fit, the last command should show zero.
+ */
+int memstats(char** token);
+
+/*
+ * The builtins, the -P runner and the -S server use the state and functions above, so they come
+ * after them.
+ */
+#include "builtins.h"
+#include "batch.h"
+#include "server.h"
+#include "lineedit.h"
+
+/*
+ * Used to catch ctrl-C and ctrl-Z as we dont want to exit. ctrl-C also interrupts whatever msh
+ * is waiting on.
  */
 static void handle_signal (int sig);
 
 
 static void handle_signal (int sig ){
+  if(sig == SIGINT)
+    interrupted = 1;
   printf("\n");
 }
 
 int main(int argc, char** argv) {
 
+  /*
+   * -b picks how commands are launched: spawn (default), vfork or fork. MSH_SPAWN does the
+   * same from the environment. -c runs the given command line and -f the lines of a script
+   * instead of reading from the prompt. -P N runs the lines (of the script, -c string or stdin)
+   * N at a time, printing each line's output in script order, or as it comes prefixed with the
+   * line number when -T is given. -L appends the usage of every command msh runs to a log, one
+   * JSON object per line, like MSH_STATS_LOG does. -S makes msh a fork server that runs the
+   * commands of clients connecting to the given Unix socket.
+   */
+  const char *backend = getenv("MSH_SPAWN");
+  const char *stats_log_path = getenv("MSH_STATS_LOG");
+  const char *script = NULL;
+  const char *server_path = NULL;
+  int parallel = 0;
+  int tagged = 0;
+  int opt;
+  while((opt = getopt(argc, argv, "b:c:f:L:P:S:T")) != -1){
+    switch(opt){
+      case 'b':
+        backend = optarg;
+        break;
+      case 'c':
+        input_text = optarg;
+        break;
+      case 'f':
+        script = optarg;
+        break;
+      case 'L':
+        stats_log_path = optarg;
+        break;
+      case 'P':
+        parallel = atoi(optarg);
+        if(parallel <= 0){
+          fprintf(stderr, "%s: -P needs a positive number of slots.\n", argv[0]);
+          return 1;
+        }
+        break;
+      case 'S':
+        server_path = optarg;
+        break;
+      case 'T':
+        tagged = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-b spawn|vfork|fork] [-c command | -f script] [-P slots [-T]]"
+                " [-S socket] [-L log]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(backend != NULL && spawn_set_backend(backend) != 0){
+    fprintf(stderr, "%s: unknown spawn backend '%s'.\n", argv[0], backend);
+    return 1;
+  }
+  if(stats_log_path != NULL && stats_open_log(stats_log_path) != 0){
+    perror(stats_log_path);
+    return 1;
+  }
+
   /*
    * The next few lines are used to do handle signals.
    */
@@ -81,166 +264,533 @@ int main(int argc, char** argv) {
     return 0;
   }
 
-  /*
-   * Declaring and array for show_pid and then memset to initialize everything to 0;
-   */
-  int *show_pid = malloc (10*sizeof(int));
-  memset(show_pid, 0, 10*sizeof(int));
-  int run = 1;
-  while(run){
-   run = shell(show_pid);
+  if(script != NULL && input_text == NULL){
+    input_fd = open(script, O_RDONLY | O_CLOEXEC);
+    if(input_fd < 0){
+      perror(script);
+      return 1;
+    }
+  }
+  if(script != NULL || input_text != NULL || parallel > 0 || server_path != NULL)
+    show_prompt = 0;
+
+  jobs_init();
+  if(show_prompt){
+    const char *history_path = history_default_path();
+    if(history_path != NULL && history_open(history_path) != 0)
+      perror(history_path);
+    lineedit_init("msh> ");
   }
 
-  free(show_pid);
-  return 0;
-}
+  int status = 0;
+  if(server_path != NULL){
+    status = run_server(server_path);
+  }
+  else if(parallel > 0){
+    status = run_parallel(parallel, tagged);
+  }
+  else{
+    int run = 1;
+    while(run){
+     run = shell();
+    }
+    if(!show_prompt)
+      status = exit_code(last_status);
+  }
 
-int shell(int* show_pid){
+  path_index_free();
+  history_close();
+  completion_free();
+  arena_free(&command_arena);
+  return status;
+}
 
-  //Calculate the length of show_pid. Limiting it at 10 as we only want to print at most 10.
-  int length=0;
-  while(show_pid[length]!=0 && length<10 ){
-    length=length+1;
-  }
+int shell(){
 
-  printf("msh> ");
+  // Everything the previous command allocated goes away here.
+  arena_reset(&command_arena);
+  heap_calls_last_command = heap_calls - heap_calls_at_prompt;
+  heap_calls_at_prompt = heap_calls;
 
-  char *input;
-  char **token;
-  int found=1;
+  jobs_notify(show_prompt);
+  if(show_prompt){
+    printf("msh> ");
+    fflush(stdout);
+  }
 
-  input = read_line();
-  // At exit or quit return such that it exits.
-  if(!strcmp(input,"exit\n") || !strcmp(input,"quit\n"))
+  char *input = read_line();
+  // End of input works like exit.
+  if(input == NULL)
     return 0;
 
-  // This is the code for running showpid. Since we want most recent print the last pid first.
-  if(!strcmp(input,"showpid\n")){
-    int counter=0;
-    for(counter=length-1; counter>=0; counter--){
-      printf("%d\n",show_pid[counter]);
+  // Only lines typed at the prompt go into the history, after !! and friends are replaced.
+  if(history.fd >= 0){
+    char *expanded = history_expand(&command_arena, input);
+    if(expanded == NULL){
+      last_status = 1 << 8;
+      return 1;
     }
-    return 1;
+    if(expanded != input){
+      printf("%s", expanded);
+      input = expanded;
+    }
+    history_add(input, strcspn(input, "\n"));
   }
 
-  token = tokenize(input);
+  return run_line(input);
+}
+
+int run_line(char* input){
+  struct pipeline pl;
 
-  if (token[0]=='\0'){
+  if(parse_pipeline(input,&pl) != 0){
+    last_status = 2 << 8;
     return 1;
   }
-  if(!strcmp(token[0],"cd")){
-    change_dir(token);
-    free(input);
-    free(token);
+  if(pl.ncmds == 0){
     return 1;
   }
 
-  /* Check for all the paths defined in the array below. If found then store the pid of the
-   * process executed in showpid. If length is at 10 then move things to the left and then write 
-   * found to showpid[9];
-   */
-  char *paths[4] = {"./","/usr/local/bin/","/usr/bin/","/bin/"};
-  int i=0;
-  while(i<4){
-    found = exec_path(token,paths[i]);
-    if(!(found == 0)){
-      if (length == 10){
-        int counter = 0;
-        for(counter = 0; counter<length-1;counter++){
-          show_pid[counter] = show_pid[counter+1];
-        }
-        length = 9;
-      }
-      show_pid[length] = found;
-      break;
+  // time in front of a line prints what the whole line used once it is done.
+  int timed = 0;
+  struct cmd_usage usage;
+  memset(&usage, 0, sizeof(usage));
+  if(!strcmp(pl.cmds[0].argv[0],"time")){
+    timed = 1;
+    pl.cmds[0].argv++;
+    pl.cmds[0].argc--;
+    if(pl.cmds[0].argc == 0){
+      usage_print(&usage);
+      last_status = 0;
+      return 1;
     }
-    else{
-      i++;
+  }
+
+  // A builtin on its own runs right here, without a fork. Its redirects are put on our own
+  // descriptors while it runs.
+  const struct builtin *b = builtin_find(pl.cmds[0].argv[0]);
+  if(b != NULL && pl.ncmds == 1 && !pl.background){
+    int fds[3] = { -1, -1, -1 };
+    int opened[MAX_REDIRS];
+    int nopened = 0;
+    struct rusage before, after;
+
+    if(timed){
+      usage.wall = stats_now();
+      getrusage(RUSAGE_SELF, &before);
+    }
+    if(open_redirects(&pl.cmds[0], fds, opened, &nopened) == 0)
+      last_status = builtin_run(b, pl.cmds[0].argv, fds) << 8;
+    else
+      last_status = 1 << 8;
+    while(nopened > 0)
+      close(opened[--nopened]);
+    if(timed){
+      // The builtin ran in msh, so what it used is what msh used meanwhile.
+      getrusage(RUSAGE_SELF, &after);
+      usage.wall = stats_now() - usage.wall;
+      usage.user = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) +
+                   (after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e6;
+      usage.sys = (after.ru_stime.tv_sec - before.ru_stime.tv_sec) +
+                  (after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6;
+      usage.maxrss = after.ru_maxrss;
+      usage.nvcsw = after.ru_nvcsw - before.ru_nvcsw;
+      usage.nivcsw = after.ru_nivcsw - before.ru_nivcsw;
+      usage_print(&usage);
     }
+
+    // At exit or quit return such that it exits.
+    return !shell_exit;
   }
 
-  // If not showpid, not cd and not found in all 4 paths then command not found.
-  if(i==4){
-    printf("%s: Command not found.\n", token[0]);
+  // The job keeps the line it was started from, without the newline or &, for jobs and fg.
+  size_t len = strcspn(input, "\n");
+  while(len > 0 && (input[len-1] == ' ' || input[len-1] == '\t' || (pl.background && input[len-1] == '&')))
+    len--;
+  input[len] = '\0';
+  struct job *job = job_create(input, pl.background);
+
+  if(run_pipeline(&pl,job) == 0){
+    job_remove(job);
+    last_status = 127 << 8;
+  }
+  else if(pl.background){
+    if(show_prompt)
+      printf("[%d] %d\n", job->id, job->pgid);
+    last_status = 0;
+  }
+  else{
+    last_status = job_wait_fg(job, timed ? &usage : NULL);
+    if(timed)
+      usage_print(&usage);
   }
-  free(input);
-  free(token);
 
   return 1;
 }
 
 char* read_line(){
-  char *result = malloc (100*sizeof(char));
-  if (!result){
-    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN READ_LINE.\n");
-    exit(1);
+  static char   pending[4096];  // read from stdin but not handed out yet
+  static size_t pending_len = 0;
+  static size_t pending_pos = 0;
+
+  size_t cap = 128;
+  char *result = arena_alloc(&command_arena, cap);
+
+  // -c: hand out the string one line at a time.
+  if(input_text != NULL){
+    if(*input_text == '\0')
+      return NULL;
+    size_t len = strcspn(input_text, "\n");
+    result = arena_grow(&command_arena, result, cap, len+2);
+    memcpy(result, input_text, len);
+    result[len] = '\n';
+    result[len+1] = '\0';
+    input_text += len + (input_text[len] == '\n');
+    return result;
+  }
+
+  // At a terminal the line is edited in place.
+  if(lineedit.enabled && input_fd == 0)
+    return lineedit_read(&command_arena);
+
+  // Like fgets, stopping after the newline, but without a length limit.
+  size_t n = 0;
+  interrupted = 0;
+  while(1){
+    if(n+1 == cap){
+      result = arena_grow(&command_arena, result, cap, cap*2);
+      cap *= 2;
+    }
+
+    if(pending_pos == pending_len){
+      int ready = jobs_wait_event(input_fd);
+      if(ready < 0){
+        n = 0;
+        break;
+      }
+      if(ready == 0)
+        continue;
+
+      ssize_t got = read(input_fd, pending, sizeof(pending));
+      if(got < 0 && errno == EINTR)
+        continue;
+      if(got <= 0){
+        if(n == 0)
+          return NULL;
+        break;
+      }
+      pending_len = got;
+      pending_pos = 0;
+    }
+
+    char c = pending[pending_pos++];
+    result[n++] = c;
+    if(c == '\n')
+      break;
   }
-  // useing fgets to scan and store in result which is returned. 
-  fgets(result,100,stdin);
+  result[n] = '\0';
   return result;
 }
 
-char** tokenize(char* input){
-  int i = 0;
-  char **token = malloc(6*sizeof(char*));
-  if (!token){
-    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN TOKENIZE.\n");
-    exit(1);
-  }
-  // Using strtok to make an array of tokens from input. 
-  token[i]= strtok(input, " \t\n");
-  while(token[i] != NULL){
-    i++;
-    token[i] = strtok(NULL, " \t\n");
+/*
+ * Starts a new empty stage at the end of the pipeline and returns it.
+ */
+struct command* add_command(struct pipeline* pl){
+  if(pl->ncmds == pl->cap){
+    int cap = pl->cap ? pl->cap*2 : 4;
+    pl->cmds = arena_grow(&command_arena, pl->cmds, pl->cap*sizeof(struct command),
+                          cap*sizeof(struct command));
+    pl->cap = cap;
   }
+  struct command *cmd = &pl->cmds[pl->ncmds++];
+  memset(cmd, 0, sizeof(struct command));
+  return cmd;
+}
 
-  return token;
+/*
+ * Appends a word to argv, keeping it NULL terminated.
+ */
+void add_word(struct command* cmd, char* word){
+  if(cmd->argc+2 > cmd->cap){
+    int cap = cmd->cap ? cmd->cap*2 : 8;
+    cmd->argv = arena_grow(&command_arena, cmd->argv, cmd->cap*sizeof(char*), cap*sizeof(char*));
+    cmd->cap = cap;
+  }
+  cmd->argv[cmd->argc++] = word;
+  cmd->argv[cmd->argc] = NULL;
 }
 
-int exec_path(char** token,char* path){
+int parse_pipeline(char* input, struct pipeline* pl){
+  memset(pl, 0, sizeof(struct pipeline));
 
-  pid_t child_pid;
-  int status;
-  int found=0;
-  char* s = concat(path,token[0]); // Concat the path with token[0] to pass to execv
+  // Words are copied into their own buffer since quotes shrink them and operators need no spaces.
+  pl->buf = arena_alloc(&command_arena, strlen(input)+1);
+
+  char *r = input;
+  char *w = pl->buf;
+  struct command *cmd = add_command(pl);
+  struct redirect *pending = NULL; // redirect still waiting for its file name
+
+  while(1){
+    while(*r==' ' || *r=='\t' || *r=='\n')
+      r++;
+    // A '#' starting a word comments out the rest of the line.
+    if(*r == '\0' || *r == '#')
+      break;
+
+    if(pl->background){
+      printf("msh: syntax error near '&'.\n");
+      return -1;
+    }
+
+    if(*r == '&'){
+      if(pending != NULL || cmd->argc == 0){
+        printf("msh: syntax error near '&'.\n");
+        return -1;
+      }
+      pl->background = 1;
+      r++;
+      continue;
+    }
 
-  child_pid = fork();
+    if(*r == '|'){
+      if(pending != NULL || cmd->argc == 0){
+        printf("msh: syntax error near '|'.\n");
+        return -1;
+      }
+      cmd = add_command(pl);
+      r++;
+      continue;
+    }
 
-  if (child_pid == 0){ // runs in child
-    if(execv(s,token) == -1){
+    int kind = -1, fd = 0, len = 0;
+    if(r[0]=='<'){
+      kind = REDIR_IN;     fd = 0; len = 1;
+    }
+    else if(r[0]=='>' && r[1]=='>'){
+      kind = REDIR_APPEND; fd = 1; len = 2;
+    }
+    else if(r[0]=='>'){
+      kind = REDIR_OUT;    fd = 1; len = 1;
+    }
+    else if(r[0]=='2' && r[1]=='>' && r[2]=='&' && r[3]=='1'){
+      kind = REDIR_ERR_TO_OUT; fd = 2; len = 4;
+    }
+    else if(r[0]=='2' && r[1]=='>'){
+      kind = REDIR_OUT;    fd = 2; len = 2;
+    }
+
+    if(kind >= 0){
+      if(pending != NULL){
+        printf("msh: syntax error near '%.*s'.\n", len, r);
+        return -1;
+      }
+      if(cmd->nredirs == MAX_REDIRS){
+        printf("msh: too many redirections.\n");
+        return -1;
+      }
+      struct redirect *redir = &cmd->redirs[cmd->nredirs++];
+      redir->fd = fd;
+      redir->kind = kind;
+      redir->file = NULL;
+      if(kind != REDIR_ERR_TO_OUT)
+        pending = redir;
+      r += len;
+      continue;
+    }
+
+    // A word, which runs until whitespace or an operator outside of quotes.
+    char *word = w;
+    while(*r && !strchr(" \t\n|<>&", *r)){
+      if(*r == '\''){
+        r++;
+        while(*r && *r != '\'')
+          *w++ = *r++;
+        if(*r == '\0'){
+          printf("msh: unterminated quote.\n");
+          return -1;
+        }
+        r++;
+      }
+      else if(*r == '"'){
+        r++;
+        while(*r && *r != '"'){
+          if(*r == '\\' && (r[1] == '"' || r[1] == '\\'))
+            r++;
+          *w++ = *r++;
+        }
+        if(*r == '\0'){
+          printf("msh: unterminated quote.\n");
+          return -1;
+        }
+        r++;
+      }
+      else if(*r == '\\' && r[1] != '\0' && r[1] != '\n'){
+        r++;
+        *w++ = *r++;
+      }
+      else{
+        *w++ = *r++;
+      }
+    }
+    *w++ = '\0';
+
+    if(pending != NULL){
+      pending->file = word;
+      pending = NULL;
+    }
+    else{
+      add_word(cmd, word);
     }
-    exit(EXIT_FAILURE);
   }
-  else if (child_pid < 0){
-    printf("ERROR IN EXEC. FORK FAILED.\n");
+
+  if(pending != NULL){
+    printf("msh: missing file name for redirection.\n");
+    return -1;
   }
-  else {
-    waitpid(child_pid, &status, 0 );
-    if (WEXITSTATUS(status)==1){ // This is returns 1 only when command not found.
-      found = 0;
+  if(cmd->argc == 0){
+    // A blank line is fine, a trailing '|' or redirects with nothing to run are not.
+    if(pl->ncmds == 1 && cmd->nredirs == 0){
+      pl->ncmds = 0;
+      return 0;
     }
-    else {
-      found = child_pid; // return child_pid for show_pid to store.
+    printf("msh: missing command.\n");
+    return -1;
+  }
+  return 0;
+}
+
+int open_redirects(struct command* cmd, int* fds, int* opened, int* nopened){
+  int i;
+  for(i=0; i<cmd->nredirs; i++){
+    struct redirect *redir = &cmd->redirs[i];
+
+    // Applied in order, so "> out 2>&1" and "2>&1 > out" differ just like in sh.
+    if(redir->kind == REDIR_ERR_TO_OUT){
+      fds[2] = fds[1] >= 0 ? fds[1] : 1;
+      continue;
+    }
+
+    int flags = O_CLOEXEC;
+    if(redir->kind == REDIR_IN)
+      flags |= O_RDONLY;
+    else if(redir->kind == REDIR_APPEND)
+      flags |= O_WRONLY | O_CREAT | O_APPEND;
+    else
+      flags |= O_WRONLY | O_CREAT | O_TRUNC;
+
+    int fd = open(redir->file, flags, 0644);
+    if(fd < 0){
+      printf("%s: %s.\n", redir->file, strerror(errno));
+      return -1;
     }
+    opened[(*nopened)++] = fd;
+    fds[redir->fd] = fd;
+  }
+  return 0;
+}
+
+int run_pipeline(struct pipeline* pl, struct job* job){
+  int started = 0;
+  int prev_read = -1;
+  int i;
+
+  for(i=0; i<pl->ncmds; i++){
+    struct command *cmd = &pl->cmds[i];
+    int fds[3] = { prev_read, -1, -1 };
+    int p[2] = { -1, -1 };
+    int opened[MAX_REDIRS];
+    int nopened = 0;
+
+    // Pipe ends are close-on-exec so each child keeps only the ones installed as 0, 1 and 2.
+    if(i < pl->ncmds-1){
+      if(pipe2(p, O_CLOEXEC) != 0){
+        perror("pipe");
+        if(prev_read >= 0)
+          close(prev_read);
+        break;
+      }
+      fds[1] = p[1];
+    }
+
+    if(open_redirects(cmd, fds, opened, &nopened) == 0){
+      const struct builtin *b = builtin_find(cmd->argv[0]);
+      const char *path = b ? NULL : path_index_lookup(cmd->argv[0]);
+      // A builtin in a pipeline or in the background still needs a process of its own.
+      if(b != NULL){
+        int pid = builtin_spawn(b, cmd->argv, fds, job_spawn_pgid(job));
+        if(pid != 0){
+          job_add_pid(job, pid, cmd->argv[0]);
+          started++;
+        }
+      }
+      // If not in the index then command not found.
+      else if(path == NULL){
+        printf("%s: Command not found.\n", cmd->argv[0]);
+      }
+      else{
+        int pid = exec_path(cmd->argv, path, fds, job_spawn_pgid(job));
+        if(pid != 0){
+          job_add_pid(job, pid, cmd->argv[0]);
+          started++;
+        }
+      }
+    }
+
+    // The children have their copies now.
+    while(nopened > 0)
+      close(opened[--nopened]);
+    if(prev_read >= 0)
+      close(prev_read);
+    if(p[1] >= 0)
+      close(p[1]);
+    prev_read = p[0];
+  }
+  return started;
+}
+
+int exec_path(char** token,const char* path,const int* fds,pid_t pgid){
+
+  pid_t child_pid;
+  int found=0;
+
+  child_pid = spawn_command(path,token,fds,pgid);
+
+  if (child_pid > 0){
+    found = child_pid; // return child_pid for show_pid to store.
   }
   return found;
 }
 
 char* concat(const char *s1, const char *s2){
-  char *result = malloc(strlen(s1)+strlen(s2)+1);
+  char *result = xmalloc(strlen(s1)+strlen(s2)+1, "CONCAT");
   strcpy(result, s1);
   strcat(result, s2);
   return result;
 }
 
-void change_dir(char** token){
+int change_dir(char** token){
   if(token[1]==NULL){ // checks for cd ..
     printf("cd: %s: No such file or directory.\n",token[1]);
+    return 1;
   }
   else{  // uses chdir
     if(chdir(token[1]) !=0){
       printf("THERE IS SOME ERROR IN CHDIR. IT FAILED.");
+      return 1;
     }
   }
+  return 0;
 }
 
+
+int memstats(char** token){
+  (void)token;
+  int nchunks;
+  size_t capacity = arena_capacity(&command_arena, &nchunks);
+  printf("arena: %zu bytes in %d chunk%s, %zu used by this command, %zu peak\n",
+         capacity, nchunks, nchunks == 1 ? "" : "s", command_arena.used, command_arena.peak);
+  printf("heap calls: %lu by the last command, %lu total, %lu path index rebuilds, %lu rescans\n",
+         heap_calls_last_command, heap_calls, path_index.rebuilds, path_index.rescans);
+  return 0;
+}
@@ -0,0 +1,367 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Command lookup index for the Maverick Shell.
+ *
+ * Every executable in the search directories is loaded into a hash table
+ * once, so resolving a command is a single lookup instead of one fork per
+ * candidate directory. Each entry remembers which directory it came from,
+ * and each directory its device, inode and mtime. Every lookup stats each
+ * search directory; one that changed (a file was added or removed, or "./"
+ * now means a different directory after cd) has its entries dropped and is
+ * scanned again on its own, leaving the others as they are. Only a new
+ * $PATH rebuilds the whole table.
+ */
+
+#ifndef __PATHIDX_H__
+#define __PATHIDX_H__
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+/*
+ * Used when neither MSH_PATH nor PATH is set. These are the directories msh
+ * has always searched.
+ */
+#define DEFAULT_SEARCH_PATH "/usr/local/bin:/usr/bin:/bin"
+
+struct search_dir {
+  char           *path;   // always ends with '/' so concat() can build full paths
+  int             exists;
+  int             changed; // set by path_index_refresh() until the dir is rescanned
+  dev_t           dev;
+  ino_t           ino;
+  struct timespec mtime;
+};
+
+struct path_entry {
+  char     *path;         // full path handed to execv, NULL for an empty slot
+  char     *name;         // points into path, just after the last '/'
+  uint32_t  hash;
+  int       dir;          // index into dirs; the earliest one with a name wins
+};
+
+struct path_index {
+  char              *source;   // copy of the search path string the dirs came from
+  struct search_dir *dirs;
+  int                ndirs;
+  struct path_entry *slots;
+  uint32_t           nslots;   // always a power of two
+  uint32_t           count;
+  unsigned long      rebuilds;
+  unsigned long      rescans;  // single directories scanned again after a change
+};
+
+static struct path_index path_index;
+
+char* concat(const char *s1, const char *s2);
+
+/*
+ * Returns the string the search directories are read from. MSH_PATH wins over
+ * PATH so the shell can be pointed somewhere else without touching children.
+ */
+const char* path_index_source();
+
+/*
+ * Splits the search path into directories. The current directory is always
+ * searched first, same as the original "./" entry.
+ */
+void path_index_set_dirs(const char *source);
+
+/*
+ * Returns 1 if the directory was modified, created, removed or replaced
+ * since it was last scanned.
+ */
+int path_index_dir_changed(struct search_dir *d);
+
+/*
+ * Throws away the table and scans every search directory again. Every
+ * directory's names are kept, and lookups pick the earliest directory's.
+ */
+void path_index_rebuild();
+
+/*
+ * Brings the table up to date. A new $PATH rebuilds it; otherwise only the
+ * entries of directories that changed are dropped and those directories
+ * scanned again, so touching the current directory does not rescan /usr/bin.
+ */
+void path_index_refresh();
+
+/*
+ * Resolves a command name to the full path of the executable that would run.
+ * Names containing a '/' are used as given. Returns NULL if nothing matches.
+ * The returned string belongs to the index and stays valid until the next
+ * call.
+ */
+const char* path_index_lookup(const char *name);
+
+/*
+ * Frees everything held by the index.
+ */
+void path_index_free();
+
+
+uint32_t path_hash(const char *s){
+  // FNV-1a, good enough for file names and cheap to compute.
+  uint32_t h = 2166136261u;
+  while(*s){
+    h ^= (unsigned char)*s++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+const char* path_index_source(){
+  const char *source = getenv("MSH_PATH");
+  if(source == NULL){
+    source = getenv("PATH");
+  }
+  if(source == NULL){
+    source = DEFAULT_SEARCH_PATH;
+  }
+  return source;
+}
+
+void path_index_set_dirs(const char *source){
+  int i;
+  for(i = 0; i < path_index.ndirs; i++){
+    free(path_index.dirs[i].path);
+  }
+  free(path_index.dirs);
+  free(path_index.source);
+
+  path_index.source = xstrdup(source, "PATH_INDEX_SET_DIRS");
+
+  // One slot for "./" plus one per ':' separated entry.
+  int max = 2;
+  const char *p;
+  for(p = source; *p; p++){
+    if(*p == ':')
+      max++;
+  }
+  path_index.dirs = xmalloc(max * sizeof(struct search_dir), "PATH_INDEX_SET_DIRS");
+  memset(path_index.dirs, 0, max * sizeof(struct search_dir));
+
+  path_index.dirs[0].path = xstrdup("./", "PATH_INDEX_SET_DIRS");
+  path_index.ndirs = 1;
+
+  const char *start = source;
+  while(1){
+    const char *end = strchr(start, ':');
+    size_t len = end ? (size_t)(end - start) : strlen(start);
+
+    // Empty entries and "." mean the current directory, which is already first.
+    if(len > 0 && !(len == 1 && start[0] == '.')){
+      char *dir = xmalloc(len + 2, "PATH_INDEX_SET_DIRS");
+      memcpy(dir, start, len);
+      if(dir[len - 1] != '/'){
+        dir[len++] = '/';
+      }
+      dir[len] = '\0';
+      path_index.dirs[path_index.ndirs++].path = dir;
+    }
+
+    if(end == NULL)
+      break;
+    start = end + 1;
+  }
+}
+
+int path_index_dir_changed(struct search_dir *d){
+  struct stat st;
+  int exists = (stat(d->path, &st) == 0 && S_ISDIR(st.st_mode));
+
+  if(exists != d->exists)
+    return 1;
+  if(!exists)
+    return 0;
+  return st.st_dev != d->dev || st.st_ino != d->ino ||
+         st.st_mtim.tv_sec != d->mtime.tv_sec || st.st_mtim.tv_nsec != d->mtime.tv_nsec;
+}
+
+void path_index_clear(){
+  uint32_t i;
+  for(i = 0; i < path_index.nslots; i++){
+    free(path_index.slots[i].path);
+  }
+  free(path_index.slots);
+  path_index.slots = NULL;
+  path_index.nslots = 0;
+  path_index.count = 0;
+}
+
+/*
+ * A name can be in the table once per directory. This returns the entry from
+ * the earliest directory, or NULL.
+ */
+struct path_entry* path_index_find(const char *name, uint32_t hash){
+  uint32_t mask = path_index.nslots - 1;
+  uint32_t i = hash & mask;
+  struct path_entry *best = NULL;
+  while(path_index.slots[i].path != NULL){
+    struct path_entry *e = &path_index.slots[i];
+    if(e->hash == hash && !strcmp(e->name, name) && (best == NULL || e->dir < best->dir))
+      best = e;
+    i = (i + 1) & mask;
+  }
+  return best;
+}
+
+struct path_entry* path_index_empty(uint32_t hash){
+  uint32_t mask = path_index.nslots - 1;
+  uint32_t i = hash & mask;
+  while(path_index.slots[i].path != NULL){
+    i = (i + 1) & mask;
+  }
+  return &path_index.slots[i];
+}
+
+/*
+ * Moves the entries into a table of nslots, freeing those of directories
+ * marked changed.
+ */
+void path_index_rehash(uint32_t nslots){
+  struct path_entry *old = path_index.slots;
+  uint32_t old_n = path_index.nslots;
+
+  path_index.nslots = nslots;
+  path_index.slots = xmalloc(path_index.nslots * sizeof(struct path_entry), "PATH_INDEX_REHASH");
+  memset(path_index.slots, 0, path_index.nslots * sizeof(struct path_entry));
+  path_index.count = 0;
+
+  uint32_t i;
+  for(i = 0; i < old_n; i++){
+    if(old[i].path == NULL)
+      continue;
+    if(path_index.dirs[old[i].dir].changed){
+      free(old[i].path);
+      continue;
+    }
+    *path_index_empty(old[i].hash) = old[i];
+    path_index.count++;
+  }
+  free(old);
+}
+
+void path_index_add(int dir, const char *name){
+  // Keep the load factor under one half so probe chains stay short.
+  if((path_index.count + 1) * 2 > path_index.nslots)
+    path_index_rehash(path_index.nslots ? path_index.nslots * 2 : 1024);
+
+  struct search_dir *d = &path_index.dirs[dir];
+  uint32_t hash = path_hash(name);
+  struct path_entry *e = path_index_empty(hash);
+
+  e->path = concat(d->path, name);
+  e->name = e->path + strlen(d->path);
+  e->hash = hash;
+  e->dir  = dir;
+  path_index.count++;
+}
+
+void path_index_scan(int i){
+  struct search_dir *d = &path_index.dirs[i];
+  struct stat st;
+
+  d->changed = 0;
+  d->exists = (stat(d->path, &st) == 0 && S_ISDIR(st.st_mode));
+  if(!d->exists)
+    return;
+
+  d->dev = st.st_dev;
+  d->ino = st.st_ino;
+  d->mtime = st.st_mtim;
+
+  DIR *dir = opendir(d->path);
+  if(dir == NULL)
+    return;
+
+  int fd = dirfd(dir);
+  struct dirent *ent;
+  while((ent = readdir(dir)) != NULL){
+    if(ent->d_name[0] == '.' &&
+       (ent->d_name[1] == '\0' || (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
+      continue;
+    if(ent->d_type == DT_DIR)
+      continue;
+
+    struct stat est;
+    if(fstatat(fd, ent->d_name, &est, 0) != 0 || !S_ISREG(est.st_mode))
+      continue;
+    if(faccessat(fd, ent->d_name, X_OK, AT_EACCESS) != 0)
+      continue;
+
+    path_index_add(i, ent->d_name);
+  }
+  closedir(dir);
+}
+
+void path_index_rebuild(){
+  const char *source = path_index_source();
+  if(path_index.source == NULL || strcmp(path_index.source, source) != 0)
+    path_index_set_dirs(source);
+
+  path_index_clear();
+  path_index_rehash(1024);
+
+  int i;
+  for(i = 0; i < path_index.ndirs; i++){
+    path_index_scan(i);
+  }
+  path_index.rebuilds++;
+}
+
+void path_index_refresh(){
+  if(path_index.source == NULL || strcmp(path_index.source, path_index_source()) != 0){
+    path_index_rebuild();
+    return;
+  }
+
+  int i, changed = 0;
+  for(i = 0; i < path_index.ndirs; i++){
+    path_index.dirs[i].changed = path_index_dir_changed(&path_index.dirs[i]);
+    changed += path_index.dirs[i].changed;
+  }
+  if(changed == 0)
+    return;
+
+  // Drop what the changed directories had, then read just those again.
+  path_index_rehash(path_index.nslots);
+  for(i = 0; i < path_index.ndirs; i++){
+    if(path_index.dirs[i].changed)
+      path_index_scan(i);
+  }
+  path_index.rescans += changed;
+}
+
+const char* path_index_lookup(const char *name){
+  if(strchr(name, '/') != NULL)
+    return access(name, X_OK) == 0 ? name : NULL;
+
+  path_index_refresh();
+
+  struct path_entry *e = path_index_find(name, path_hash(name));
+  return e ? e->path : NULL;
+}
+
+void path_index_free(){
+  int i;
+  path_index_clear();
+  for(i = 0; i < path_index.ndirs; i++){
+    free(path_index.dirs[i].path);
+  }
+  free(path_index.dirs);
+  free(path_index.source);
+  memset(&path_index, 0, sizeof(path_index));
+}
+
+#endif
@@ -0,0 +1,194 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Pipeline throughput benchmark for the Maverick Shell.
+ *
+ * Build and run:
+ *   gcc -O2 -o msh msh.c
+ *   gcc -O2 -o pipebench pipebench.c
+ *   ./pipebench [-s path/to/msh] [-m MB] [-k stages] [-d dir]
+ *
+ * Writes an input file (1024 MB by default), then has msh run
+ *   cat < in | cat | ... | cat > out
+ * with k stages and reports MB/s. The same line is timed under /bin/sh for
+ * comparison, and the output is checked against the input afterwards.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Returns the monotonic clock in seconds.
+ */
+double now_s();
+
+/*
+ * Writes mb megabytes of pseudo random bytes to path.
+ */
+void make_input(const char *path, long mb);
+
+/*
+ * Runs shell with the command line on its stdin, followed by exit, and returns
+ * the wall time it took.
+ */
+double run_shell(char **shell_argv, const char *line);
+
+/*
+ * Returns 1 if both files have the same contents.
+ */
+int same_contents(const char *a, const char *b);
+
+
+double now_s(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void make_input(const char *path, long mb){
+  FILE *fp = fopen(path, "w");
+  if(fp == NULL){
+    perror(path);
+    exit(1);
+  }
+
+  uint64_t block[1 << 17];
+  uint64_t x = 88172645463325252ULL;
+  long i;
+  size_t j;
+  for(i = 0; i < mb; i++){
+    for(j = 0; j < sizeof(block) / sizeof(block[0]); j++){
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      block[j] = x;
+    }
+    fwrite(block, 1, sizeof(block), fp);
+  }
+  fclose(fp);
+}
+
+double run_shell(char **shell_argv, const char *line){
+  int p[2];
+  if(pipe(p) != 0){
+    perror("pipe");
+    exit(1);
+  }
+
+  fflush(stdout);
+  double start = now_s();
+  pid_t pid = fork();
+  if(pid == 0){
+    dup2(p[0], 0);
+    close(p[0]);
+    close(p[1]);
+    // The prompts are not part of the measurement.
+    freopen("/dev/null", "w", stdout);
+    execv(shell_argv[0], shell_argv);
+    perror(shell_argv[0]);
+    _exit(127);
+  }
+  close(p[0]);
+  if(write(p[1], line, strlen(line)) < 0 || write(p[1], "\nexit\n", 6) < 0)
+    perror("write");
+  close(p[1]);
+
+  int status;
+  waitpid(pid, &status, 0);
+  return now_s() - start;
+}
+
+int same_contents(const char *a, const char *b){
+  FILE *fa = fopen(a, "r");
+  FILE *fb = fopen(b, "r");
+  int same = (fa != NULL && fb != NULL);
+  static char ba[1 << 16], bb[1 << 16];
+
+  while(same){
+    size_t na = fread(ba, 1, sizeof(ba), fa);
+    size_t nb = fread(bb, 1, sizeof(bb), fb);
+    if(na != nb || memcmp(ba, bb, na) != 0)
+      same = 0;
+    if(na == 0)
+      break;
+  }
+  if(fa)
+    fclose(fa);
+  if(fb)
+    fclose(fb);
+  return same;
+}
+
+int main(int argc, char **argv){
+  char *msh = "./msh";
+  char *dir = "/tmp";
+  long mb = 1024;
+  int stages = 4;
+  int opt;
+
+  while((opt = getopt(argc, argv, "s:m:k:d:")) != -1){
+    switch(opt){
+      case 's':
+        msh = optarg;
+        break;
+      case 'm':
+        mb = atol(optarg);
+        break;
+      case 'k':
+        stages = atoi(optarg);
+        break;
+      case 'd':
+        dir = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-s msh] [-m MB] [-k stages] [-d dir]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(mb <= 0 || stages <= 0){
+    fprintf(stderr, "ERROR: size and stage count must be positive.\n");
+    return 1;
+  }
+
+  char in[4096], out[4096];
+  snprintf(in, sizeof(in), "%s/pipebench.%d.in", dir, (int)getpid());
+  snprintf(out, sizeof(out), "%s/pipebench.%d.out", dir, (int)getpid());
+  make_input(in, mb);
+
+  // cat < in | cat | ... > out
+  size_t cap = 64 + 2 * strlen(in) + 8 * stages;
+  char *line = malloc(cap);
+  if(!line){
+    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN MAIN.\n");
+    return 1;
+  }
+  int n = snprintf(line, cap, "cat < %s", in);
+  int i;
+  for(i = 1; i < stages; i++){
+    n += snprintf(line + n, cap - n, " | cat");
+  }
+  snprintf(line + n, cap - n, " > %s", out);
+
+  char *msh_argv[] = { msh, NULL };
+  char *sh_argv[] = { "/bin/sh", NULL };
+
+  printf("%ld MB through %d stages\n", mb, stages);
+
+  double t = run_shell(msh_argv, line);
+  int ok = same_contents(in, out);
+  printf("msh     %8.3f s   %8.1f MB/s   %s\n", t, mb / t, ok ? "output ok" : "OUTPUT DIFFERS");
+
+  t = run_shell(sh_argv, line);
+  printf("/bin/sh %8.3f s   %8.1f MB/s\n", t, mb / t);
+
+  unlink(in);
+  unlink(out);
+  free(line);
+  return ok ? 0 : 1;
+}
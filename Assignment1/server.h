@@ -0,0 +1,713 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Fork server mode of the Maverick Shell (msh -S socket).
+ *
+ * Tools that shell out to msh for every command pay for a new process, its
+ * startup and the signal setup in main() each time. In server mode msh
+ * starts once and runs commands for any number of clients connected to a
+ * Unix socket (see serverproto.h for the requests and replies).
+ *
+ * The server is two processes. The front end owns the socket and multiplexes
+ * every client with epoll; it only ever reads requests and writes replies.
+ * Commands are started by a zygote, a copy of msh forked before the first
+ * client connects, while it is still small, that already has its signals
+ * and path index set up. The front end forwards each complete request to the
+ * zygote over a SOCK_SEQPACKET pair, along with the client's descriptors;
+ * the zygote vforks and execs the command and sends back its pid, and later
+ * its wait status, which the front end passes on to the client.
+ *
+ * This file uses the state and functions declared before it in msh.c, so it
+ * is included after those.
+ */
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "jobs.h"
+#include "pathidx.h"
+#include "serverproto.h"
+#include "spawn.h"
+#include "stats.h"
+
+#define SERVER_EVENTS    256
+#define SERVER_LISTEN    ((uint64_t)-1)   // epoll data of the listening socket
+#define SERVER_ZYGOTE    ((uint64_t)-2)   // and of the zygote socket
+
+/*
+ * Sent by the front end to the zygote, followed by the request as the client sent it.
+ */
+struct zygote_order {
+  uint32_t  client;   // slot of the client, with its generation to catch reused slots
+  uint32_t  gen;
+};
+
+/*
+ * Sent by the zygote to the front end for every reply a client should get.
+ */
+struct zygote_event {
+  uint32_t  client;
+  uint32_t  gen;
+  struct server_reply reply;
+};
+
+/*
+ * A command the zygote started and has not reaped yet.
+ */
+struct zygote_child {
+  pid_t     pid;
+  uint32_t  client;
+  uint32_t  gen;
+  uint32_t  id;
+  int       silent;   // exec failed and the client already got SERVER_ERROR
+  double    started;
+  char      name[STATS_NAME_MAX];
+};
+
+struct server_client {
+  int       fd;       // -1 for a free slot
+  uint32_t  gen;
+  int       busy;     // a request is with the zygote, so we are not reading
+  char     *buf;      // request read so far
+  size_t    len;
+  size_t    cap;
+  int       fds[3];   // descriptors that came with the request
+  int       nfds;
+};
+
+struct server {
+  int                   listen_fd;
+  int                   zygote_fd;
+  pid_t                 zygote_pid;
+  int                   epoll_fd;
+  struct server_client *clients;
+  int                   nclients;
+  int                   cap;
+  unsigned long         requests;
+};
+
+static struct server server;
+
+/*
+ * Set by the zygote's child if chdir or exec fails. vfork shares our memory, so
+ * we can read it as soon as vfork returns.
+ */
+static volatile int zygote_exec_errno = 0;
+
+/*
+ * Listens on path and serves requests until ctrl-C or SIGTERM. Returns 0 on a
+ * clean shutdown and 1 if the server could not start.
+ */
+int run_server(const char *path);
+
+/*
+ * The zygote: starts what the front end asks for on sock until sock is closed.
+ * Never returns.
+ */
+void zygote_main(int sock);
+
+
+/*
+ * Receives a message and up to three descriptors with it. Extra descriptors are
+ * closed. Returns what recvmsg returned.
+ */
+ssize_t server_recv_fds(int sock, void *buf, size_t len, int *fds, int *nfds, int flags){
+  struct iovec iov = { buf, len };
+  struct msghdr msg;
+  union {
+    char           buf[CMSG_SPACE(8 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t n = recvmsg(sock, &msg, flags | MSG_CMSG_CLOEXEC);
+  if(n < 0)
+    return n;
+
+  struct cmsghdr *cmsg;
+  for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+    if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    int *got = (int *)CMSG_DATA(cmsg);
+    int i;
+    for(i = 0; i < count; i++){
+      if(*nfds < 3)
+        fds[(*nfds)++] = got[i];
+      else
+        close(got[i]);
+    }
+  }
+  return n;
+}
+
+/*
+ * Sends a message with descriptors attached, if nfds is not 0.
+ */
+ssize_t server_send_fds(int sock, const void *head, size_t head_len, const void *body,
+                        size_t body_len, const int *fds, int nfds){
+  struct iovec iov[2] = { { (void *)head, head_len }, { (void *)body, body_len } };
+  struct msghdr msg;
+  union {
+    char           buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  if(nfds > 0){
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+  }
+
+  ssize_t n;
+  do{
+    n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  }while(n < 0 && errno == EINTR);
+  return n;
+}
+
+/*
+ * Zygote side: the children it has started, the events the front end has not
+ * taken yet, and /dev/null for commands sent without descriptors.
+ */
+static struct zygote_child *zygote_children = NULL;
+static int                  zygote_nchildren = 0;
+static int                  zygote_children_cap = 0;
+static struct zygote_event *zygote_queue = NULL;
+static int                  zygote_nqueue = 0;
+static int                  zygote_queue_cap = 0;
+static int                  zygote_null = -1;
+
+void zygote_push(uint32_t client, uint32_t gen, uint32_t id, uint32_t kind, int32_t value){
+  if(zygote_nqueue == zygote_queue_cap){
+    zygote_queue_cap = zygote_queue_cap ? zygote_queue_cap * 2 : 64;
+    zygote_queue = xrealloc(zygote_queue, zygote_queue_cap * sizeof(struct zygote_event), "ZYGOTE_PUSH");
+  }
+  struct zygote_event *e = &zygote_queue[zygote_nqueue++];
+  e->client = client;
+  e->gen = gen;
+  e->reply.id = id;
+  e->reply.kind = kind;
+  e->reply.value = value;
+}
+
+/*
+ * Sends queued events to the front end until its socket is full. The zygote never
+ * blocks on the front end, so the two can not wait on each other.
+ */
+void zygote_flush(int sock){
+  int sent = 0;
+  while(sent < zygote_nqueue){
+    if(send(sock, &zygote_queue[sent], sizeof(struct zygote_event), MSG_DONTWAIT | MSG_NOSIGNAL) < 0){
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN)
+        break;
+      _exit(1);
+    }
+    sent++;
+  }
+  memmove(zygote_queue, zygote_queue + sent, (zygote_nqueue - sent) * sizeof(struct zygote_event));
+  zygote_nqueue -= sent;
+}
+
+/*
+ * Splits the strings of a request into cwd, argv and envp, all NULL terminated
+ * and allocated from the command arena. Returns -1 if the strings do not match
+ * the header.
+ */
+int zygote_parse(const struct server_request *req, char *strings, size_t len, const char **cwd,
+                 char ***argv, char ***envp){
+  int want = 1 + req->argc + ((req->flags & SERVER_ENV) ? req->envc : 0);
+  char **words = arena_alloc(&command_arena, (want + 2) * sizeof(char *));
+  size_t pos = 0;
+  int n = 0;
+
+  while(n < want && pos < len){
+    char *end = memchr(strings + pos, '\0', len - pos);
+    if(end == NULL)
+      return -1;
+    words[n++] = strings + pos;
+    pos = end - strings + 1;
+  }
+  if(n != want || req->argc == 0)
+    return -1;
+
+  *cwd = words[0];
+  *argv = arena_alloc(&command_arena, (req->argc + 1) * sizeof(char *));
+  memcpy(*argv, words + 1, req->argc * sizeof(char *));
+  (*argv)[req->argc] = NULL;
+  if(req->flags & SERVER_ENV){
+    *envp = arena_alloc(&command_arena, (req->envc + 1) * sizeof(char *));
+    memcpy(*envp, words + 1 + req->argc, req->envc * sizeof(char *));
+    (*envp)[req->envc] = NULL;
+  }
+  else{
+    *envp = environ;
+  }
+  return 0;
+}
+
+/*
+ * Starts one command. Returns its pid, or -1 with the reason in *err.
+ */
+pid_t zygote_launch(const char *path, char **argv, char **envp, const char *cwd, const int *fds,
+                    int *err){
+  // Signals stay blocked until the child has let go of the zygote's handlers, as in
+  // spawn_vfork.
+  sigset_t all, saved;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &saved);
+  zygote_exec_errno = 0;
+  pid_t pid = vfork();
+  if(pid == 0){
+    // Only system calls from here on: we are running on the zygote's memory.
+    setpgid(0, 0);
+    if(cwd[0] != '\0' && chdir(cwd) != 0){
+      zygote_exec_errno = errno;
+      _exit(127);
+    }
+    spawn_install_fds(fds);
+    spawn_vfork_signals(&saved);
+    execve(path, argv, envp);
+    zygote_exec_errno = errno;
+    _exit(127);
+  }
+  int fork_errno = errno;
+  pthread_sigmask(SIG_SETMASK, &saved, NULL);
+  if(pid < 0){
+    *err = fork_errno;
+    return -1;
+  }
+  if(zygote_exec_errno != 0){
+    // The child is already gone; it only needs reaping.
+    *err = zygote_exec_errno;
+    return pid;
+  }
+  *err = 0;
+  return pid;
+}
+
+/*
+ * Takes one order from the front end and starts it.
+ */
+void zygote_order(int sock){
+  static char buf[sizeof(struct zygote_order) + SERVER_MAX_REQUEST];
+  int fds[3];
+  int nfds = 0;
+  int i;
+
+  ssize_t n = server_recv_fds(sock, buf, sizeof(buf), fds, &nfds, MSG_DONTWAIT);
+  if(n < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  if(n <= 0)
+    _exit(0);   // the front end is gone
+
+  arena_reset(&command_arena);
+  struct zygote_order order;
+  struct server_request req;
+  memcpy(&order, buf, sizeof(order));
+  memcpy(&req, buf + sizeof(order), sizeof(req));
+
+  const char *cwd;
+  char **argv, **envp;
+  int err = 0;
+  pid_t pid = -1;
+  const char *path = NULL;
+  char *strings = buf + sizeof(order) + sizeof(req);
+  size_t len = n - sizeof(order) - sizeof(req);
+
+  if(zygote_parse(&req, strings, len, &cwd, &argv, &envp) != 0)
+    err = EINVAL;
+  else if(strchr(argv[0], '/') != NULL)
+    path = argv[0];
+  else if((path = path_index_lookup(argv[0])) == NULL)
+    err = ENOENT;
+
+  if(err == 0){
+    int null_fds[3] = { zygote_null, zygote_null, zygote_null };
+    pid = zygote_launch(path, argv, envp, cwd, nfds == 3 ? fds : null_fds, &err);
+  }
+  for(i = 0; i < nfds; i++){
+    close(fds[i]);
+  }
+
+  if(pid > 0){
+    if(zygote_nchildren == zygote_children_cap){
+      zygote_children_cap = zygote_children_cap ? zygote_children_cap * 2 : 64;
+      zygote_children = xrealloc(zygote_children, zygote_children_cap * sizeof(struct zygote_child),
+                                 "ZYGOTE_ORDER");
+    }
+    struct zygote_child *c = &zygote_children[zygote_nchildren++];
+    c->pid = pid;
+    c->client = order.client;
+    c->gen = order.gen;
+    c->id = req.id;
+    c->silent = err != 0;
+    c->started = stats_now();
+    const char *base = strrchr(argv[0], '/');
+    snprintf(c->name, sizeof(c->name), "%s", base ? base + 1 : argv[0]);
+  }
+
+  if(err != 0)
+    zygote_push(order.client, order.gen, req.id, SERVER_ERROR, err);
+  else
+    zygote_push(order.client, order.gen, req.id, SERVER_PID, pid);
+}
+
+/*
+ * Reaps every child that exited and queues its wait status.
+ */
+void zygote_reap(){
+  char drain[64];
+  while(read(job_table.sigchld_pipe[0], drain, sizeof(drain)) > 0){
+  }
+
+  pid_t pid;
+  int status;
+  struct rusage ru;
+  while((pid = wait4(-1, &status, WNOHANG, &ru)) > 0){
+    int i;
+    for(i = 0; i < zygote_nchildren; i++){
+      if(zygote_children[i].pid == pid)
+        break;
+    }
+    if(i == zygote_nchildren)
+      continue;
+
+    struct zygote_child *c = &zygote_children[i];
+    if(!c->silent){
+      zygote_push(c->client, c->gen, c->id, SERVER_EXIT, status);
+      stats_record(c->name, pid, exit_code(status), stats_now() - c->started, &ru);
+    }
+    zygote_children[i] = zygote_children[--zygote_nchildren];
+  }
+}
+
+void zygote_main(int sock){
+  // Set up once what every command would otherwise need: default signals, the path index.
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTSTP, SIG_DFL);
+  signal(SIGTTIN, SIG_DFL);
+  signal(SIGTTOU, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  jobs_reset_child();
+  path_index_lookup("sh");
+  zygote_null = open("/dev/null", O_RDWR | O_CLOEXEC);
+
+  struct pollfd fds[2];
+  while(1){
+    fds[0].fd = sock;
+    fds[0].events = POLLIN | (zygote_nqueue > 0 ? POLLOUT : 0);
+    fds[1].fd = job_table.sigchld_pipe[0];
+    fds[1].events = POLLIN;
+
+    if(poll(fds, 2, -1) < 0)
+      continue;
+    if(fds[1].revents)
+      zygote_reap();
+    if(fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+      zygote_order(sock);
+    if(zygote_nqueue > 0)
+      zygote_flush(sock);
+  }
+}
+
+/*
+ * Front end side.
+ */
+
+void server_close_client(struct server_client *c){
+  int i;
+  epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  for(i = 0; i < c->nfds; i++){
+    close(c->fds[i]);
+  }
+  c->fd = -1;
+  c->gen++;   // replies still on their way for this slot are dropped
+  c->busy = 0;
+  c->len = 0;
+  c->nfds = 0;
+  server.nclients--;
+}
+
+void server_accept(){
+  while(1){
+    int fd = accept4(server.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd < 0){
+      if(errno == EINTR)
+        continue;
+      return;   // EAGAIN, or out of descriptors until a client leaves
+    }
+
+    int i;
+    for(i = 0; i < server.cap && server.clients[i].fd >= 0; i++){
+    }
+    if(i == server.cap){
+      int old = server.cap;
+      server.cap = old ? old * 2 : 64;
+      server.clients = xrealloc(server.clients, server.cap * sizeof(struct server_client), "SERVER_ACCEPT");
+      memset(&server.clients[old], 0, (server.cap - old) * sizeof(struct server_client));
+      int j;
+      for(j = old; j < server.cap; j++){
+        server.clients[j].fd = -1;
+      }
+    }
+
+    struct server_client *c = &server.clients[i];
+    c->fd = fd;
+    c->busy = 0;
+    c->len = 0;
+    c->nfds = 0;
+    server.nclients++;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = i;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+void server_reply(struct server_client *c, uint32_t id, uint32_t kind, int32_t value){
+  struct server_reply reply = { id, kind, value };
+  // At most two small replies are ever outstanding, so a full socket means the client is stuck.
+  if(send(c->fd, &reply, sizeof(reply), MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(reply))
+    server_close_client(c);
+}
+
+/*
+ * Hands the request at the start of the client's buffer to the zygote if it is
+ * complete. Returns -1 if the client sent something that is not a request.
+ */
+int server_dispatch(struct server_client *c, int slot){
+  struct server_request req;
+  if(c->busy || c->len < sizeof(req))
+    return 0;
+  memcpy(&req, c->buf, sizeof(req));
+  if(req.magic != SERVER_MAGIC || sizeof(req) + req.len > SERVER_MAX_REQUEST || req.argc == 0)
+    return -1;
+  if(c->len < sizeof(req) + req.len)
+    return 0;
+
+  // Descriptors only count if the request says so.
+  struct zygote_order order = { slot, c->gen };
+  int nfds = (req.flags & SERVER_FDS) && c->nfds == 3 ? 3 : 0;
+  int i;
+  size_t used = sizeof(req) + req.len;
+  int sent = server_send_fds(server.zygote_fd, &order, sizeof(order), c->buf, used, c->fds, nfds);
+  int err = errno;
+
+  // Sent or not, the request is finished with here; a sent one's descriptors are the zygote's now.
+  for(i = 0; i < c->nfds; i++){
+    close(c->fds[i]);
+  }
+  c->nfds = 0;
+  memmove(c->buf, c->buf + used, c->len - used);
+  c->len -= used;
+
+  if(sent < 0){
+    // The client is still free to send more, so see whether it already has.
+    server_reply(c, req.id, SERVER_ERROR, err);
+    return c->fd >= 0 ? server_dispatch(c, slot) : 0;
+  }
+  c->busy = 1;
+  server.requests++;
+
+  // Nothing more is read from the client until its command is done.
+  struct epoll_event ev;
+  ev.events = 0;
+  ev.data.u64 = slot;
+  epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+  return 0;
+}
+
+void server_read_client(struct server_client *c, int slot){
+  while(c->fd >= 0 && !c->busy){
+    if(c->cap - c->len < 4096){
+      c->cap = c->cap ? c->cap * 2 : 4096;
+      c->buf = xrealloc(c->buf, c->cap, "SERVER_READ_CLIENT");
+    }
+    ssize_t n = server_recv_fds(c->fd, c->buf + c->len, c->cap - c->len, c->fds, &c->nfds, 0);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0 && errno == EAGAIN)
+      return;
+    if(n <= 0){
+      server_close_client(c);
+      return;
+    }
+    c->len += n;
+    if(server_dispatch(c, slot) != 0 || c->len > SERVER_MAX_REQUEST){
+      server_close_client(c);
+      return;
+    }
+  }
+}
+
+void server_zygote_events(){
+  struct zygote_event e;
+  while(1){
+    ssize_t n = recv(server.zygote_fd, &e, sizeof(e), MSG_DONTWAIT);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0 && errno == EAGAIN)
+      return;
+    if(n != sizeof(e)){
+      fprintf(stderr, "msh: the zygote exited.\n");
+      interrupted = 1;
+      return;
+    }
+
+    if(e.client >= (uint32_t)server.cap)
+      continue;
+    struct server_client *c = &server.clients[e.client];
+    if(c->fd < 0 || c->gen != e.gen)
+      continue;   // the client left while its command ran
+
+    server_reply(c, e.reply.id, e.reply.kind, e.reply.value);
+    if(c->fd >= 0 && e.reply.kind != SERVER_PID){
+      c->busy = 0;
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.u64 = e.client;
+      epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+      // The next request may already be waiting in the buffer.
+      if(server_dispatch(c, e.client) != 0)
+        server_close_client(c);
+    }
+  }
+}
+
+/*
+ * SIGTERM stops the server like ctrl-C does.
+ */
+static void server_signal(int sig){
+  (void)sig;
+  interrupted = 1;
+}
+
+int run_server(const char *path){
+  struct sockaddr_un addr;
+  struct stat st;
+
+  if(strlen(path) >= sizeof(addr.sun_path)){
+    fprintf(stderr, "msh: %s: socket path too long.\n", path);
+    return 1;
+  }
+  // A socket left behind by an earlier server is replaced, anything else is not touched.
+  if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(server.listen_fd < 0 || bind(server.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+     listen(server.listen_fd, SOMAXCONN) != 0){
+    perror(path);
+    return 1;
+  }
+
+  int pair[2];
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) != 0){
+    perror("socketpair");
+    return 1;
+  }
+  fflush(stdout);
+  server.zygote_pid = fork();
+  if(server.zygote_pid < 0){
+    perror("fork");
+    return 1;
+  }
+  if(server.zygote_pid == 0){
+    close(server.listen_fd);
+    close(pair[0]);
+    zygote_main(pair[1]);
+  }
+  close(pair[1]);
+  server.zygote_fd = pair[0];
+
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = server_signal;
+  sigaction(SIGTERM, &act, NULL);
+
+  server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u64 = SERVER_LISTEN;
+  epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &ev);
+  ev.events = EPOLLIN;
+  ev.data.u64 = SERVER_ZYGOTE;
+  epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.zygote_fd, &ev);
+
+  struct epoll_event events[SERVER_EVENTS];
+  while(!interrupted){
+    int n = epoll_wait(server.epoll_fd, events, SERVER_EVENTS, -1);
+    int i;
+    for(i = 0; i < n; i++){
+      uint64_t what = events[i].data.u64;
+      if(what == SERVER_LISTEN){
+        server_accept();
+      }
+      else if(what == SERVER_ZYGOTE){
+        server_zygote_events();
+      }
+      else{
+        struct server_client *c = &server.clients[what];
+        if(c->fd < 0)
+          continue;
+        if(events[i].events & (EPOLLERR | EPOLLHUP))
+          server_close_client(c);
+        else if(events[i].events & EPOLLIN)
+          server_read_client(c, (int)what);
+      }
+    }
+  }
+
+  // Closing the pair tells the zygote to exit; commands still running are left alone.
+  int i;
+  for(i = 0; i < server.cap; i++){
+    if(server.clients[i].fd >= 0)
+      server_close_client(&server.clients[i]);
+    free(server.clients[i].buf);
+  }
+  free(server.clients);
+  close(server.zygote_fd);
+  close(server.listen_fd);
+  close(server.epoll_fd);
+  waitpid(server.zygote_pid, NULL, 0);
+  unlink(path);
+  return 0;
+}
+
+#endif
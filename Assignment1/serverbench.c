@@ -0,0 +1,228 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Load generator for the Maverick Shell fork server.
+ *
+ * Build and run:
+ *   gcc -O2 -o msh msh.c
+ *   gcc -O2 -pthread -o serverbench serverbench.c
+ *   ./serverbench [-s path/to/msh] [-u socket] [-c clients] [-n requests] [-b baseline] [cmd ...]
+ *
+ * Starts msh -S on the socket (unless -s is given as "" and a server is
+ * already listening there), then has c client threads (64 by default)
+ * each keep one request in flight on their own connection until n
+ * requests (20000 by default) have run cmd (/bin/true by default).
+ * Reports requests per second and the p50/p99/max round trip from
+ * sending a request to its exit status. For comparison it then runs the
+ * command b times (500 by default) the way a tool without the server
+ * would, as msh -c, one at a time.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serverproto.h"
+
+struct bench_client {
+  pthread_t  thread;
+  long       first;   // requests [first, first + count) are this client's
+  long       count;
+  long       failed;
+};
+
+static const char *socket_path = "/tmp/msh.sock";
+static char      **command;
+static double     *latency;   // of every request, in seconds
+
+/*
+ * Returns the monotonic clock in seconds.
+ */
+double now_s();
+
+/*
+ * Sends the client's share of the requests one after the other on its own
+ * connection.
+ */
+void* client_main(void *arg);
+
+/*
+ * Runs cmd n times as msh -c and returns the wall time it took.
+ */
+double run_baseline(const char *msh, long n);
+
+
+double now_s(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void* client_main(void *arg){
+  struct bench_client *c = arg;
+  int sock = server_connect(socket_path);
+  long i;
+
+  if(sock < 0){
+    perror(socket_path);
+    c->failed = c->count;
+    return NULL;
+  }
+
+  for(i = 0; i < c->count; i++){
+    struct server_reply reply;
+    double start = now_s();
+    if(server_send(sock, (uint32_t)i, NULL, command, NULL, NULL) != 0){
+      c->failed += c->count - i;
+      break;
+    }
+    // A pid first, then the exit status, or a single error.
+    do{
+      if(server_recv(sock, &reply) != 0){
+        reply.kind = SERVER_ERROR;
+        break;
+      }
+    }while(reply.kind == SERVER_PID);
+    latency[c->first + i] = now_s() - start;
+    if(reply.kind != SERVER_EXIT || !WIFEXITED(reply.value) || WEXITSTATUS(reply.value) != 0)
+      c->failed++;
+  }
+  close(sock);
+  return NULL;
+}
+
+double run_baseline(const char *msh, long n){
+  // The line msh -c runs: the command words joined by spaces.
+  char line[4096];
+  size_t len = 0;
+  int i;
+  line[0] = '\0';
+  for(i = 0; command[i] != NULL && len < sizeof(line) - 1; i++){
+    len += snprintf(line + len, sizeof(line) - len, "%s%s", i ? " " : "", command[i]);
+  }
+
+  double start = now_s();
+  long j;
+  for(j = 0; j < n; j++){
+    pid_t pid = fork();
+    if(pid == 0){
+      execl(msh, msh, "-c", line, (char *)NULL);
+      _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+  }
+  return now_s() - start;
+}
+
+int cmp_double(const void *a, const void *b){
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv){
+  char *msh = "./msh";
+  int nclients = 64;
+  long n = 20000;
+  long baseline = 500;
+  int opt;
+
+  while((opt = getopt(argc, argv, "s:u:c:n:b:")) != -1){
+    switch(opt){
+      case 's':
+        msh = optarg;
+        break;
+      case 'u':
+        socket_path = optarg;
+        break;
+      case 'c':
+        nclients = atoi(optarg);
+        break;
+      case 'n':
+        n = atol(optarg);
+        break;
+      case 'b':
+        baseline = atol(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-s msh] [-u socket] [-c clients] [-n requests] [-b baseline]"
+                " [cmd ...]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(nclients <= 0 || n < nclients){
+    fprintf(stderr, "ERROR: need at least one client and one request per client.\n");
+    return 1;
+  }
+  static char *default_command[] = { "/bin/true", NULL };
+  command = optind < argc ? argv + optind : default_command;
+
+  pid_t server_pid = 0;
+  if(msh[0] != '\0'){
+    server_pid = fork();
+    if(server_pid == 0){
+      execl(msh, msh, "-S", socket_path, (char *)NULL);
+      perror(msh);
+      _exit(127);
+    }
+    // Wait for the socket to show up.
+    int tries;
+    for(tries = 0; tries < 500; tries++){
+      int s = server_connect(socket_path);
+      if(s >= 0){
+        close(s);
+        break;
+      }
+      usleep(10000);
+    }
+  }
+
+  latency = malloc(n * sizeof(double));
+  struct bench_client *clients = calloc(nclients, sizeof(struct bench_client));
+  if(!latency || !clients){
+    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN MAIN.\n");
+    return 1;
+  }
+
+  int i;
+  long first = 0;
+  double start = now_s();
+  for(i = 0; i < nclients; i++){
+    clients[i].first = first;
+    clients[i].count = n / nclients + (i < n % nclients);
+    first += clients[i].count;
+    pthread_create(&clients[i].thread, NULL, client_main, &clients[i]);
+  }
+  long failed = 0;
+  for(i = 0; i < nclients; i++){
+    pthread_join(clients[i].thread, NULL);
+    failed += clients[i].failed;
+  }
+  double t = now_s() - start;
+
+  qsort(latency, n, sizeof(double), cmp_double);
+  printf("%ld requests from %d clients running %s\n", n, nclients, command[0]);
+  printf("server      %10.0f req/s   p50 %8.1f us   p99 %8.1f us   max %8.1f us   %ld failed\n",
+         n / t, latency[n / 2] * 1e6, latency[(long)(n * 0.99)] * 1e6, latency[n - 1] * 1e6, failed);
+
+  if(server_pid > 0){
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, NULL, 0);
+  }
+
+  if(baseline > 0 && msh[0] != '\0'){
+    double tb = run_baseline(msh, baseline);
+    printf("msh -c      %10.0f req/s   %8.1f us each, one at a time\n", baseline / tb, tb * 1e6 / baseline);
+  }
+
+  free(latency);
+  free(clients);
+  return failed ? 1 : 0;
+}
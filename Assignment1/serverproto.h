@@ -0,0 +1,212 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Wire format of the Maverick Shell fork server (msh -S).
+ *
+ * A client connects to the Unix socket and sends one request at a time: a
+ * server_request header followed by len bytes of NUL terminated strings,
+ * the working directory (empty to keep the server's), argc arguments and,
+ * with SERVER_ENV, envc environment entries. With SERVER_FDS the header is
+ * sent with three descriptors attached (SCM_RIGHTS) that become the
+ * command's stdin, stdout and stderr; otherwise it gets /dev/null. The
+ * server answers with a SERVER_PID reply once the command is running and a
+ * SERVER_EXIT reply with its wait status when it is done, or a single
+ * SERVER_ERROR reply with an errno value if it could not be started. The
+ * connection can then be used for the next request.
+ *
+ * The client functions here only use the C library, so other tools can
+ * include this file on its own.
+ */
+
+#ifndef __SERVERPROTO_H__
+#define __SERVERPROTO_H__
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_MAGIC        0x3168736dU   // "msh1" in memory order
+#define SERVER_MAX_REQUEST  (64 * 1024)   // header and strings
+
+enum server_flags
+{
+  SERVER_FDS = 1,
+  SERVER_ENV = 2
+};
+
+enum server_reply_kind
+{
+  SERVER_PID   = 1,
+  SERVER_EXIT  = 2,
+  SERVER_ERROR = 3
+};
+
+struct server_request {
+  uint32_t  magic;
+  uint32_t  id;      // chosen by the client and echoed in the replies
+  uint32_t  len;     // bytes of strings after the header
+  uint16_t  argc;
+  uint16_t  envc;
+  uint32_t  flags;
+};
+
+struct server_reply {
+  uint32_t  id;
+  uint32_t  kind;
+  int32_t   value;   // pid, wait status or errno
+};
+
+/*
+ * Connects to the server listening on path. Returns the socket or -1.
+ */
+int server_connect(const char *path);
+
+/*
+ * Sends a request to run argv in cwd (NULL or "" to keep the server's) with envp
+ * (NULL to keep the server's) and fds as stdin, stdout and stderr (NULL for
+ * /dev/null). Returns 0, or -1 with errno set.
+ */
+int server_send(int sock, uint32_t id, const char *cwd, char **argv, char **envp, const int *fds);
+
+/*
+ * Reads one reply. Returns 0, or -1 if the connection failed or was closed.
+ */
+int server_recv(int sock, struct server_reply *reply);
+
+
+int server_connect(const char *path){
+  struct sockaddr_un addr;
+  if(strlen(path) >= sizeof(addr.sun_path)){
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(sock < 0)
+    return -1;
+  if(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+    int err = errno;
+    close(sock);
+    errno = err;
+    return -1;
+  }
+  return sock;
+}
+
+int server_send(int sock, uint32_t id, const char *cwd, char **argv, char **envp, const int *fds){
+  struct server_request req;
+  size_t len;
+  int i;
+
+  if(cwd == NULL)
+    cwd = "";
+  memset(&req, 0, sizeof(req));
+  req.magic = SERVER_MAGIC;
+  req.id = id;
+  len = strlen(cwd) + 1;
+  for(i = 0; argv[i] != NULL; i++){
+    len += strlen(argv[i]) + 1;
+  }
+  req.argc = i;
+  for(i = 0; envp != NULL && envp[i] != NULL; i++){
+    len += strlen(envp[i]) + 1;
+  }
+  req.envc = i;
+  if(envp != NULL)
+    req.flags |= SERVER_ENV;
+  if(fds != NULL)
+    req.flags |= SERVER_FDS;
+  req.len = len;
+  if(req.argc == 0 || sizeof(req) + len > SERVER_MAX_REQUEST){
+    errno = E2BIG;
+    return -1;
+  }
+
+  // Header and strings go out in one sendmsg, so the descriptors arrive with the header.
+  char stack[4096];
+  char *buf = sizeof(req) + len <= sizeof(stack) ? stack : malloc(sizeof(req) + len);
+  if(buf == NULL){
+    errno = ENOMEM;
+    return -1;
+  }
+  size_t n = 0;
+  memcpy(buf, &req, sizeof(req));
+  n += sizeof(req);
+  memcpy(buf + n, cwd, strlen(cwd) + 1);
+  n += strlen(cwd) + 1;
+  for(i = 0; argv[i] != NULL; i++){
+    memcpy(buf + n, argv[i], strlen(argv[i]) + 1);
+    n += strlen(argv[i]) + 1;
+  }
+  for(i = 0; envp != NULL && envp[i] != NULL; i++){
+    memcpy(buf + n, envp[i], strlen(envp[i]) + 1);
+    n += strlen(envp[i]) + 1;
+  }
+
+  struct iovec iov = { buf, n };
+  struct msghdr msg;
+  union {
+    char           buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if(fds != NULL){
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+  }
+
+  int result = 0;
+  size_t sent = 0;
+  while(sent < n){
+    ssize_t w = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    if(w < 0){
+      if(errno == EINTR)
+        continue;
+      result = -1;
+      break;
+    }
+    // Anything left goes out without the descriptors, which were sent with the first part.
+    sent += w;
+    iov.iov_base = buf + sent;
+    iov.iov_len = n - sent;
+    msg.msg_control = NULL;
+    msg.msg_controllen = 0;
+  }
+
+  if(buf != stack){
+    int err = errno;
+    free(buf);
+    errno = err;
+  }
+  return result;
+}
+
+int server_recv(int sock, struct server_reply *reply){
+  size_t got = 0;
+  while(got < sizeof(*reply)){
+    ssize_t r = read(sock, (char *)reply + got, sizeof(*reply) - got);
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r <= 0)
+      return -1;
+    got += r;
+  }
+  return 0;
+}
+
+#endif
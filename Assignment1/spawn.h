@@ -0,0 +1,243 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Process launch backends for the Maverick Shell.
+ *
+ * fork() copies the page tables of the whole shell for every command, only
+ * for the child to throw them away in execv. posix_spawn (which glibc builds
+ * on clone(CLONE_VM|CLONE_VFORK)) and vfork skip that copy. The backend is
+ * picked once at startup; fork is always there to fall back to.
+ */
+
+#ifndef __SPAWN_H__
+#define __SPAWN_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+extern char **environ;
+
+enum spawn_backend {
+  SPAWN_FORK = 0,
+  SPAWN_VFORK,
+  SPAWN_POSIX,
+  NUM_SPAWN_BACKENDS
+};
+
+char * spawnBackendAsString[ NUM_SPAWN_BACKENDS ] =
+{
+  "fork",
+  "vfork",
+  "spawn"
+};
+
+static enum spawn_backend spawn_backend = SPAWN_POSIX;
+
+/*
+ * Selects the launch backend by name ("fork", "vfork" or "spawn"). Returns 0 on
+ * success and -1 if the name is unknown.
+ */
+int spawn_set_backend(const char *name);
+
+/*
+ * Starts path with argv using the selected backend and returns the pid of the
+ * child, or -1 (after reporting why) if no child could be started. fds holds
+ * the descriptors to install as the child's 0, 1 and 2 (-1 keeps ours) and may
+ * be NULL. pgid is the process group to put the child in: 0 starts a new one
+ * led by the child, -1 leaves it in ours. The child gets the default action
+ * for every signal msh handles or ignores itself. If the child starts but
+ * execv fails it exits with 127.
+ */
+pid_t spawn_command(const char *path, char **argv, const int *fds, pid_t pgid);
+
+
+int spawn_set_backend(const char *name){
+  int i;
+  for(i = 0; i < NUM_SPAWN_BACKENDS; i++){
+    if(!strcmp(name, spawnBackendAsString[i])){
+      spawn_backend = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Signals msh catches or ignores, which must go back to the default in the child
+ * before it runs anything. execv only resets the caught ones.
+ */
+void spawn_default_signals(sigset_t *set){
+  sigemptyset(set);
+  sigaddset(set, SIGINT);
+  sigaddset(set, SIGTSTP);
+  sigaddset(set, SIGTTIN);
+  sigaddset(set, SIGTTOU);
+}
+
+/*
+ * Runs in the child before execv. Only uses setpgid and signal, which are safe
+ * after vfork; spawn_vfork keeps signals blocked until the child has reset them.
+ */
+void spawn_child_setup(pid_t pgid){
+  if(pgid >= 0)
+    setpgid(0, pgid);
+  signal(SIGTTIN, SIG_DFL);
+  signal(SIGTTOU, SIG_DFL);
+}
+
+/*
+ * The parent sets the group too so it is in place whichever side runs first.
+ */
+void spawn_parent_setup(pid_t pid, pid_t pgid){
+  if(pid > 0 && pgid >= 0)
+    setpgid(pid, pgid ? pgid : pid);
+}
+
+/*
+ * Runs in the child before execv. Only uses dup2 and fcntl so it is safe after vfork.
+ */
+void spawn_install_fds(const int *fds){
+  int i;
+  if(fds == NULL)
+    return;
+  for(i = 0; i < 3; i++){
+    if(fds[i] < 0)
+      continue;
+    if(fds[i] == i)
+      fcntl(i, F_SETFD, 0);  // dup2 onto itself would leave close-on-exec set
+    else
+      dup2(fds[i], i);
+  }
+}
+
+pid_t spawn_fork(const char *path, char **argv, const int *fds, pid_t pgid){
+  fflush(stdout); // so the child does not inherit and print our buffered output again
+  pid_t pid = fork();
+  if(pid == 0){
+    spawn_child_setup(pgid);
+    spawn_install_fds(fds);
+    execv(path, argv);
+    perror(argv[0]);
+    _exit(127);
+  }
+  if(pid < 0)
+    perror("fork");
+  spawn_parent_setup(pid, pgid);
+  return pid;
+}
+
+/*
+ * Runs in the vfork child with every signal blocked. Any handler of ours would
+ * run on msh's memory, so each caught signal goes back to the default, as do the
+ * ones msh ignores, before the mask the parent had is put back.
+ */
+void spawn_vfork_signals(const sigset_t *saved){
+  struct sigaction act, old;
+  sigset_t defaults;
+  int sig;
+
+  spawn_default_signals(&defaults);
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = SIG_DFL;
+  for(sig = 1; sig < NSIG; sig++){
+    if(sigaction(sig, NULL, &old) != 0)
+      continue;
+    if(old.sa_handler != SIG_DFL && (old.sa_handler != SIG_IGN || sigismember(&defaults, sig)))
+      sigaction(sig, &act, NULL);
+  }
+  pthread_sigmask(SIG_SETMASK, saved, NULL);
+}
+
+pid_t spawn_vfork(const char *path, char **argv, const int *fds, pid_t pgid){
+  // The child shares our memory until it execs, so it may only touch its descriptors,
+  // its signal state, execv and _exit. Signals stay blocked until it has let go of our
+  // handlers, the same as glibc's posix_spawn.
+  volatile pid_t group = pgid;
+  sigset_t all, saved;
+
+  fflush(stdout);
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &saved);
+  pid_t pid = vfork();
+  if(pid == 0){
+    spawn_child_setup(group);
+    spawn_install_fds(fds);
+    spawn_vfork_signals(&saved);
+    execv(path, argv);
+    _exit(127);
+  }
+  int err = errno;
+  pthread_sigmask(SIG_SETMASK, &saved, NULL);
+  if(pid < 0){
+    errno = err;
+    perror("vfork");
+  }
+  spawn_parent_setup(pid, group);
+  return pid;
+}
+
+pid_t spawn_posix(const char *path, char **argv, const int *fds, pid_t pgid){
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_t actions;
+  sigset_t defaults;
+  pid_t pid;
+  int i;
+
+  fflush(stdout);
+  posix_spawnattr_init(&attr);
+  spawn_default_signals(&defaults);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  if(pgid >= 0){
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+  }
+  else{
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+  }
+
+  // Same order as spawn_install_fds. dup2 onto the same descriptor clears close-on-exec here.
+  posix_spawn_file_actions_init(&actions);
+  for(i = 0; fds != NULL && i < 3; i++){
+    if(fds[i] >= 0)
+      posix_spawn_file_actions_adddup2(&actions, fds[i], i);
+  }
+
+  int err = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+
+  if(err == 0){
+    spawn_parent_setup(pid, pgid);
+    return pid;
+  }
+
+  // Errors from the exec itself mean the file changed under us; anything else is the
+  // spawn machinery failing, so give fork a chance.
+  if(err == ENOENT || err == EACCES || err == ENOEXEC || err == ENOTDIR || err == ELOOP){
+    errno = err;
+    perror(argv[0]);
+    return -1;
+  }
+  return spawn_fork(path, argv, fds, pgid);
+}
+
+pid_t spawn_command(const char *path, char **argv, const int *fds, pid_t pgid){
+  switch(spawn_backend){
+    case SPAWN_VFORK:
+      return spawn_vfork(path, argv, fds, pgid);
+    case SPAWN_POSIX:
+      return spawn_posix(path, argv, fds, pgid);
+    default:
+      return spawn_fork(path, argv, fds, pgid);
+  }
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Spawn throughput benchmark for the msh launch backends.
+ *
+ * Build and run:
+ *   gcc -O2 -o spawnbench spawnbench.c
+ *   ./spawnbench [-n spawns] [-m resident MB] [command]
+ *
+ * For every backend in spawn.h it starts the command (default /bin/true)
+ * n times back to back, waiting for each one like msh does. It reports
+ * commands per second and the latency of the spawn call itself, which is
+ * where fork pays for copying page tables. -m grows and touches a heap
+ * block first so the benchmark process looks like a shell with a large
+ * resident set.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spawn.h"
+
+/*
+ * Returns the monotonic clock in nanoseconds.
+ */
+long long now_ns();
+
+/*
+ * Used by qsort to order latency samples.
+ */
+int compare_ll(const void *a, const void *b);
+
+/*
+ * Runs one backend n times and prints its line of the report.
+ */
+void run_backend(enum spawn_backend backend, int n, char **argv);
+
+
+long long now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int compare_ll(const void *a, const void *b){
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+void run_backend(enum spawn_backend backend, int n, char **argv){
+  long long *samples = malloc(n * sizeof(long long));
+  if(!samples){
+    printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN RUN_BACKEND.\n");
+    exit(1);
+  }
+
+  spawn_backend = backend;
+
+  int i;
+  int failed = 0;
+  long long start = now_ns();
+  for(i = 0; i < n; i++){
+    int status;
+    long long t0 = now_ns();
+    pid_t pid = spawn_command(argv[0], argv, NULL, -1);
+    samples[i] = now_ns() - t0;
+    if(pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      failed++;
+  }
+  long long total = now_ns() - start;
+
+  qsort(samples, n, sizeof(long long), compare_ll);
+  printf("%-6s %10.0f cmds/s   spawn p50 %8.1f us   p99 %8.1f us   max %8.1f us   failed %d\n",
+         spawnBackendAsString[backend],
+         n / (total / 1e9),
+         samples[n / 2] / 1e3,
+         samples[(int)(n * 0.99)] / 1e3,
+         samples[n - 1] / 1e3,
+         failed);
+  free(samples);
+}
+
+int main(int argc, char **argv){
+  int n = 2000;
+  long mb = 0;
+  int opt;
+
+  while((opt = getopt(argc, argv, "n:m:")) != -1){
+    switch(opt){
+      case 'n':
+        n = atoi(optarg);
+        break;
+      case 'm':
+        mb = atol(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n spawns] [-m resident MB] [command [args]]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(n <= 0){
+    fprintf(stderr, "ERROR: spawn count must be positive.\n");
+    return 1;
+  }
+
+  char *default_cmd[] = { "/bin/true", NULL };
+  char **cmd = (optind < argc) ? &argv[optind] : default_cmd;
+
+  // Touch every page so it is really resident and has page table entries to copy.
+  char *ballast = NULL;
+  if(mb > 0){
+    ballast = malloc(mb << 20);
+    if(!ballast){
+      printf("ERROR IN ALLOCATING MEMORY FOR MALLOC IN MAIN.\n");
+      return 1;
+    }
+    memset(ballast, 1, mb << 20);
+  }
+
+  printf("%d spawns of %s with %ld MB resident\n", n, cmd[0], mb);
+  int b;
+  for(b = 0; b < NUM_SPAWN_BACKENDS; b++){
+    run_backend(b, n, cmd);
+  }
+
+  free(ballast);
+  return 0;
+}
@@ -0,0 +1,370 @@
+/*
+ * Name: Tanmay Sardesai
+ * ID #: 1001094616
+ * Programming Assignment 1
+ * Description: Per command timing and resource accounting for the Maverick Shell.
+ *
+ * Children are reaped with wait4(), which hands back their rusage, so every
+ * command msh starts is accounted for without wrapping it in /usr/bin/time.
+ * Each command name gets an entry with totals and a log-linear histogram of
+ * wall times: 8 buckets per power of two of microseconds, so percentiles
+ * come out within 12.5% with a fixed 2 KB per name and no sorting. The
+ * stats builtin prints them, and the time prefix prints the usage of one
+ * line like time(1).
+ *
+ * If MSH_STATS_LOG or -L names a file, every finished command is also
+ * appended to it as one JSON object per line. Each line is a single write()
+ * to a file opened with O_APPEND, so the copies of msh run by -P can share
+ * the log.
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+#define STATS_NAME_MAX  32
+#define STATS_SUB_BITS  3
+#define STATS_BUCKETS   (16 + 60 * (1 << STATS_SUB_BITS))
+
+/*
+ * What one command, or all the stages of a line, used.
+ */
+struct cmd_usage {
+  double  wall;     // seconds
+  double  user;
+  double  sys;
+  long    maxrss;   // KB, the largest of the processes
+  long    nvcsw;
+  long    nivcsw;
+};
+
+struct stats_entry {
+  char      name[STATS_NAME_MAX];  // empty marks a free slot
+  uint64_t  count;
+  uint64_t  failures;              // runs that did not exit with 0
+  double    wall;
+  double    user;
+  double    sys;
+  uint64_t  max_wall_us;
+  long      maxrss;
+  long      nvcsw;
+  long      nivcsw;
+  uint32_t  hist[STATS_BUCKETS];   // wall time in microseconds
+};
+
+struct stats_table {
+  struct stats_entry *entries;
+  int                 cap;         // power of two
+  int                 count;
+  int                 log_fd;      // -1 when there is no log
+};
+
+static struct stats_table stats_table = { NULL, 0, 0, -1 };
+
+/*
+ * Returns the monotonic clock in seconds.
+ */
+double stats_now();
+
+/*
+ * Opens the log the commands are appended to. Returns -1 if it could not be opened.
+ */
+int stats_open_log(const char *path);
+
+/*
+ * Adds what a process used, as returned by wait4(), to usage.
+ */
+void usage_add(struct cmd_usage *usage, const struct rusage *ru);
+
+/*
+ * Counts one finished run of the command name, which took wall seconds since msh
+ * started it and exited with code.
+ */
+void stats_record(const char *name, pid_t pid, int code, double wall, const struct rusage *ru);
+
+/*
+ * Returns the entry for name, making one if create is set. Returns NULL if there
+ * is none and create is not set.
+ */
+struct stats_entry* stats_find(const char *name, int create);
+
+/*
+ * Returns the wall time in microseconds that fraction p of the runs were within.
+ */
+uint64_t stats_percentile(const struct stats_entry *e, double p);
+
+/*
+ * Prints usage like time(1) does, to stderr.
+ */
+void usage_print(const struct cmd_usage *usage);
+
+/*
+ * Builtin: stats prints every command seen, stats name... only those, and
+ * stats -r forgets everything.
+ */
+int builtin_stats(char **token);
+
+
+double stats_now(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int stats_open_log(const char *path){
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if(fd < 0)
+    return -1;
+  if(stats_table.log_fd >= 0)
+    close(stats_table.log_fd);
+  stats_table.log_fd = fd;
+  return 0;
+}
+
+void usage_add(struct cmd_usage *usage, const struct rusage *ru){
+  usage->user += ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6;
+  usage->sys += ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+  if(ru->ru_maxrss > usage->maxrss)
+    usage->maxrss = ru->ru_maxrss;
+  usage->nvcsw += ru->ru_nvcsw;
+  usage->nivcsw += ru->ru_nivcsw;
+}
+
+int stats_bucket(uint64_t us){
+  if(us < 16)
+    return (int)us;
+  int e = 63 - __builtin_clzll(us);
+  return 16 + (e - 4) * (1 << STATS_SUB_BITS) +
+         (int)((us >> (e - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1));
+}
+
+/*
+ * Smallest value that falls in bucket b.
+ */
+uint64_t stats_bucket_value(int b){
+  if(b < 16)
+    return b;
+  int e = (b - 16) / (1 << STATS_SUB_BITS) + 4;
+  int sub = (b - 16) % (1 << STATS_SUB_BITS);
+  return (uint64_t)((1 << STATS_SUB_BITS) + sub) << (e - STATS_SUB_BITS);
+}
+
+uint32_t stats_hash(const char *s){
+  uint32_t h = 2166136261u;
+  while(*s){
+    h ^= (unsigned char)*s++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+struct stats_entry* stats_find(const char *name, int create){
+  if(stats_table.cap == 0){
+    if(!create)
+      return NULL;
+    stats_table.cap = 16;
+    stats_table.entries = xmalloc(stats_table.cap * sizeof(struct stats_entry), "STATS_FIND");
+    memset(stats_table.entries, 0, stats_table.cap * sizeof(struct stats_entry));
+  }
+
+  // Names longer than an entry holds are counted under their first STATS_NAME_MAX-1 bytes.
+  char key[STATS_NAME_MAX];
+  snprintf(key, sizeof(key), "%s", name);
+
+  uint32_t mask = stats_table.cap - 1;
+  uint32_t i = stats_hash(key) & mask;
+  while(stats_table.entries[i].name[0] != '\0'){
+    if(!strcmp(stats_table.entries[i].name, key))
+      return &stats_table.entries[i];
+    i = (i + 1) & mask;
+  }
+  if(!create)
+    return NULL;
+
+  if((stats_table.count + 1) * 4 > stats_table.cap * 3){
+    // Rehash into a table twice the size.
+    struct stats_entry *old = stats_table.entries;
+    int old_cap = stats_table.cap;
+    int j;
+    stats_table.cap *= 2;
+    stats_table.entries = xmalloc(stats_table.cap * sizeof(struct stats_entry), "STATS_FIND");
+    memset(stats_table.entries, 0, stats_table.cap * sizeof(struct stats_entry));
+    mask = stats_table.cap - 1;
+    for(j = 0; j < old_cap; j++){
+      if(old[j].name[0] == '\0')
+        continue;
+      i = stats_hash(old[j].name) & mask;
+      while(stats_table.entries[i].name[0] != '\0')
+        i = (i + 1) & mask;
+      stats_table.entries[i] = old[j];
+    }
+    free(old);
+    i = stats_hash(key) & mask;
+    while(stats_table.entries[i].name[0] != '\0')
+      i = (i + 1) & mask;
+  }
+
+  memcpy(stats_table.entries[i].name, key, sizeof(key));
+  stats_table.count++;
+  return &stats_table.entries[i];
+}
+
+/*
+ * Appends one JSON line for the run to the log.
+ */
+void stats_log(const char *name, pid_t pid, int code, double wall, const struct cmd_usage *u){
+  char line[512];
+  char esc[2 * STATS_NAME_MAX];
+  size_t n = 0;
+  const char *s;
+
+  for(s = name; *s && n < sizeof(esc) - 2 && s - name < STATS_NAME_MAX; s++){
+    if(*s == '"' || *s == '\\')
+      esc[n++] = '\\';
+    esc[n++] = (unsigned char)*s < 0x20 ? '?' : *s;
+  }
+  esc[n] = '\0';
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  int len = snprintf(line, sizeof(line),
+                     "{\"time\":%ld.%03ld,\"cmd\":\"%s\",\"pid\":%d,\"status\":%d,"
+                     "\"wall_us\":%.0f,\"user_us\":%.0f,\"sys_us\":%.0f,\"maxrss_kb\":%ld,"
+                     "\"nvcsw\":%ld,\"nivcsw\":%ld}\n",
+                     (long)ts.tv_sec, ts.tv_nsec / 1000000, esc, (int)pid, code,
+                     wall * 1e6, u->user * 1e6, u->sys * 1e6, u->maxrss, u->nvcsw, u->nivcsw);
+  if(write(stats_table.log_fd, line, len) < 0){
+    close(stats_table.log_fd);
+    stats_table.log_fd = -1;
+  }
+}
+
+void stats_record(const char *name, pid_t pid, int code, double wall, const struct rusage *ru){
+  struct cmd_usage u;
+  memset(&u, 0, sizeof(u));
+  usage_add(&u, ru);
+
+  struct stats_entry *e = stats_find(name, 1);
+  uint64_t us = wall > 0 ? (uint64_t)(wall * 1e6) : 0;
+  e->count++;
+  if(code != 0)
+    e->failures++;
+  e->wall += wall;
+  e->user += u.user;
+  e->sys += u.sys;
+  if(us > e->max_wall_us)
+    e->max_wall_us = us;
+  if(u.maxrss > e->maxrss)
+    e->maxrss = u.maxrss;
+  e->nvcsw += u.nvcsw;
+  e->nivcsw += u.nivcsw;
+  e->hist[stats_bucket(us)]++;
+
+  if(stats_table.log_fd >= 0)
+    stats_log(name, pid, code, wall, &u);
+}
+
+uint64_t stats_percentile(const struct stats_entry *e, double p){
+  // Nearest rank: the run at position ceil(p * count), counting from 1.
+  double rank = p * e->count;
+  uint64_t want = (uint64_t)rank;
+  uint64_t seen = 0;
+  int b;
+  if(want == rank && want > 0)
+    want--;
+  if(want >= e->count)
+    want = e->count - 1;
+  for(b = 0; b < STATS_BUCKETS; b++){
+    seen += e->hist[b];
+    if(seen > want){
+      // Report the middle of the bucket, but never more than the slowest run.
+      uint64_t lo = stats_bucket_value(b);
+      uint64_t hi = b + 1 < STATS_BUCKETS ? stats_bucket_value(b + 1) : lo;
+      uint64_t mid = lo + (hi - lo) / 2;
+      return mid < e->max_wall_us ? mid : e->max_wall_us;
+    }
+  }
+  return e->max_wall_us;
+}
+
+void usage_print(const struct cmd_usage *u){
+  fprintf(stderr, "\nreal\t%dm%.3fs\nuser\t%dm%.3fs\nsys\t%dm%.3fs\n",
+          (int)(u->wall / 60), u->wall - 60 * (int)(u->wall / 60),
+          (int)(u->user / 60), u->user - 60 * (int)(u->user / 60),
+          (int)(u->sys / 60), u->sys - 60 * (int)(u->sys / 60));
+  fprintf(stderr, "maxrss\t%ld KB\nctxsw\t%ld voluntary, %ld involuntary\n",
+          u->maxrss, u->nvcsw, u->nivcsw);
+}
+
+int stats_by_wall(const void *a, const void *b){
+  const struct stats_entry *x = *(const struct stats_entry * const *)a;
+  const struct stats_entry *y = *(const struct stats_entry * const *)b;
+  if(x->wall != y->wall)
+    return x->wall < y->wall ? 1 : -1;
+  return strcmp(x->name, y->name);
+}
+
+void stats_print_entry(const struct stats_entry *e){
+  printf("%-20s %7llu %6llu %10.3f %10.3f %10.3f %10.3f %10.3f %9ld %8ld\n", e->name,
+         (unsigned long long)e->count, (unsigned long long)e->failures,
+         stats_percentile(e, 0.50) / 1e3, stats_percentile(e, 0.99) / 1e3,
+         e->max_wall_us / 1e3, e->user * 1e3 / e->count, e->sys * 1e3 / e->count,
+         e->maxrss, (e->nvcsw + e->nivcsw) / (long)e->count);
+}
+
+int builtin_stats(char **token){
+  int i, n = 0;
+
+  if(token[1] != NULL && !strcmp(token[1], "-r")){
+    if(stats_table.cap > 0)
+      memset(stats_table.entries, 0, stats_table.cap * sizeof(struct stats_entry));
+    stats_table.count = 0;
+    return 0;
+  }
+
+  printf("%-20s %7s %6s %10s %10s %10s %10s %10s %9s %8s\n", "command", "runs", "failed",
+         "p50 ms", "p99 ms", "max ms", "user ms", "sys ms", "maxrss KB", "ctxsw");
+
+  if(token[1] != NULL){
+    int status = 0;
+    for(i = 1; token[i] != NULL; i++){
+      struct stats_entry *e = stats_find(token[i], 0);
+      if(e == NULL){
+        printf("stats: %s: not run yet.\n", token[i]);
+        status = 1;
+        continue;
+      }
+      stats_print_entry(e);
+    }
+    return status;
+  }
+
+  if(stats_table.count == 0)
+    return 0;
+
+  // Slowest in total first, which is where the time went.
+  struct stats_entry **sorted = xmalloc(stats_table.count * sizeof(struct stats_entry *), "BUILTIN_STATS");
+  for(i = 0; i < stats_table.cap; i++){
+    if(stats_table.entries[i].name[0] != '\0')
+      sorted[n++] = &stats_table.entries[i];
+  }
+  qsort(sorted, n, sizeof(struct stats_entry *), stats_by_wall);
+  for(i = 0; i < n; i++){
+    stats_print_entry(sorted[i]);
+  }
+  free(sorted);
+  return 0;
+}
+
+#endif
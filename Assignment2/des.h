@@ -0,0 +1,57 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __DES_H__
+#define __DES_H__
+
+#include <stdint.h>
+
+#include "sim.h"
+#include "train.h"
+
+/*
+ *
+ * Discrete event mode (mavon -d): the schedule runs through the
+ * simulation in sim.h instead of threads and a real clock, and mavon
+ * only sees each arrival, entry and leave to print and measure it.
+ *
+ */
+
+// Set by -d.  main() hands the whole run to desRun() when it is.
+int virtual_time = 0;
+
+struct sim des;
+
+// In mavon.c
+void desTrace( struct sim * s, enum SIM_EVENT kind, uint32_t entry );
+
+void desRun( )
+{
+  simInit( &des, schedule + schedule_front, schedule_back - schedule_front );
+  des.trace = desTrace;
+  simRun( &des );
+
+  schedule_front += des.next;
+  current_time    = des.current_time;
+}
+
+#endif
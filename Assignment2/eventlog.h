@@ -0,0 +1,298 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __EVENTLOG_H__
+#define __EVENTLOG_H__
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpsc.h"
+#include "train.h"
+
+/*
+ *
+ * The arrived / entering / leaving lines, written off the trains' threads.
+ *
+ * logEvent() stores a small fixed-size record in the calling thread's own
+ * ring buffer and returns; it never formats or does I/O, so a train
+ * holding the intersection is not held up by a slow terminal or pipe.  A
+ * drainer thread wakes every LOG_DRAIN_NS, or sooner when a ring fills
+ * up, takes everything the rings hold, puts it back in the order it was
+ * logged and writes it to stdout in one go.
+ *
+ * Every record takes a number from one counter, and the drainer only
+ * writes records below the counter as it was when it started, waiting
+ * for any thread caught between taking a number and publishing its
+ * record.  So the lines come out in the order they were logged, and a
+ * single-threaded run prints exactly what fprintf did.
+ *
+ * A thread gets a ring the first time it logs.  When it exits the ring
+ * is drained and handed to the next new thread, so -t's thread per train
+ * does not mean a ring per train.
+ *
+ * Building with -DLOG_LEVEL=0 compiles every call out, for benchmarks.
+ *
+ */
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 1
+#endif
+
+#define LOG_RING_SIZE 1024         // records per thread, a power of two
+#define LOG_DRAIN_NS  5000000      // longest a record waits to be written
+#define LOG_BUFFER    ( 64 * 1024 )
+
+enum LOG_KIND
+{
+  LOG_ARRIVE = 0,
+  LOG_ENTER  = 1,
+  LOG_LEAVE  = 2
+};
+
+struct log_record
+{
+  uint64_t seq;
+  uint32_t time;
+  uint32_t train_id;
+  uint32_t kind;
+  uint32_t direction;
+};
+
+enum LOG_RING_STATE
+{
+  LOG_RING_OWNED   = 0,   // a live thread logs to it
+  LOG_RING_RETIRED = 1,   // its thread is gone, the drainer empties it
+  LOG_RING_FREE    = 2    // empty, for the next new thread
+};
+
+struct log_ring
+{
+  struct log_record records[ LOG_RING_SIZE ];
+  uint32_t          head;      // next for the drainer
+  uint32_t          tail;      // next for the owner
+  uint32_t          writing;   // owner has a number but has not published
+  uint32_t          state;
+  struct log_ring  *next;
+};
+
+struct event_log
+{
+  struct log_ring   *rings;    // every ring ever made, newest first
+  uint64_t           seq;
+  uint32_t           wake;     // futex the drainer sleeps on
+  uint32_t           stop;
+  int                running;
+  pthread_t          drainer;
+  pthread_key_t      key;
+  struct log_record *batch;
+  uint32_t           batch_cap;
+};
+
+#if LOG_LEVEL > 0
+
+struct event_log           event_log;
+static __thread struct log_ring *log_mine;
+
+void logStart( );
+void logEvent( enum LOG_KIND kind, uint32_t time, uint32_t train_id, enum TRAIN_DIRECTION direction );
+
+// Writes everything logged so far and stops the drainer
+void logStop ( );
+
+// pthread_key destructor, run as a thread that logged exits
+void logRetire( void * val )
+{
+  struct log_ring *ring = val;
+  __atomic_store_n( &ring->state, LOG_RING_RETIRED, __ATOMIC_RELEASE );
+}
+
+struct log_ring * logRing( )
+{
+  struct log_ring *ring;
+
+  // A ring a finished thread left behind, if there is one
+  for( ring = __atomic_load_n( &event_log.rings, __ATOMIC_ACQUIRE ); ring != NULL; ring = ring->next )
+  {
+    uint32_t state = LOG_RING_FREE;
+    if( __atomic_compare_exchange_n( &ring->state, &state, LOG_RING_OWNED, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+      break;
+  }
+
+  if( ring == NULL )
+  {
+    ring = calloc( 1, sizeof( struct log_ring ) );
+    if( ring == NULL )
+    {
+      fprintf( stderr, "ERROR: Out of memory for a log ring.\n");
+      exit( EXIT_FAILURE );
+    }
+    ring->next = __atomic_load_n( &event_log.rings, __ATOMIC_RELAXED );
+    while( !__atomic_compare_exchange_n( &event_log.rings, &ring->next, ring, 1,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+  }
+  pthread_setspecific( event_log.key, ring );
+  return ring;
+}
+
+void logEvent( enum LOG_KIND kind, uint32_t time, uint32_t train_id, enum TRAIN_DIRECTION direction )
+{
+  struct log_ring *ring = log_mine;
+  if( ring == NULL ) ring = log_mine = logRing( );
+
+  // Full: hurry the drainer along
+  while( ring->tail - __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE ) == LOG_RING_SIZE )
+  {
+    __atomic_store_n( &event_log.wake, 1, __ATOMIC_RELEASE );
+    futexWake( &event_log.wake );
+    sched_yield( );
+  }
+
+  __atomic_store_n( &ring->writing, 1, __ATOMIC_SEQ_CST );
+  struct log_record *r = &ring->records[ ring->tail % LOG_RING_SIZE ];
+  r->seq       = __atomic_fetch_add( &event_log.seq, 1, __ATOMIC_SEQ_CST );
+  r->time      = time;
+  r->train_id  = train_id;
+  r->kind      = kind;
+  r->direction = direction;
+  __atomic_store_n( &ring->tail, ring->tail + 1, __ATOMIC_RELEASE );
+  __atomic_store_n( &ring->writing, 0, __ATOMIC_RELEASE );
+
+  if( ring->tail - __atomic_load_n( &ring->head, __ATOMIC_RELAXED ) == LOG_RING_SIZE / 2 )
+  {
+    __atomic_store_n( &event_log.wake, 1, __ATOMIC_RELEASE );
+    futexWake( &event_log.wake );
+  }
+}
+
+int logRecordCompare( const void * a, const void * b )
+{
+  const struct log_record *x = a, *y = b;
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+// Takes every record numbered before the counter as it is now and writes them in order
+void logDrain( )
+{
+  static const char *what[] = { "arrived at", "entering", "leaving" };
+  static char        out[ LOG_BUFFER ];
+
+  uint64_t limit = __atomic_load_n( &event_log.seq, __ATOMIC_SEQ_CST );
+  uint32_t n     = 0;
+
+  for( struct log_ring *ring = __atomic_load_n( &event_log.rings, __ATOMIC_ACQUIRE ); ring; ring = ring->next )
+  {
+    // A thread between taking its number and publishing may be below the limit
+    while( __atomic_load_n( &ring->writing, __ATOMIC_SEQ_CST ) )
+      sched_yield( );
+
+    uint32_t state = __atomic_load_n( &ring->state, __ATOMIC_ACQUIRE );
+    uint32_t tail  = __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+    uint32_t head  = ring->head;
+
+    if( tail - head > event_log.batch_cap - n )
+    {
+      uint64_t cap = event_log.batch_cap ? event_log.batch_cap : LOG_RING_SIZE;
+      while( cap < (uint64_t) n + ( tail - head ) ) cap *= 2;
+      event_log.batch = realloc( event_log.batch, cap * sizeof( struct log_record ) );
+      if( event_log.batch == NULL )
+      {
+        fprintf( stderr, "ERROR: Out of memory for the log.\n");
+        exit( EXIT_FAILURE );
+      }
+      event_log.batch_cap = cap;
+    }
+    for( ; head != tail && ring->records[ head % LOG_RING_SIZE ].seq < limit; head++ )
+      event_log.batch[ n++ ] = ring->records[ head % LOG_RING_SIZE ];
+    __atomic_store_n( &ring->head, head, __ATOMIC_RELEASE );
+
+    if( state == LOG_RING_RETIRED && head == tail )
+      __atomic_store_n( &ring->state, LOG_RING_FREE, __ATOMIC_RELEASE );
+  }
+  if( n == 0 ) return;
+
+  qsort( event_log.batch, n, sizeof( struct log_record ), logRecordCompare );
+
+  size_t len = 0;
+  for( uint32_t i = 0; i < n; i++ )
+  {
+    struct log_record *r = &event_log.batch[ i ];
+    if( LOG_BUFFER - len < 128 )
+    {
+      fwrite( out, 1, len, stdout );
+      len = 0;
+    }
+    len += snprintf( out + len, LOG_BUFFER - len, "Current time: %d MAV %d heading %s %s the intersection\n",
+                     (int) r->time, (int) r->train_id, directionAsString[ r->direction ], what[ r->kind ] );
+  }
+  fwrite( out, 1, len, stdout );
+  fflush( stdout );
+}
+
+void * logDrainer( void * val )
+{
+  (void) val;
+  while( !__atomic_load_n( &event_log.stop, __ATOMIC_ACQUIRE ) )
+  {
+    if( !__atomic_exchange_n( &event_log.wake, 0, __ATOMIC_ACQUIRE ) )
+      futexWaitFor( &event_log.wake, 0, LOG_DRAIN_NS );
+    __atomic_store_n( &event_log.wake, 0, __ATOMIC_RELEASE );
+    logDrain( );
+  }
+  return NULL;
+}
+
+void logStart( )
+{
+  pthread_key_create( &event_log.key, logRetire );
+  event_log.running = 1;
+  pthread_create( &event_log.drainer, NULL, logDrainer, NULL );
+}
+
+void logStop( )
+{
+  if( !event_log.running ) return;
+  event_log.running = 0;
+
+  __atomic_store_n( &event_log.stop, 1, __ATOMIC_RELEASE );
+  __atomic_store_n( &event_log.wake, 1, __ATOMIC_RELEASE );
+  futexWake( &event_log.wake );
+  pthread_join( event_log.drainer, NULL );
+
+  // Whatever was logged while it stopped
+  logDrain( );
+}
+
+#else
+
+#define logStart( )
+#define logStop( )
+#define logEvent( kind, time, train_id, direction )
+
+#endif
+
+#endif
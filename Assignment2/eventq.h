@@ -0,0 +1,156 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef __EVENTQ_H__
+#define __EVENTQ_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ *
+ * The pieces a discrete event simulation of intersections is made of:
+ * a priority queue of timed events and a queue of the trains waiting in
+ * each direction.  sim.h runs one intersection on them, the grid
+ * simulation one per node.
+ *
+ */
+
+struct event
+{
+  uint32_t time;
+  uint32_t kind;
+  uint64_t order;            // breaks ties between events of the same time and kind
+  uint32_t train_id;
+  uint32_t where;            // which intersection, for the grid
+  uint32_t direction;
+  uint32_t max_wait;         // the train's, carried from its schedule entry
+};
+
+// Binary min-heap on (time, kind, order)
+struct event_queue
+{
+  struct event *heap;
+  uint32_t      n;
+  uint32_t      cap;
+  uint32_t      seq;         // order for the next event pushed
+};
+
+// Trains waiting in one direction, oldest first, in a ring
+struct direction_queue
+{
+  uint32_t *ids;
+  uint32_t  head;
+  uint32_t  n;
+  uint32_t  cap;
+};
+
+void     queuePush( struct direction_queue *q, uint32_t train_id );
+uint32_t queuePop ( struct direction_queue *q );
+
+void         eventPush( struct event_queue *q, struct event ev );
+struct event eventPop ( struct event_queue *q );
+
+int eventBefore( struct event *a, struct event *b )
+{
+  if( a->time != b->time ) return a->time < b->time;
+  if( a->kind != b->kind ) return a->kind < b->kind;
+  return a->order < b->order;
+}
+
+void eventPush( struct event_queue *q, struct event ev )
+{
+  if( q->n == q->cap )
+  {
+    q->cap  = q->cap ? q->cap * 2 : 64;
+    q->heap = realloc( q->heap, q->cap * sizeof( struct event ) );
+    if( q->heap == NULL )
+    {
+      fprintf( stderr, "ERROR: Out of memory for the event queue.\n");
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  uint32_t i = q->n++;
+  while( i > 0 && eventBefore( &ev, &q->heap[ ( i - 1 ) / 2 ] ) )
+  {
+    q->heap[ i ] = q->heap[ ( i - 1 ) / 2 ];
+    i = ( i - 1 ) / 2;
+  }
+  q->heap[ i ] = ev;
+}
+
+struct event eventPop( struct event_queue *q )
+{
+  struct event top  = q->heap[ 0 ];
+  struct event last = q->heap[ --q->n ];
+  uint32_t i = 0;
+
+  while( 1 )
+  {
+    uint32_t child = 2 * i + 1;
+    if( child >= q->n ) break;
+    if( child + 1 < q->n && eventBefore( &q->heap[ child + 1 ], &q->heap[ child ] ) )
+      child++;
+    if( !eventBefore( &q->heap[ child ], &last ) ) break;
+    q->heap[ i ] = q->heap[ child ];
+    i = child;
+  }
+  if( q->n > 0 ) q->heap[ i ] = last;
+  return top;
+}
+
+void queuePush( struct direction_queue *q, uint32_t train_id )
+{
+  if( q->n == q->cap )
+  {
+    uint32_t  cap = q->cap ? q->cap * 2 : 16;
+    uint32_t *ids = malloc( cap * sizeof( uint32_t ) );
+    if( ids == NULL )
+    {
+      fprintf( stderr, "ERROR: Out of memory for the waiting trains.\n");
+      exit( EXIT_FAILURE );
+    }
+    // Unwrap the ring into the new array
+    for( uint32_t i = 0; i < q->n; i++ )
+      ids[ i ] = q->ids[ ( q->head + i ) % q->cap ];
+    free( q->ids );
+    q->ids  = ids;
+    q->head = 0;
+    q->cap  = cap;
+  }
+
+  q->ids[ ( q->head + q->n ) % q->cap ] = train_id;
+  q->n++;
+}
+
+uint32_t queuePop( struct direction_queue *q )
+{
+  uint32_t train_id = q->ids[ q->head ];
+  q->head = ( q->head + 1 ) % q->cap;
+  q->n--;
+  return train_id;
+}
+
+#endif
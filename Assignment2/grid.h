@@ -0,0 +1,402 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __GRID_H__
+#define __GRID_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eventq.h"
+#include "policy.h"
+#include "train.h"
+
+/*
+ *
+ * A rail grid of width x height intersections, simulated on a virtual
+ * clock and split across threads.
+ *
+ * Row 0 is the north edge.  A train enters at the edge it comes from,
+ * goes straight through every intersection in its direction and leaves
+ * the grid at the far edge.  Each intersection works the way the single
+ * one in mavon -d does, and the next one is LINK_TIME seconds down the
+ * line.
+ *
+ * Each shard thread owns a band of whole rows, so trains heading east or
+ * west stay in their shard and only north and south ones cross over.
+ * Shards run in lockstep windows of LINK_TIME seconds: nothing sent to
+ * another shard can be due before the next window, so within a window
+ * every shard runs its own events with no further synchronization.
+ * Between windows each shard takes the trains sent to it and the next
+ * window starts at the earliest event anywhere, skipping idle time.
+ *
+ * Ties at one intersection break on the train id, so the results do not
+ * depend on the number of shards.
+ *
+ */
+
+#define LINK_TIME  60
+#define GRID_NEVER UINT32_MAX
+
+enum GRID_EVENT
+{
+  GRID_MEDIATE = 0,
+  GRID_ARRIVE  = 1,
+  GRID_CROSS   = 2,
+  GRID_LEAVE   = 3
+};
+
+struct grid_node
+{
+  struct intersection    x;
+  struct direction_queue waiting[ NUM_DIRECTIONS ];
+  struct direction_queue max_wait[ NUM_DIRECTIONS ];   // of the trains in waiting, in step
+  int                    mediate_pending;
+};
+
+// Trains bound for a neighbouring shard, handed over between windows
+struct grid_outbox
+{
+  struct event *ev;
+  uint32_t      n;
+  uint32_t      cap;
+};
+
+struct grid_shard
+{
+  pthread_t          thread;
+  int                index;
+  uint32_t           first_row;
+  uint32_t           rows;
+  struct event_queue events;
+  struct grid_outbox to_north;    // for the shard before this one
+  struct grid_outbox to_south;    // for the shard after it
+  uint32_t           next_time;   // earliest event after taking in the mail
+  uint64_t           processed;
+  uint64_t           finished;    // trains that left the grid
+  uint64_t           checksum;    // over when and where each train left
+  uint64_t           waited;      // seconds trains spent waiting to cross
+  uint64_t           deadlines_met;
+  uint64_t           deadlines_missed;
+  uint32_t           worst_late;
+};
+
+struct grid
+{
+  uint32_t            width;
+  uint32_t            height;
+  struct grid_node   *nodes;       // row by row
+  struct grid_shard  *shards;
+  int                 nshards;
+  pthread_barrier_t   barrier;
+  uint32_t            window;      // start of the current window
+};
+
+// Sets up the grid and its shards.  Trains are added with gridAddTrain()
+// before gridRun().
+void gridInit    ( struct grid * g, uint32_t width, uint32_t height, int nshards );
+void gridAddTrain( struct grid * g, uint32_t time, uint32_t train_id, enum TRAIN_DIRECTION direction,
+                   uint32_t max_wait );
+void gridRun     ( struct grid * g );
+void gridFree    ( struct grid * g );
+
+struct grid_shard * gridShardOf( struct grid * g, uint32_t row )
+{
+  // Rows are dealt out as evenly as they go, the first shards getting one more
+  uint32_t base  = g->height / g->nshards;
+  uint32_t extra = g->height % g->nshards;
+  uint32_t cut   = extra * ( base + 1 );
+  int      s     = row < cut ? row / ( base + 1 ) : extra + ( row - cut ) / base;
+  return &g->shards[ s ];
+}
+
+void gridInit( struct grid * g, uint32_t width, uint32_t height, int nshards )
+{
+  memset( g, 0, sizeof( struct grid ) );
+  if( nshards > (int) height ) nshards = height;
+  g->width   = width;
+  g->height  = height;
+  g->nshards = nshards;
+  g->nodes   = calloc( (size_t) width * height, sizeof( struct grid_node ) );
+  g->shards  = calloc( nshards, sizeof( struct grid_shard ) );
+  if( g->nodes == NULL || g->shards == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for a %ux%u grid.\n", width, height );
+    exit( EXIT_FAILURE );
+  }
+
+  for( size_t i = 0; i < (size_t) width * height; i++ )
+    intersectionInit( &g->nodes[ i ].x );
+
+  uint32_t row = 0;
+  for( int s = 0; s < nshards; s++ )
+  {
+    g->shards[ s ].index     = s;
+    g->shards[ s ].first_row = row;
+    g->shards[ s ].rows      = height / nshards + ( (uint32_t) s < height % nshards );
+    row += g->shards[ s ].rows;
+  }
+  pthread_barrier_init( &g->barrier, NULL, nshards );
+}
+
+void gridPush( struct grid_shard * shard, uint32_t time, enum GRID_EVENT kind, uint32_t where,
+               uint32_t train_id, uint32_t direction, uint32_t max_wait )
+{
+  struct event ev = { time, kind, ( (uint64_t) where << 32 ) | train_id, train_id, where, direction, max_wait };
+  eventPush( &shard->events, ev );
+}
+
+void gridAddTrain( struct grid * g, uint32_t time, uint32_t train_id, enum TRAIN_DIRECTION direction,
+                   uint32_t max_wait )
+{
+  uint32_t row, col;
+
+  // In at the edge it comes from, on a line picked by its id
+  switch( direction )
+  {
+    case NORTH: row = g->height - 1;        col = train_id % g->width;  break;
+    case SOUTH: row = 0;                    col = train_id % g->width;  break;
+    case EAST:  row = train_id % g->height; col = 0;                    break;
+    case WEST:  row = train_id % g->height; col = g->width - 1;         break;
+    default:    return;
+  }
+  gridPush( gridShardOf( g, row ), time, GRID_ARRIVE, row * g->width + col, train_id, direction, max_wait );
+}
+
+void outboxPush( struct grid_outbox * box, struct event ev )
+{
+  if( box->n == box->cap )
+  {
+    box->cap = box->cap ? box->cap * 2 : 256;
+    box->ev  = realloc( box->ev, box->cap * sizeof( struct event ) );
+    if( box->ev == NULL )
+    {
+      fprintf( stderr, "ERROR: Out of memory for trains between shards.\n");
+      exit( EXIT_FAILURE );
+    }
+  }
+  box->ev[ box->n++ ] = ev;
+}
+
+// The intersection wants mediate() on the next tick
+void gridWantMediate( struct grid_shard * shard, struct grid_node * node, uint32_t time, uint32_t where )
+{
+  if( node->mediate_pending ) return;
+  node->mediate_pending = 1;
+  gridPush( shard, time + 1, GRID_MEDIATE, where, 0, UNKNOWN, 0 );
+}
+
+// Sends a train that just left an intersection on to the next one, or out of the grid
+void gridMove( struct grid * g, struct grid_shard * shard, struct event * ev )
+{
+  uint32_t row = ev->where / g->width;
+  uint32_t col = ev->where % g->width;
+
+  switch( ev->direction )
+  {
+    case NORTH: if( row == 0 )             goto out; row--; break;
+    case SOUTH: if( row == g->height - 1 ) goto out; row++; break;
+    case EAST:  if( col == g->width - 1 )  goto out; col++; break;
+    case WEST:  if( col == 0 )             goto out; col--; break;
+  }
+
+  struct event next = { ev->time + LINK_TIME, GRID_ARRIVE, 0, ev->train_id, row * g->width + col, ev->direction,
+                        ev->max_wait };
+  next.order = ( (uint64_t) next.where << 32 ) | next.train_id;
+
+  if( row < shard->first_row )
+    outboxPush( &shard->to_north, next );
+  else if( row >= shard->first_row + shard->rows )
+    outboxPush( &shard->to_south, next );
+  else
+    eventPush( &shard->events, next );
+  return;
+
+out:
+  shard->finished++;
+  shard->checksum += ( (uint64_t) ev->time * 2654435761u ) ^ ( (uint64_t) ev->train_id << 20 ) ^ ev->where;
+}
+
+void gridEvent( struct grid * g, struct grid_shard * shard, struct event * ev )
+{
+  struct grid_node * node = &g->nodes[ ev->where ];
+
+  switch( ev->kind )
+  {
+    case GRID_MEDIATE:
+    {
+      node->mediate_pending = 0;
+      enum TRAIN_DIRECTION d = mediateChoose( &node->x );
+      if( d != UNKNOWN && node->waiting[ d ].n > 0 )
+      {
+        intersectionGranted( &node->x, d, ev->time );
+        uint32_t train_id = queuePop( &node->waiting[ d ] );
+        gridPush( shard, ev->time, GRID_CROSS, ev->where, train_id, d, queuePop( &node->max_wait[ d ] ) );
+      }
+      break;
+    }
+
+    case GRID_ARRIVE:
+      intersectionArrive( &node->x, ev->direction, ev->max_wait ? ev->time + ev->max_wait : NO_DEADLINE );
+      queuePush( &node->waiting[ ev->direction ], ev->train_id );
+      queuePush( &node->max_wait[ ev->direction ], ev->max_wait );
+      if( node->x.in_intersection == INTERSECTION_EMPTY )
+        gridWantMediate( shard, node, ev->time, ev->where );
+      // How long it waits shows up when it enters; count it from here
+      shard->waited -= ev->time;
+      break;
+
+    case GRID_CROSS:
+      intersectionEnter( &node->x, ev->train_id, ev->direction );
+      shard->waited += ev->time;
+      gridPush( shard, ev->time + CROSSING_TIME - 1, GRID_LEAVE, ev->where, ev->train_id, ev->direction, ev->max_wait );
+      break;
+
+    case GRID_LEAVE:
+      intersectionLeave( &node->x, ev->direction );
+      for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+      {
+        if( node->waiting[ d ].n )
+        {
+          gridWantMediate( shard, node, ev->time, ev->where );
+          break;
+        }
+      }
+      gridMove( g, shard, ev );
+      break;
+  }
+  shard->processed++;
+}
+
+void gridTakeMail( struct grid_shard * shard, struct grid_outbox * box )
+{
+  for( uint32_t i = 0; i < box->n; i++ )
+    eventPush( &shard->events, box->ev[ i ] );
+  box->n = 0;
+}
+
+struct grid_worker
+{
+  struct grid       * g;
+  struct grid_shard * shard;
+};
+
+void * gridWorker( void * val )
+{
+  struct grid_worker * w     = val;
+  struct grid        * g     = w->g;
+  struct grid_shard  * shard = w->shard;
+  int                  s     = shard->index;
+
+  while( 1 )
+  {
+    // Everything due in this window is local to the shard
+    uint32_t end = g->window + LINK_TIME;
+    while( shard->events.n > 0 && shard->events.heap[ 0 ].time < end )
+    {
+      struct event ev = eventPop( &shard->events );
+      gridEvent( g, shard, &ev );
+    }
+    pthread_barrier_wait( &g->barrier );
+
+    // Take in the trains the neighbours sent
+    if( s > 0 )              gridTakeMail( shard, &g->shards[ s - 1 ].to_south );
+    if( s < g->nshards - 1 ) gridTakeMail( shard, &g->shards[ s + 1 ].to_north );
+    shard->next_time = shard->events.n ? shard->events.heap[ 0 ].time : GRID_NEVER;
+    pthread_barrier_wait( &g->barrier );
+
+    // Every shard works out the same next window
+    uint32_t next = GRID_NEVER;
+    for( int i = 0; i < g->nshards; i++ )
+      if( g->shards[ i ].next_time < next ) next = g->shards[ i ].next_time;
+    if( next == GRID_NEVER ) break;
+    if( s == 0 ) g->window = next;
+    pthread_barrier_wait( &g->barrier );
+  }
+
+  for( size_t i = (size_t) shard->first_row * g->width; i < (size_t) ( shard->first_row + shard->rows ) * g->width; i++ )
+  {
+    struct intersection * x = &g->nodes[ i ].x;
+    shard->deadlines_met    += x->deadlines_met;
+    shard->deadlines_missed += x->deadlines_missed;
+    if( x->worst_late > shard->worst_late ) shard->worst_late = x->worst_late;
+  }
+  return NULL;
+}
+
+void gridRun( struct grid * g )
+{
+  struct grid_worker * workers = malloc( g->nshards * sizeof( struct grid_worker ) );
+  if( workers == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for the shard threads.\n");
+    exit( EXIT_FAILURE );
+  }
+
+  // The first window starts at the first train
+  g->window = GRID_NEVER;
+  for( int s = 0; s < g->nshards; s++ )
+    if( g->shards[ s ].events.n && g->shards[ s ].events.heap[ 0 ].time < g->window )
+      g->window = g->shards[ s ].events.heap[ 0 ].time;
+  if( g->window == GRID_NEVER )
+  {
+    free( workers );
+    return;
+  }
+
+  for( int s = 0; s < g->nshards; s++ )
+  {
+    workers[ s ].g     = g;
+    workers[ s ].shard = &g->shards[ s ];
+    pthread_create( &g->shards[ s ].thread, NULL, gridWorker, &workers[ s ] );
+  }
+  for( int s = 0; s < g->nshards; s++ )
+    pthread_join( g->shards[ s ].thread, NULL );
+  free( workers );
+}
+
+void gridFree( struct grid * g )
+{
+  for( size_t i = 0; i < (size_t) g->width * g->height; i++ )
+  {
+    intersectionFree( &g->nodes[ i ].x );
+    for( int d = 0; d < NUM_DIRECTIONS; d++ )
+    {
+      free( g->nodes[ i ].waiting[ d ].ids );
+      free( g->nodes[ i ].max_wait[ d ].ids );
+    }
+  }
+  for( int s = 0; s < g->nshards; s++ )
+  {
+    free( g->shards[ s ].events.heap );
+    free( g->shards[ s ].to_north.ev );
+    free( g->shards[ s ].to_south.ev );
+  }
+  pthread_barrier_destroy( &g->barrier );
+  free( g->nodes );
+  free( g->shards );
+}
+
+#endif
@@ -0,0 +1,177 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/*
+ *
+ * Runs a grid of intersections (grid.h) with 1, 2, 4, ... shard threads
+ * and reports how fast each one goes.
+ *
+ * Build and run:
+ *   gcc -O2 -pthread -o gridsim gridsim.c
+ *   ./gridsim [-g WxH] [-n trains] [-j max shards] [-p policy] [-x percent] [schedule]
+ *
+ * The grid is 64x64 by default.  Without a schedule file, n trains
+ * (100000 by default) arrive at random times over a day from random
+ * directions.  Every run must finish the same trains at the same times,
+ * so the checksum printed for each shard count has to be the same.
+ * -p picks the policy every intersection uses (see policy.h), so runs
+ * with different ones compare them on the same trains.  -x makes that
+ * percentage of the generated trains expresses, which may wait at most
+ * EXPRESS_WAIT seconds at each intersection; try it with -p edf.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "grid.h"
+
+#define EXPRESS_WAIT 30
+
+double nowS( )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main( int argc, char * argv[] )
+{
+  unsigned width = 64, height = 64;
+  long     trains = 100000;
+  int      max_shards = sysconf( _SC_NPROCESSORS_ONLN );
+  int      express = 0;
+  int      opt;
+
+  while( ( opt = getopt( argc, argv, "g:n:j:p:x:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'g':
+        if( sscanf( optarg, "%ux%u", &width, &height ) != 2 || width == 0 || height == 0 )
+        {
+          fprintf( stderr, "ERROR: -g wants WIDTHxHEIGHT, like 64x64.\n");
+          exit( EXIT_FAILURE );
+        }
+        break;
+      case 'n':
+        trains = atol( optarg );
+        break;
+      case 'j':
+        max_shards = atoi( optarg );
+        break;
+      case 'p':
+        if( policySet( optarg ) != 0 )
+        {
+          fprintf( stderr, "ERROR: Unknown policy %s, or not the one this build is fixed to.\n", optarg );
+          exit( EXIT_FAILURE );
+        }
+        break;
+      case 'x':
+        express = atoi( optarg );
+        break;
+      default:
+        fprintf( stderr, "usage: %s [-g WxH] [-n trains] [-j max shards] [-p policy] [-x percent] [schedule]\n",
+                 argv[0] );
+        exit( EXIT_FAILURE );
+    }
+  }
+  if( max_shards < 1 ) max_shards = 1;
+  if( max_shards > (int) height ) max_shards = height;
+
+  if( optind < argc )
+  {
+    buildTrainSchedule( argv[ optind ] );
+  }
+  else
+  {
+    if( trains <= 0 || trains > UINT32_MAX )
+    {
+      fprintf( stderr, "ERROR: trains must be between 1 and %u.\n", UINT32_MAX );
+      exit( EXIT_FAILURE );
+    }
+    scheduleInit( );
+    srand( 1 );
+    for( long i = 0; i < trains; i++ )
+    {
+      ScheduleEntry entry = { rand( ) % SECONDS_IN_A_DAY, i, NORTH + rand( ) % 4, 0 };
+      if( rand( ) % 100 < express ) entry.max_wait = EXPRESS_WAIT;
+      schedulePush( entry );
+    }
+  }
+
+  printf( "%ux%u grid, %u trains, %s policy\n", width, height, schedule_back - schedule_front,
+          policyNames[ mediatePolicy ] );
+  printf( "shards   seconds     events    M events/s   finished   mean wait   checksum\n" );
+
+  uint64_t first_sum = 0;
+  int      same      = 1;
+  for( int shards = 1; ; shards *= 2 )
+  {
+    if( shards > max_shards ) shards = max_shards;
+
+    struct grid g;
+    gridInit( &g, width, height, shards );
+    for( uint32_t i = schedule_front; i < schedule_back; i++ )
+      gridAddTrain( &g, schedule[ i ].arrival_time, schedule[ i ].train_id, schedule[ i ].train_direction,
+                    schedule[ i ].max_wait );
+
+    double start = nowS( );
+    gridRun( &g );
+    double t = nowS( ) - start;
+
+    uint64_t events = 0, finished = 0, sum = 0, waited = 0, met = 0, missed = 0;
+    uint32_t worst = 0;
+    for( int s = 0; s < g.nshards; s++ )
+    {
+      events   += g.shards[ s ].processed;
+      finished += g.shards[ s ].finished;
+      sum      += g.shards[ s ].checksum;
+      waited   += g.shards[ s ].waited;
+      met      += g.shards[ s ].deadlines_met;
+      missed   += g.shards[ s ].deadlines_missed;
+      if( g.shards[ s ].worst_late > worst ) worst = g.shards[ s ].worst_late;
+    }
+    gridFree( &g );
+
+    printf( "%6d %9.3f %10llu %13.2f %10llu %9.1f s   %016llx\n", shards, t, (unsigned long long) events,
+            events / t / 1e6, (unsigned long long) finished, finished ? (double) waited / finished : 0.0,
+            (unsigned long long) sum );
+
+    if( met + missed )
+      printf( "       deadlines: %llu met, %llu missed, worst %u s late\n", (unsigned long long) met,
+              (unsigned long long) missed, worst );
+
+    if( shards == 1 ) first_sum = sum;
+    else if( sum != first_sum ) same = 0;
+    if( shards == max_shards ) break;
+  }
+
+  if( !same )
+  {
+    fprintf( stderr, "ERROR: The runs disagree.\n");
+    return 1;
+  }
+  return 0;
+}
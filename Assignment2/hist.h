@@ -0,0 +1,128 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __HIST_H__
+#define __HIST_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ *
+ * Histograms of times in powers of two nanoseconds: bucket b counts the
+ * times in [2^b, 2^(b+1)) ns, and 0 goes in bucket 0.  Adding a time is
+ * a count of leading zeros and an increment, so the hot paths can afford
+ * one, and percentiles come out to within a factor of two.  pool.h keeps
+ * its dispatch latencies in one, lockprof.h its lock waits and holds,
+ * and simclock.h how late the clock woke.
+ *
+ */
+
+#define HIST_BUCKETS 64
+
+struct hist
+{
+  uint64_t count;
+  uint64_t max_ns;
+  uint64_t buckets[ HIST_BUCKETS ];
+};
+
+static inline void histAdd( struct hist * h, uint64_t ns );
+
+// The time fraction p of those added did not go over
+double histPercentile( const struct hist * h, double p );
+
+// ns in whichever of ns, us, ms and s reads best
+void   histFormat    ( char * out, size_t len, double ns );
+
+// The count and percentiles, then a bar for each bucket in use
+void   histPrint     ( FILE * fp, const char * name, const struct hist * h );
+
+static inline void histAdd( struct hist * h, uint64_t ns )
+{
+  h->count++;
+  h->buckets[ ns ? 63 - __builtin_clzll( ns ) : 0 ]++;
+  if( ns > h->max_ns ) h->max_ns = ns;
+}
+
+double histPercentile( const struct hist * h, double p )
+{
+  uint64_t want = p * h->count;
+  uint64_t seen = 0;
+
+  if( h->count == 0 ) return 0;
+  if( want >= h->count ) want = h->count - 1;
+  for( int b = 0; b < HIST_BUCKETS; b++ )
+  {
+    seen += h->buckets[ b ];
+    if( seen > want )
+    {
+      // Middle of the bucket, but never past the largest seen
+      double mid = 1.5 * ( (uint64_t) 1 << b );
+      return mid < h->max_ns ? mid : h->max_ns;
+    }
+  }
+  return h->max_ns;
+}
+
+void histFormat( char * out, size_t len, double ns )
+{
+  if( ns < 1e3 )      snprintf( out, len, "%.0f ns", ns );
+  else if( ns < 1e6 ) snprintf( out, len, "%.1f us", ns / 1e3 );
+  else if( ns < 1e9 ) snprintf( out, len, "%.1f ms", ns / 1e6 );
+  else                snprintf( out, len, "%.2f s", ns / 1e9 );
+}
+
+void histPrint( FILE * fp, const char * name, const struct hist * h )
+{
+  char p50[ 16 ], p99[ 16 ], max[ 16 ], low[ 16 ], high[ 16 ];
+  int  first = HIST_BUCKETS, last = -1;
+  uint64_t most = 0;
+
+  if( h->count == 0 ) return;
+  for( int b = 0; b < HIST_BUCKETS; b++ )
+  {
+    if( h->buckets[ b ] == 0 ) continue;
+    if( b < first ) first = b;
+    last = b;
+    if( h->buckets[ b ] > most ) most = h->buckets[ b ];
+  }
+
+  histFormat( p50, sizeof( p50 ), histPercentile( h, 0.5 ) );
+  histFormat( p99, sizeof( p99 ), histPercentile( h, 0.99 ) );
+  histFormat( max, sizeof( max ), h->max_ns );
+  fprintf( fp, "  %s: %llu, p50 %s, p99 %s, max %s\n", name, (unsigned long long) h->count, p50, p99, max );
+
+  for( int b = first; b <= last; b++ )
+  {
+    char bar[ 41 ];
+    int  width = (int) ( 40 * h->buckets[ b ] / most );
+    if( h->buckets[ b ] && width == 0 ) width = 1;
+    for( int i = 0; i < width; i++ ) bar[ i ] = '#';
+    bar[ width ] = '\0';
+
+    histFormat( low, sizeof( low ), (double) ( (uint64_t) 1 << b ) );
+    histFormat( high, sizeof( high ), (double) ( (uint64_t) 1 << b ) * 2 );
+    fprintf( fp, "    %9s - %-9s %10llu %s\n", low, high, (unsigned long long) h->buckets[ b ], bar );
+  }
+}
+
+#endif
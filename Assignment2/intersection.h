@@ -0,0 +1,229 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __INTERSECTION_H__
+#define __INTERSECTION_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "train.h"
+
+/*
+ *
+ * The state of one intersection.  mavon has one of these; the grid
+ * simulation has one per node.  Which direction goes next is up to the
+ * policies in policy.h.
+ *
+ */
+
+#define CROSSING_TIME    10   // seconds a train holds the intersection
+#define STARVATION_LIMIT 5    // trains in a row before rules lets the next direction go
+#define NO_DEADLINE      UINT32_MAX
+#define POLICY_DEFAULT   -1   // whatever mediatePolicy is
+
+struct arrival
+{
+  uint32_t seq;        // arrival stamp, or for the urgent queue a position in the ring
+  uint32_t deadline;   // time it must be let in by, or NO_DEADLINE
+};
+
+// The trains waiting in one direction, oldest first.  Only the thread
+// trains arrive on writes or reads the arrays; the train entering just
+// moves head on, so it never touches them.
+struct arrival_ring
+{
+  struct arrival *trains;
+  uint32_t        head;     // advanced by intersectionEnter()
+  uint32_t        tail;
+  uint32_t        cap;
+
+  // Trains with a deadline that no train behind them beats, so the
+  // first still waiting has the earliest deadline in the direction
+  struct arrival *urgent;
+  uint32_t        urgent_first;
+  uint32_t        urgent_last;
+  uint32_t        urgent_cap;
+};
+
+struct intersection
+{
+  uint32_t            in_intersection;                 // train crossing, or INTERSECTION_EMPTY
+  int                 trainCount[ NUM_DIRECTIONS ];    // trains arrived and not yet left, per direction
+  int                 consecCount[ NUM_DIRECTIONS ];   // trains in a row from each direction
+  uint32_t            arrivals;                        // stamp for the next train to arrive
+  struct arrival_ring waiting[ NUM_DIRECTIONS ];
+
+  // How policy.h picks who goes next here, so runs side by side can differ
+  int                 policy;                          // a MEDIATE_POLICY or POLICY_DEFAULT
+  int                 starvation_limit;
+
+  // Trains with a deadline let in on time or late, and the latest one
+  uint64_t            deadlines_met;
+  uint64_t            deadlines_missed;
+  uint32_t            worst_late;
+};
+
+void intersectionInit( struct intersection * x );
+void intersectionFree( struct intersection * x );
+
+// Bookkeeping for a train arriving, entering and leaving.  Arrivals and
+// leaves may happen on different threads, so their counts are atomic.
+void intersectionArrive( struct intersection * x, enum TRAIN_DIRECTION train_direction, uint32_t deadline );
+void intersectionEnter ( struct intersection * x, uint32_t train_id, enum TRAIN_DIRECTION train_direction );
+void intersectionLeave ( struct intersection * x, enum TRAIN_DIRECTION train_direction );
+
+// The rest are called on the thread trains arrive on.
+//
+// The arrival stamp of the oldest train waiting in a direction, or
+// UINT32_MAX if there is none, and the earliest deadline of any train
+// waiting there.
+uint32_t intersectionOldest  ( struct intersection * x, enum TRAIN_DIRECTION train_direction );
+uint32_t intersectionEarliest( struct intersection * x, enum TRAIN_DIRECTION train_direction );
+
+// Counts the deadline of the train a direction is being granted to as met or missed
+void intersectionGranted( struct intersection * x, enum TRAIN_DIRECTION train_direction, uint32_t now );
+
+void intersectionInit( struct intersection * x )
+{
+  memset( x, 0, sizeof( struct intersection ) );
+  x->in_intersection  = INTERSECTION_EMPTY;
+  x->policy           = POLICY_DEFAULT;
+  x->starvation_limit = STARVATION_LIMIT;
+}
+
+void intersectionFree( struct intersection * x )
+{
+  for( int d = 0; d < NUM_DIRECTIONS; d++ )
+  {
+    free( x->waiting[ d ].trains );
+    free( x->waiting[ d ].urgent );
+  }
+}
+
+// Doubles a ring of arrivals, keeping entries first to last where they are
+struct arrival * arrivalsGrow( struct arrival * ring, uint32_t * cap, uint32_t first, uint32_t last )
+{
+  uint32_t        grown = *cap ? *cap * 2 : 16;
+  struct arrival *a     = malloc( grown * sizeof( struct arrival ) );
+  if( a == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for the waiting trains.\n");
+    exit( EXIT_FAILURE );
+  }
+  for( uint32_t i = first; i != last; i++ )
+    a[ i % grown ] = ring[ i % *cap ];
+  free( ring );
+  *cap = grown;
+  return a;
+}
+
+// Forgets the urgent trains that have gone through
+void urgentPrune( struct arrival_ring * r, uint32_t head )
+{
+  while( r->urgent_first != r->urgent_last &&
+         (int32_t) ( r->urgent[ r->urgent_first % r->urgent_cap ].seq - head ) < 0 )
+    r->urgent_first++;
+}
+
+void intersectionArrive( struct intersection * x, enum TRAIN_DIRECTION train_direction, uint32_t deadline )
+{
+  struct arrival_ring *r = &x->waiting[ train_direction ];
+  uint32_t head = __atomic_load_n( &r->head, __ATOMIC_ACQUIRE );
+
+  // head may move on while this copies; the entries it skips are simply not read
+  if( r->tail - head == r->cap )
+    r->trains = arrivalsGrow( r->trains, &r->cap, head, r->tail );
+  r->trains[ r->tail % r->cap ] = (struct arrival) { x->arrivals++, deadline };
+
+  if( deadline != NO_DEADLINE )
+  {
+    urgentPrune( r, head );
+
+    // Anyone behind in the urgent queue with a later deadline will never be the earliest
+    while( r->urgent_last != r->urgent_first &&
+           r->urgent[ ( r->urgent_last - 1 ) % r->urgent_cap ].deadline >= deadline )
+      r->urgent_last--;
+    if( r->urgent_last - r->urgent_first == r->urgent_cap )
+      r->urgent = arrivalsGrow( r->urgent, &r->urgent_cap, r->urgent_first, r->urgent_last );
+    r->urgent[ r->urgent_last++ % r->urgent_cap ] = (struct arrival) { r->tail, deadline };
+  }
+  __atomic_store_n( &r->tail, r->tail + 1, __ATOMIC_RELEASE );
+
+  __atomic_add_fetch( &x->trainCount[ train_direction ], 1, __ATOMIC_RELAXED );
+}
+
+void intersectionEnter( struct intersection * x, uint32_t train_id, enum TRAIN_DIRECTION train_direction )
+{
+  x->in_intersection = train_id;
+  __atomic_add_fetch( &x->waiting[ train_direction ].head, 1, __ATOMIC_RELEASE );
+
+  // Counting the number of consecutive trains in a row, for the starvation check.
+  for( enum TRAIN_DIRECTION d = NORTH; d < NUM_DIRECTIONS; d++ )
+    x->consecCount[ d ] = d == train_direction ? x->consecCount[ d ] + 1 : 0;
+}
+
+void intersectionLeave( struct intersection * x, enum TRAIN_DIRECTION train_direction )
+{
+  x->in_intersection = INTERSECTION_EMPTY;
+  __atomic_sub_fetch( &x->trainCount[ train_direction ], 1, __ATOMIC_RELAXED );
+}
+
+uint32_t intersectionOldest( struct intersection * x, enum TRAIN_DIRECTION train_direction )
+{
+  struct arrival_ring *r = &x->waiting[ train_direction ];
+  uint32_t head = __atomic_load_n( &r->head, __ATOMIC_ACQUIRE );
+
+  return head == r->tail ? UINT32_MAX : r->trains[ head % r->cap ].seq;
+}
+
+uint32_t intersectionEarliest( struct intersection * x, enum TRAIN_DIRECTION train_direction )
+{
+  struct arrival_ring *r = &x->waiting[ train_direction ];
+  urgentPrune( r, __atomic_load_n( &r->head, __ATOMIC_ACQUIRE ) );
+  return r->urgent_first == r->urgent_last ? NO_DEADLINE : r->urgent[ r->urgent_first % r->urgent_cap ].deadline;
+}
+
+void intersectionGranted( struct intersection * x, enum TRAIN_DIRECTION train_direction, uint32_t now )
+{
+  struct arrival_ring *r = &x->waiting[ train_direction ];
+  uint32_t head = __atomic_load_n( &r->head, __ATOMIC_ACQUIRE );
+
+  if( head == r->tail ) return;
+
+  uint32_t deadline = r->trains[ head % r->cap ].deadline;
+  if( deadline == NO_DEADLINE ) return;
+
+  if( now <= deadline )
+  {
+    x->deadlines_met++;
+  }
+  else
+  {
+    x->deadlines_missed++;
+    if( now - deadline > x->worst_late ) x->worst_late = now - deadline;
+  }
+}
+
+#endif
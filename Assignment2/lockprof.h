@@ -0,0 +1,231 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __LOCKPROF_H__
+#define __LOCKPROF_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "hist.h"
+
+/*
+ *
+ * Profiled mutexes and condition variables.
+ *
+ * A prof_mutex is a pthread mutex that, while lock_profile is set, times
+ * how long each lock call waited and how long the lock was then held,
+ * and counts the calls that found it taken.  A prof_cond counts waits
+ * and signals, the signals that came when nobody was waiting (lost) and
+ * the waits that returned with no signal to account for them (spurious).
+ * Waits and holds go in the histograms of hist.h.
+ *
+ * The wait and hold times of a mutex are only written by the thread
+ * holding it, so they need no atomics of their own.
+ *
+ * The lost and spurious counts are exact only when the signaller holds
+ * the mutex the waiters use.  grant() in mavon -t signals without it, so
+ * a signal can land between a thread counting itself as a waiter and its
+ * pthread_cond_wait; that signal wakes nobody yet is counted as pending,
+ * and the next wait to return takes it instead of counting as spurious.
+ * Read the -t counts as how often the signal raced a train thread on its
+ * way into the wait, not as exact figures.
+ *
+ * With lock_profile clear each call costs one well predicted branch on
+ * top of the pthread call.  Building with -DLOCK_PROFILE=0 leaves just
+ * the pthread calls.
+ *
+ */
+
+#ifndef LOCK_PROFILE
+#define LOCK_PROFILE 1
+#endif
+
+#define PROF_MAX 16   // mutexes and condition variables profiled
+
+struct prof_mutex
+{
+  pthread_mutex_t  m;
+#if LOCK_PROFILE > 0
+  const char      *name;
+  uint64_t         acquired_ns;   // when the holder got it
+  uint64_t         acquired;      // by lock calls and by waits returning
+  uint64_t         contended;     // lock calls that found it taken
+  struct hist      wait;
+  struct hist      hold;
+#endif
+};
+
+struct prof_cond
+{
+  pthread_cond_t   c;
+#if LOCK_PROFILE > 0
+  const char      *name;
+  uint32_t         waiters;
+  uint32_t         pending;       // signals sent to waiters that have not woken yet
+  uint64_t         waits;
+  uint64_t         signals;
+  uint64_t         lost;
+  uint64_t         spurious;
+#endif
+};
+
+void profMutexInit( struct prof_mutex * p, const char * name );
+void profCondInit ( struct prof_cond * c, const char * name );
+
+// Everything profiled so far
+void profReport   ( FILE * fp );
+
+#if LOCK_PROFILE > 0
+
+int lock_profile = 0;   // mavon -l
+
+struct prof_mutex *prof_mutexes[ PROF_MAX ];
+struct prof_cond  *prof_conds[ PROF_MAX ];
+int                prof_nmutexes;
+int                prof_nconds;
+
+static inline uint64_t profNow( )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void profMutexInit( struct prof_mutex * p, const char * name )
+{
+  pthread_mutex_init( &p->m, NULL );
+  p->name = name;
+  if( prof_nmutexes < PROF_MAX ) prof_mutexes[ prof_nmutexes++ ] = p;
+}
+
+void profCondInit( struct prof_cond * c, const char * name )
+{
+  pthread_cond_init( &c->c, NULL );
+  c->name = name;
+  if( prof_nconds < PROF_MAX ) prof_conds[ prof_nconds++ ] = c;
+}
+
+static inline void profLock( struct prof_mutex * p )
+{
+  if( __builtin_expect( !lock_profile, 1 ) )
+  {
+    pthread_mutex_lock( &p->m );
+    return;
+  }
+
+  uint64_t start = profNow( );
+  int      taken = pthread_mutex_trylock( &p->m ) != 0;
+  if( taken ) pthread_mutex_lock( &p->m );
+
+  p->acquired_ns = profNow( );
+  p->acquired++;
+  p->contended  += taken;
+  histAdd( &p->wait, p->acquired_ns - start );
+}
+
+static inline void profUnlock( struct prof_mutex * p )
+{
+  if( __builtin_expect( lock_profile, 0 ) )
+    histAdd( &p->hold, profNow( ) - p->acquired_ns );
+  pthread_mutex_unlock( &p->m );
+}
+
+// Returns holding p; the hold starts as it wakes
+static inline void profWait( struct prof_cond * c, struct prof_mutex * p )
+{
+  if( __builtin_expect( !lock_profile, 1 ) )
+  {
+    pthread_cond_wait( &c->c, &p->m );
+    return;
+  }
+
+  __atomic_add_fetch( &c->waits, 1, __ATOMIC_RELAXED );
+  __atomic_add_fetch( &c->waiters, 1, __ATOMIC_SEQ_CST );
+  pthread_cond_wait( &c->c, &p->m );
+  p->acquired_ns = profNow( );
+  p->acquired++;
+
+  // Take a signal before leaving, so a signaller never sees more signals than waiters
+  uint32_t pending = __atomic_load_n( &c->pending, __ATOMIC_SEQ_CST );
+  while( pending && !__atomic_compare_exchange_n( &c->pending, &pending, pending - 1, 1,
+                                                  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) );
+  if( pending == 0 ) __atomic_add_fetch( &c->spurious, 1, __ATOMIC_RELAXED );
+  __atomic_sub_fetch( &c->waiters, 1, __ATOMIC_SEQ_CST );
+}
+
+static inline void profSignal( struct prof_cond * c )
+{
+  if( __builtin_expect( lock_profile, 0 ) )
+  {
+    // Every waiter already has a signal coming, so this one wakes nobody
+    __atomic_add_fetch( &c->signals, 1, __ATOMIC_RELAXED );
+    if( __atomic_load_n( &c->waiters, __ATOMIC_SEQ_CST ) <= __atomic_load_n( &c->pending, __ATOMIC_SEQ_CST ) )
+      __atomic_add_fetch( &c->lost, 1, __ATOMIC_RELAXED );
+    else
+      __atomic_add_fetch( &c->pending, 1, __ATOMIC_SEQ_CST );
+  }
+  pthread_cond_signal( &c->c );
+}
+
+void profReport( FILE * fp )
+{
+  for( int i = 0; i < prof_nmutexes; i++ )
+  {
+    struct prof_mutex *p = prof_mutexes[ i ];
+    if( p->acquired == 0 ) continue;
+
+    fprintf( fp, "lock %s: %llu acquired, %llu contended (%.1f%% of lock calls)\n", p->name,
+             (unsigned long long) p->acquired, (unsigned long long) p->contended,
+             p->wait.count ? 100.0 * p->contended / p->wait.count : 0.0 );
+    histPrint( fp, "wait", &p->wait );
+    histPrint( fp, "hold", &p->hold );
+  }
+
+  for( int i = 0; i < prof_nconds; i++ )
+  {
+    struct prof_cond *c = prof_conds[ i ];
+    if( c->waits + c->signals == 0 ) continue;
+
+    fprintf( fp, "cond %s: %llu waits, %llu signals, %llu lost, %llu spurious\n", c->name,
+             (unsigned long long) c->waits, (unsigned long long) c->signals,
+             (unsigned long long) c->lost, (unsigned long long) c->spurious );
+  }
+}
+
+#else
+
+#define lock_profile 0
+
+#define profMutexInit( mx, name ) pthread_mutex_init( &( mx )->m, NULL )
+#define profCondInit( cv, name )  pthread_cond_init( &( cv )->c, NULL )
+#define profLock( mx )            pthread_mutex_lock( &( mx )->m )
+#define profUnlock( mx )          pthread_mutex_unlock( &( mx )->m )
+#define profWait( cv, mx )        pthread_cond_wait( &( cv )->c, &( mx )->m )
+#define profSignal( cv )          pthread_cond_signal( &( cv )->c )
+#define profReport( fp )
+
+#endif
+
+#endif
@@ -27,244 +27,245 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "lockprof.h"
+#include "policy.h"
+#include "simclock.h"
+#include "stream.h"
 #include "train.h"
 
-void trainArrives( uint32_t train_id, enum TRAIN_DIRECTION train_direction );
-void trainCross  ( uint32_t train_id, enum TRAIN_DIRECTION train_direction );
-void trainLeaves ( uint32_t train_id, enum TRAIN_DIRECTION train_direction );
+void trainArrives( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t max_wait );
+void trainCross  ( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t arrival );
+void trainLeaves ( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t arrival );
 
 // Current time of day in seconds since midnight
 int32_t  current_time;
-uint32_t clock_tick;
+double   clock_tick;   // simulated seconds per real second
 
-// Current train in the intersection
-uint32_t in_intersection;
+// Trains that have arrived so far, which numbers each one for the metrics
+uint32_t arrivals;
+
+// The intersection: the train in it and the counts mediate() works from
+struct intersection crossing;
 
 int isIntersectionEmpty(){
-  return in_intersection == INTERSECTION_EMPTY;
+  return crossing.in_intersection == INTERSECTION_EMPTY;
 }
 
 struct train_struct{
   int id;
   int direction;
+  uint32_t arrival;
 };
 
-#define DIRECTION 5
-int trainCount[DIRECTION];
-
-int consecCount[DIRECTION];
-
 struct train_struct *ts;
 
-pthread_cond_t north_cond;
-pthread_cond_t south_cond;
-pthread_cond_t east_cond;
-pthread_cond_t west_cond;
+// Profiled with -l, see lockprof.h
+struct prof_cond north_cond;
+struct prof_cond south_cond;
+struct prof_cond east_cond;
+struct prof_cond west_cond;
+
+struct prof_mutex north_mutex;
+struct prof_mutex south_mutex;
+struct prof_mutex east_mutex;
+struct prof_mutex west_mutex;
 
-pthread_mutex_t north_mutex;
-pthread_mutex_t south_mutex;
-pthread_mutex_t east_mutex;
-pthread_mutex_t west_mutex;
+struct prof_mutex intersection_mutex;
 
-pthread_mutex_t intersection_mutex;
+#include "des.h"
+#include "pool.h"
+#include "metrics.h"
+#include "eventlog.h"
 
 void * trainLogic( void * val )
 {
   struct train_struct *ts = val;
   int id = ts->id;
   int direction = ts->direction;
+  uint32_t arrival = ts->arrival;
 
-  // Swich to set cond_wait for the direction of the thread.
+  // Swich to set cond_wait for the direction of the thread. The wait needs the
+  // direction mutex held, and it is held again once the wait returns.
   switch(direction){
     case 1:
-      pthread_cond_wait(&north_cond,&north_mutex);
+      profLock(&north_mutex);
+      profWait(&north_cond,&north_mutex);
       break;
     case 2:
-      pthread_cond_wait(&east_cond,&east_mutex);
+      profLock(&east_mutex);
+      profWait(&east_cond,&east_mutex);
       break;
     case 3:
-      pthread_cond_wait(&south_cond,&south_mutex);
+      profLock(&south_mutex);
+      profWait(&south_cond,&south_mutex);
       break;
     case 4:
-      pthread_cond_wait(&west_cond,&west_mutex);
+      profLock(&west_mutex);
+      profWait(&west_cond,&west_mutex);
       break;
   }
 
   // Intersection lock so that no other string crosses at the same time.
-  pthread_mutex_lock( &intersection_mutex );
+  profLock( &intersection_mutex );
   // Unlock the direction mutex.
   switch(direction){
     case 1:
-      pthread_mutex_unlock(&north_mutex);
+      profUnlock(&north_mutex);
       break;
     case 2:
-      pthread_mutex_unlock(&east_mutex);
+      profUnlock(&east_mutex);
       break;
     case 3:
-      pthread_mutex_unlock(&south_mutex);
+      profUnlock(&south_mutex);
       break;
     case 4:
-      pthread_mutex_unlock(&west_mutex);
+      profUnlock(&west_mutex);
       break;
   }
-  trainCross(id,direction);
-  pthread_mutex_unlock( &intersection_mutex );
+  dispatchRecord( pool.grant_ns[direction] );
+  trainCross(id,direction,arrival);
+  profUnlock( &intersection_mutex );
 
   free (ts);
+  threadsAdd(-1);
+  return NULL;
 }
 
-void trainLeaves( uint32_t train_id, enum TRAIN_DIRECTION train_direction )
+void trainLeaves( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t arrival )
 {
-  fprintf( stdout, "Current time: %d MAV %d heading %s leaving the intersection\n",
-           current_time, train_id, directionAsString[ train_direction ] );
+  logEvent( LOG_LEAVE, current_time, train_id, train_direction );
+  metricsRecord( METRIC_LEAVE, current_time, arrival, train_id, train_direction );
 
-  in_intersection = INTERSECTION_EMPTY;
-
-  // Reduce this value as train has exited.
-  trainCount[train_direction]--;
+  // Empty it, and reduce the count as the train has exited.
+  intersectionLeave(&crossing, train_direction);
 
   // TODO: Handle any cleanup 
 }
 
-void trainCross( uint32_t train_id, enum TRAIN_DIRECTION train_direction )
+void trainEnters( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t arrival )
 {
-  // TODO: Handle any crossing logic
-
-  fprintf( stdout, "Current time: %d MAV %d heading %s entering the intersection\n",
-           current_time, train_id, directionAsString[ train_direction ] );
+  logEvent( LOG_ENTER, current_time, train_id, train_direction );
+  metricsRecord( METRIC_ENTER, current_time, arrival, train_id, train_direction );
 
-  if( in_intersection == INTERSECTION_EMPTY )
-  {
-    in_intersection = train_id;
-  }
-  else
+  if( crossing.in_intersection != INTERSECTION_EMPTY )
   {
+    logStop( );
     fprintf( stderr, "CRASH: Train %d collided with train %d\n",
-                      train_id, in_intersection );
+                      train_id, crossing.in_intersection );
     exit( EXIT_FAILURE );
   }
 
-  // This switch statement is counting the number of consecutive Trains in a row.
-  // These values are later used to check for starvation case.
-  switch(train_direction){
-    case 1:
-      consecCount[1]++;
-      consecCount[2]=0;
-      consecCount[3]=0;
-      consecCount[4]=0;
-      break;
-    case 2:
-      consecCount[1]=0;
-      consecCount[2]++;
-      consecCount[3]=0;
-      consecCount[4]=0;
-      break;
-    case 3:
-      consecCount[1]=0;
-      consecCount[2]=0;
-      consecCount[3]++;
-      consecCount[4]=0;
-      break;
-    case 4:
-      consecCount[1]=0;
-      consecCount[2]=0;
-      consecCount[3]=0;
-      consecCount[4]++;
-      break;
-  }
+  // Takes the intersection and counts the consecutive trains for the starvation check.
+  intersectionEnter(&crossing, train_id, train_direction);
+}
 
+void trainCross( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t arrival )
+{
+  // TODO: Handle any crossing logic
+
+  int32_t entered = current_time;
+  trainEnters( train_id, train_direction, arrival );
 
-  // Sleep for 10 microseconds to simulate crossing
-  // the intersection
-  usleep( 10 * 1000000 / clock_tick );
+  // Cross for CROSSING_TIME simulated seconds, leaving halfway through
+  // the last one so the intersection is clear by the next tick, as in -d
+  clockSleepUntil( &sim_clock, entered + CROSSING_TIME - 0.5 );
 
 // Leave the intersection
-  trainLeaves( train_id, train_direction );
+  trainLeaves( train_id, train_direction, arrival );
 
   return;
 }
 
-void trainArrives( uint32_t train_id, enum TRAIN_DIRECTION train_direction )
+void trainArrives( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t max_wait )
 {
-  fprintf( stdout, "Current time: %d MAV %d heading %s arrived at the intersection\n",
-           current_time, train_id, directionAsString[ train_direction ] );
+  uint32_t arrival = arrivals++;
+
+  logEvent( LOG_ARRIVE, current_time, train_id, train_direction );
+
+  metricsRecord( METRIC_ARRIVE, current_time, arrival, train_id, train_direction );
 
   // This keeps tracks of number of trains scheduled.
-  trainCount[train_direction]++;
+  intersectionArrive(&crossing, train_direction, max_wait ? current_time + max_wait : NO_DEADLINE);
+
+  // It waits on its direction's run queue for a pool worker.
+  if(!thread_per_train){
+    poolArrive(train_id, train_direction, arrival);
+    return;
+  }
+
   pthread_t tid;
   ts = (struct train_struct*) malloc( sizeof( struct train_struct ) );
   ts->id = train_id;
   ts->direction = train_direction;
+  ts->arrival = arrival;
   // Pthread Created and it is passed trainLogic and trainstruct.
+  threadsAdd(1);
   pthread_create(&tid, NULL,trainLogic,(void *)ts);
+  pthread_detach(tid);
 
   // TODO: Handle the intersection logic
 
   return;
 }
 
-void mediate( )
+// Lets one train heading in direction cross: the oldest one waiting goes to a
+// pool worker. With -t it wakes one of the direction's threads, without taking
+// the direction mutex, so -l's lost and spurious counts are only approximate.
+void grant( enum TRAIN_DIRECTION direction )
 {
-  if(in_intersection != INTERSECTION_EMPTY){
+  if(!thread_per_train){
+    poolGrant(direction);
     return;
   }
 
-  // This takes care of starvation cases.
-  if(consecCount[1]==5 & trainCount[2]!=0){
-    consecCount[1]=0;
-    pthread_cond_signal(&east_cond);
-    return;
+  pool.grant_ns[direction] = nowNs();
+  switch(direction){
+    case NORTH:
+      profSignal(&north_cond);
+      break;
+    case EAST:
+      profSignal(&east_cond);
+      break;
+    case SOUTH:
+      profSignal(&south_cond);
+      break;
+    case WEST:
+      profSignal(&west_cond);
+      break;
+    default:
+      break;
   }
+}
 
-  if(consecCount[2]==5 & trainCount[3]!=0){
-    consecCount[2]=0;
-    pthread_cond_signal(&south_cond);
-    return;
-  }
+// In discrete event mode des keeps its own intersection; this just prints and records.
+void desTrace( struct sim * s, enum SIM_EVENT kind, uint32_t entry )
+{
+  const ScheduleEntry *e = &s->schedule[ entry ];
 
-  if(consecCount[3]==5 & trainCount[4]!=0){
-    consecCount[3]=0;
-    pthread_cond_signal(&west_cond);
-    return;
+  if( kind == SIM_ENTER && s->crossing.in_intersection != INTERSECTION_EMPTY )
+  {
+    logStop( );
+    fprintf( stderr, "CRASH: Train %d collided with train %d\n",
+                      e->train_id, s->crossing.in_intersection );
+    exit( EXIT_FAILURE );
   }
 
-  if(consecCount[4]==5 & trainCount[1]!=0){
-    consecCount[4]=0;
-    pthread_cond_signal(&north_cond);
-    return;
-  }
+  logEvent( (enum LOG_KIND) kind, s->current_time, e->train_id, e->train_direction );
+  metricsRecord( (enum METRIC_KIND) kind, s->current_time, entry, e->train_id, e->train_direction );
+}
 
-  // Checks for N-S and E-W cases.
-  if(trainCount[NORTH]!=0 && trainCount[SOUTH]!=0 && trainCount[EAST]==0 && trainCount[WEST]==0){
-    pthread_cond_signal(&north_cond);
-    return;
-  }
-  if(trainCount[NORTH]==0 && trainCount[SOUTH]==0 && trainCount[EAST]!=0 && trainCount[WEST]!=0){
-    pthread_cond_signal(&east_cond);
-    return;
-                                                                                                                             245,3         58%
-  // Check for 4-way intersection.
-  if(trainCount[NORTH]!=0 && trainCount[SOUTH]!=0 && trainCount[EAST]!=0 && trainCount[WEST]!=0){
-    pthread_cond_signal(&north_cond);
+void mediate( )
+{
+  // A pool train that was granted but has not entered yet already has it.
+  if(!thread_per_train && poolBusy()){
     return;
   }
 
-  // Right of way conditions.
-  if(trainCount[NORTH]!=0 && trainCount[WEST]==0){
-    pthread_cond_signal(&north_cond);
-    return;
-  }
-  if(trainCount[WEST]!=0 && trainCount[SOUTH]==0){
-    pthread_cond_signal(&west_cond);
-    return;
-  }
-  if(trainCount[SOUTH]!=0 && trainCount[EAST]==0){
-    pthread_cond_signal(&south_cond);
-    return;
-  }
-  if(trainCount[EAST]!=0 && trainCount[NORTH]==0){
-    pthread_cond_signal(&east_cond);
-    return;
+  // The policies are in policy.h, shared with the grid simulation.
+  enum TRAIN_DIRECTION direction = mediateChoose(&crossing);
+  if(direction != UNKNOWN){
+    intersectionGranted(&crossing, direction, current_time);
+    grant(direction);
   }
 }
 
@@ -272,22 +273,29 @@ void init( )
 {
   // TODO: Any code you need called in the initialization of the application
   // init for scheduled train Count and consecutive train count.
-  for(int i =0; i<5 ;i++){
-    trainCount[i]=0;
-    consecCount[i]=0;
-  }
+  intersectionInit(&crossing);
 
   // Initialize conds and mutex for directions.
-  pthread_cond_init(&north_cond,NULL);
-  pthread_cond_init(&south_cond,NULL);
-  pthread_cond_init(&east_cond,NULL);
-  pthread_cond_init(&west_cond,NULL);
-
-  pthread_mutex_init(&north_mutex,NULL);
-  pthread_mutex_init(&south_mutex,NULL);
-  pthread_mutex_init(&east_mutex,NULL);
-  pthread_mutex_init(&west_mutex, NULL);
-
+  profCondInit(&north_cond,"north_cond");
+  profCondInit(&south_cond,"south_cond");
+  profCondInit(&east_cond,"east_cond");
+  profCondInit(&west_cond,"west_cond");
+
+  profMutexInit(&north_mutex,"north_mutex");
+  profMutexInit(&south_mutex,"south_mutex");
+  profMutexInit(&east_mutex,"east_mutex");
+  profMutexInit(&west_mutex,"west_mutex");
+  profMutexInit(&intersection_mutex,"intersection_mutex");
+
+  // The main thread, the log drainer, then the workers that take trains across.
+  threadsAdd(1);
+  logStart();
+#if LOG_LEVEL > 0
+  threadsAdd(1);
+#endif
+  if(!virtual_time && !thread_per_train){
+    poolInit();
+  }
 }
 
 /*
@@ -301,13 +309,23 @@ void init( )
 
 int process( )
 {
-  // If there are no more scheduled train arrivals
-  // then return and exit
-  if( scheduleEmpty() ) return 0;
+  // A streamed schedule takes in whatever has come in, and runs
+  // day after day until its source closes
+  if( streaming )
+  {
+    streamFill( &stream );
+    if( streamEnded( &stream ) ) return 0;
+  }
+  else
+  {
+    // If there are no more scheduled train arrivals
+    // then return and exit
+    if( scheduleEmpty() ) return 0;
 
-  // If we're done with a day's worth of schedule then
-  // we're done.
-  if( current_time > SECONDS_IN_A_DAY ) return 0;
+    // If we're done with a day's worth of schedule then
+    // we're done.
+    if( current_time > SECONDS_IN_A_DAY ) return 0;
+  }
 
   // Check for deadlocks
   mediate( );
@@ -318,22 +336,21 @@ int process( )
   {
 
 #ifdef DEBUG
-                                                                                                                             285,3         81%
     fprintf( stdout, "Dispatching schedule event: time: %d train: %d direction: %s\n",
                       scheduleFront().arrival_time, scheduleFront().train_id,
                       directionAsString[ scheduleFront().train_direction ] );
 #endif
 
-    trainArrives( scheduleFront().train_id, scheduleFront().train_direction );
+    trainArrives( scheduleFront().train_id, scheduleFront().train_direction, scheduleFront().max_wait );
 
     // Remove the event from the schedule since it's done
     schedulePop( );
 
   }
 
-  // Sleep for a simulated second. Depending on clock_tick this
-  // may equate to 1 real world second down to 1 microsecond
-  usleep( 1 * 1000000 / clock_tick );
+  // Sleep until the next simulated second. Depending on clock_tick this
+  // may equate to 1 real world second down to well under 1 microsecond
+  clockTick( &sim_clock, current_time + 1 );
 
   current_time ++;
 
@@ -347,8 +364,65 @@ int main ( int argc, char * argv[] )
   current_time = 0;
   clock_tick   = 1;
 
+  // Options come before the data file name:
+  //   -d    run as a discrete event simulation on a virtual clock
+  //   -t    one thread per train instead of the worker pool
+  //   -w N  N pool workers instead of one per core
+  //   -s    print thread, memory and dispatch statistics at the end
+  //   -p P  let policy P pick who goes next (see policy.h)
+  //   -m F  write per-train metrics to F, JSON or, for a .csv name, CSV
+  //   -l    profile the locks and condition variables (see lockprof.h)
+  //   -f    stream the schedule, waiting at its end for more (see stream.h)
+  char * metrics_file = NULL;
+  int follow = 0;
+  int opt;
+  while( ( opt = getopt( argc, argv, "dtw:sp:m:lf" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'd':
+        virtual_time = 1;
+        break;
+      case 't':
+        thread_per_train = 1;
+        break;
+      case 'w':
+        pool_workers = atoi( optarg );
+        break;
+      case 's':
+        show_stats = 1;
+        break;
+      case 'p':
+        if( policySet( optarg ) != 0 )
+        {
+          fprintf( stderr, "ERROR: Unknown policy %s, or not the one this build is fixed to.\n", optarg );
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'm':
+        metrics_file = optarg;
+        break;
+      case 'l':
+#if LOCK_PROFILE > 0
+        lock_profile = 1;
+#else
+        fprintf( stderr, "ERROR: This build has lock profiling compiled out.\n");
+        exit(EXIT_FAILURE);
+#endif
+        break;
+      case 'f':
+        follow = 1;
+        break;
+      default:
+        fprintf( stderr, "usage: %s [-d] [-t] [-w workers] [-s] [-p policy] [-m file] [-l] [-f] schedule|- [tick]\n",
+                 argv[0] );
+        exit(EXIT_FAILURE);
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
   // Verify the user provided a data file name.  If not then
-                                                                                                                             321,3         89%
   // print an error and exit the program
   if( argc < 2 )
   {
@@ -360,9 +434,9 @@ int main ( int argc, char * argv[] )
   // tick rate.  
   if( argc == 3 )
   {
-    int32_t tick = atoi( argv[2] );
+    double tick = strtod( argv[2], NULL );
 
-    if( tick <= 0 )
+    if( !( tick > 0 ) )
     {
       fprintf( stderr, "ERROR: tick rate must be positive.\n");
       exit(EXIT_FAILURE);
@@ -373,16 +447,93 @@ int main ( int argc, char * argv[] )
     }
   }
 
-  buildTrainSchedule( argv[1] );
+  // stdin, a FIFO or with -f any file is read as the simulation goes
+  if( streamWanted( argv[1], follow ) )
+  {
+    if( virtual_time || metrics_file )
+    {
+      fprintf( stderr, "ERROR: -d and -m need the whole schedule, not a stream.\n");
+      exit(EXIT_FAILURE);
+    }
+    streamOpen( &stream, argv[1], follow );
+  }
+  else
+  {
+    buildTrainSchedule( argv[1] );
+  }
+
+  // Per-train metrics grow with the trains, so a stream goes without
+  if( ( show_stats || metrics_file ) && !streaming )
+    metricsInit( schedule_back - schedule_front );
 
   // Initialize the intersection to be empty
-  in_intersection = INTERSECTION_EMPTY;
+  crossing.in_intersection = INTERSECTION_EMPTY;
+
+  // The clock starts before the threads do, so they get its timer slack
+  if( !virtual_time )
+    clockStart( &sim_clock, clock_tick );
 
   // Call user specific initialization
   init( );
 
   // Start running the MAV manager
-  while( process() );
+  if( virtual_time )
+    desRun( );
+  else
+    while( process() );
+
+  // The lines still in the log go out before any report
+  logStop( );
+
+  if( ( show_stats || metrics_file ) && !streaming )
+  {
+    // Trains still crossing would add to the records as they are read
+    metrics.enabled = 0;
+    metricsCollect( );
+  }
+
+  if( show_stats )
+  {
+    fflush( stdout );
+    poolReport( );
+    if( !virtual_time )
+      clockReport( &sim_clock, stderr );
+    if( !streaming )
+      metricsReport( stderr );
+  }
+
+  // Lines a stream dropped are always worth knowing about
+  if( streaming && ( show_stats || stream.skipped ) )
+  {
+    fflush( stdout );
+    fprintf( stderr, "stream: %llu trains over %u days, %llu lines skipped\n",
+             (unsigned long long) stream.entries, stream.day + 1, (unsigned long long) stream.skipped );
+  }
+
+  if( lock_profile )
+  {
+    // Only -t has locks; the pool hands trains over with futexes
+    fflush( stdout );
+    profReport( stderr );
+    fprintf( stderr, "handoff from mediate() to trainCross():\n" );
+    histPrint( stderr, "trains", &dispatch.latency );
+  }
+
+  if( metrics_file && metricsWrite( metrics_file ) != 0 )
+  {
+    perror( metrics_file );
+    exit( EXIT_FAILURE );
+  }
+
+  // Only schedules that give trains a max wait have deadlines to report
+  struct intersection *x = virtual_time ? &des.crossing : &crossing;
+  if( x->deadlines_met + x->deadlines_missed )
+  {
+    fflush( stdout );
+    fprintf( stderr, "deadlines: %llu met, %llu missed, worst %u s late\n",
+             (unsigned long long) x->deadlines_met, (unsigned long long) x->deadlines_missed,
+             x->worst_late );
+  }
 
   return 0;
 }
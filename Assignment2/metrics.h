@@ -0,0 +1,356 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "train.h"
+
+/*
+ *
+ * Per-train metrics.  Every arrival, entry and leave is appended to one
+ * preallocated buffer; a slot is claimed with a single atomic add, so
+ * recording takes no lock whichever thread the train is on.  Each train
+ * is numbered as it arrives and its three records carry that number, so
+ * trains that share an id are never mixed up.  At the end of the run the
+ * records are sorted by that number and put back together, and
+ * metricsReport() works out the wait at the intersection per direction
+ * (p50, p95, p99, max), how busy the intersection was, trains per
+ * simulated hour and Jain's fairness index over the directions' mean
+ * waits.  metricsWrite() dumps the same as JSON, or every train as CSV.
+ *
+ * Times are in simulated seconds, current_time as the trains see it.
+ *
+ */
+
+#define SECONDS_IN_AN_HOUR 3600
+
+enum METRIC_KIND
+{
+  METRIC_ARRIVE = 0,
+  METRIC_ENTER  = 1,
+  METRIC_LEAVE  = 2
+};
+
+struct metric_record
+{
+  uint32_t time;
+  uint32_t train_id;
+  uint32_t arrival;     // the train's number in order of arrival
+  uint8_t  kind;
+  uint8_t  direction;
+};
+
+// One train put back together
+struct train_metrics
+{
+  uint32_t train_id;
+  uint32_t direction;
+  uint32_t arrive;
+  uint32_t enter;
+  uint32_t leave;
+};
+
+struct metrics
+{
+  int                   enabled;
+  struct metric_record *records;
+  uint32_t              cap;
+  uint32_t              n;          // slots claimed, may pass cap
+  struct train_metrics *trains;     // filled in by metricsCollect()
+  uint32_t              ntrains;
+  uint32_t              unfinished; // arrived but never left
+};
+
+struct metrics metrics;
+
+// Makes room for the records of a schedule of this many trains
+void metricsInit   ( uint32_t trains );
+void metricsRecord ( enum METRIC_KIND kind, uint32_t time, uint32_t arrival, uint32_t train_id,
+                     enum TRAIN_DIRECTION direction );
+void metricsCollect( );
+void metricsReport ( FILE * fp );
+
+// JSON summary, or one CSV line per train if filename ends in .csv
+int  metricsWrite  ( const char * filename );
+
+void metricsInit( uint32_t trains )
+{
+  uint64_t cap = (uint64_t) trains * 3;
+
+  if( cap > UINT32_MAX ) cap = UINT32_MAX;
+  metrics.records = malloc( cap * sizeof( struct metric_record ) );
+  if( metrics.records == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for the metrics of %u trains.\n", trains );
+    exit( EXIT_FAILURE );
+  }
+  metrics.cap     = cap;
+  metrics.n       = 0;
+  metrics.enabled = 1;
+}
+
+void metricsRecord( enum METRIC_KIND kind, uint32_t time, uint32_t arrival, uint32_t train_id,
+                    enum TRAIN_DIRECTION direction )
+{
+  if( !metrics.enabled ) return;
+
+  uint32_t slot = __atomic_fetch_add( &metrics.n, 1, __ATOMIC_RELAXED );
+  if( slot >= metrics.cap ) return;
+
+  struct metric_record *r = &metrics.records[ slot ];
+  r->time      = time;
+  r->train_id  = train_id;
+  r->arrival   = arrival;
+  r->kind      = kind;
+  r->direction = direction;
+}
+
+int metricRecordCompare( const void * a, const void * b )
+{
+  const struct metric_record *x = a, *y = b;
+
+  if( x->arrival != y->arrival ) return x->arrival < y->arrival ? -1 : 1;
+  return x->kind < y->kind ? -1 : x->kind > y->kind;
+}
+
+// Call once every train thread is done
+void metricsCollect( )
+{
+  uint32_t n = metrics.n < metrics.cap ? metrics.n : metrics.cap;
+
+  qsort( metrics.records, n, sizeof( struct metric_record ), metricRecordCompare );
+
+  metrics.trains = malloc( ( n / 3 + 1 ) * sizeof( struct train_metrics ) );
+  if( metrics.trains == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for the train metrics.\n");
+    exit( EXIT_FAILURE );
+  }
+  metrics.ntrains    = 0;
+  metrics.unfinished = 0;
+
+  // Each arrival's records are together now, arrive first
+  for( uint32_t i = 0; i < n; )
+  {
+    struct metric_record *r[ 3 ] = { NULL, NULL, NULL };
+    uint32_t arrival = metrics.records[ i ].arrival;
+
+    for( ; i < n && metrics.records[ i ].arrival == arrival; i++ )
+      r[ metrics.records[ i ].kind ] = &metrics.records[ i ];
+
+    // Missing its arrival only if that went past the buffer
+    if( r[ METRIC_ARRIVE ] == NULL ) continue;
+    if( r[ METRIC_ENTER ] == NULL || r[ METRIC_LEAVE ] == NULL )
+    {
+      metrics.unfinished++;
+      continue;
+    }
+
+    struct train_metrics *t = &metrics.trains[ metrics.ntrains++ ];
+    t->train_id  = r[ METRIC_ARRIVE ]->train_id;
+    t->direction = r[ METRIC_ARRIVE ]->direction;
+    t->arrive    = r[ METRIC_ARRIVE ]->time;
+    t->enter     = r[ METRIC_ENTER ]->time;
+    t->leave     = r[ METRIC_LEAVE ]->time;
+  }
+}
+
+struct wait_summary
+{
+  uint32_t trains;
+  uint32_t p50, p95, p99, max;
+  double   mean;
+};
+
+struct run_summary
+{
+  struct wait_summary wait[ NUM_DIRECTIONS ];   // UNKNOWN's slot is every direction
+  uint32_t            start, end;               // first arrival, last leave
+  uint64_t            busy;                     // seconds a train was in the intersection
+  double              utilization;
+  double              per_hour;
+  uint32_t            peak_hour, peak_hour_trains;
+  double              jain;
+};
+
+int waitCompare( const void * a, const void * b )
+{
+  uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+// Nearest rank percentile of sorted waits
+uint32_t waitPercentile( uint32_t * waits, uint32_t n, double p )
+{
+  uint32_t rank = p * n;
+  if( rank < p * n ) rank++;
+  return waits[ rank ? rank - 1 : 0 ];
+}
+
+void waitSummarize( struct wait_summary * s, uint32_t * waits, uint32_t n )
+{
+  uint64_t sum = 0;
+
+  memset( s, 0, sizeof( struct wait_summary ) );
+  s->trains = n;
+  if( n == 0 ) return;
+
+  qsort( waits, n, sizeof( uint32_t ), waitCompare );
+  for( uint32_t i = 0; i < n; i++ ) sum += waits[ i ];
+  s->p50  = waitPercentile( waits, n, 0.50 );
+  s->p95  = waitPercentile( waits, n, 0.95 );
+  s->p99  = waitPercentile( waits, n, 0.99 );
+  s->max  = waits[ n - 1 ];
+  s->mean = (double) sum / n;
+}
+
+void metricsSummarize( struct run_summary * r )
+{
+  uint32_t *waits = malloc( ( metrics.ntrains + 1 ) * sizeof( uint32_t ) );
+  if( waits == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for the train metrics.\n");
+    exit( EXIT_FAILURE );
+  }
+  memset( r, 0, sizeof( struct run_summary ) );
+
+  for( int d = UNKNOWN; d < NUM_DIRECTIONS; d++ )
+  {
+    uint32_t n = 0;
+    for( uint32_t i = 0; i < metrics.ntrains; i++ )
+      if( d == UNKNOWN || metrics.trains[ i ].direction == (uint32_t) d )
+        waits[ n++ ] = metrics.trains[ i ].enter - metrics.trains[ i ].arrive;
+    waitSummarize( &r->wait[ d ], waits, n );
+  }
+  free( waits );
+  if( metrics.ntrains == 0 ) return;
+
+  uint32_t hours = SECONDS_IN_A_DAY / SECONDS_IN_AN_HOUR + 1;
+  uint32_t per_hour[ SECONDS_IN_A_DAY / SECONDS_IN_AN_HOUR + 1 ] = { 0 };
+
+  r->start = UINT32_MAX;
+  for( uint32_t i = 0; i < metrics.ntrains; i++ )
+  {
+    struct train_metrics *t = &metrics.trains[ i ];
+    if( t->arrive < r->start ) r->start = t->arrive;
+    if( t->leave > r->end )    r->end   = t->leave;
+    // A train leaves at the end of its last second in the intersection
+    r->busy += t->leave - t->enter + 1;
+    per_hour[ t->leave / SECONDS_IN_AN_HOUR < hours ? t->leave / SECONDS_IN_AN_HOUR : hours - 1 ]++;
+  }
+  r->utilization = (double) r->busy / ( r->end - r->start + 1 );
+  r->per_hour    = metrics.ntrains / ( ( r->end - r->start + 1 ) / (double) SECONDS_IN_AN_HOUR );
+  for( uint32_t h = 0; h < hours; h++ )
+  {
+    if( per_hour[ h ] > r->peak_hour_trains )
+    {
+      r->peak_hour        = h;
+      r->peak_hour_trains = per_hour[ h ];
+    }
+  }
+
+  // (sum x)^2 / (n sum x^2): 1 when every direction waits as long, 1/n when one does all the waiting
+  double sum = 0, squares = 0;
+  int    n   = 0;
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+  {
+    if( r->wait[ d ].trains == 0 ) continue;
+    sum     += r->wait[ d ].mean;
+    squares += r->wait[ d ].mean * r->wait[ d ].mean;
+    n++;
+  }
+  r->jain = squares > 0 ? sum * sum / ( n * squares ) : 1.0;
+}
+
+void metricsReport( FILE * fp )
+{
+  struct run_summary r;
+  metricsSummarize( &r );
+
+  fprintf( fp, "wait (s)   trains    p50    p95    p99    max     mean\n" );
+  for( int d = NORTH; d <= NUM_DIRECTIONS; d++ )
+  {
+    // Every direction last
+    int                  i = d == NUM_DIRECTIONS ? UNKNOWN : d;
+    struct wait_summary *s = &r.wait[ i ];
+    fprintf( fp, "%-8s %8u %6u %6u %6u %6u %8.1f\n", i == UNKNOWN ? "all" : directionAsString[ i ],
+             s->trains, s->p50, s->p95, s->p99, s->max, s->mean );
+  }
+  if( metrics.ntrains == 0 ) return;
+
+  fprintf( fp, "utilization: %.1f%% of %u s\n", 100 * r.utilization, r.end - r.start + 1 );
+  fprintf( fp, "throughput: %.1f trains per hour, peak %u in hour %u\n", r.per_hour,
+           r.peak_hour_trains, r.peak_hour );
+  fprintf( fp, "fairness: Jain's index %.3f over the directions' mean waits\n", r.jain );
+  if( metrics.unfinished )
+    fprintf( fp, "unfinished: %u trains arrived but had not left\n", metrics.unfinished );
+  if( metrics.n > metrics.cap )
+    fprintf( fp, "dropped: %u records past the buffer\n", metrics.n - metrics.cap );
+}
+
+int metricsWrite( const char * filename )
+{
+  FILE * fp = fopen( filename, "w" );
+  if( fp == NULL ) return -1;
+
+  size_t len = strlen( filename );
+  if( len >= 4 && strcmp( filename + len - 4, ".csv" ) == 0 )
+  {
+    fprintf( fp, "train_id,direction,arrive,enter,leave,wait\n" );
+    for( uint32_t i = 0; i < metrics.ntrains; i++ )
+    {
+      struct train_metrics *t = &metrics.trains[ i ];
+      fprintf( fp, "%u,%s,%u,%u,%u,%u\n", t->train_id, directionAsString[ t->direction ],
+               t->arrive, t->enter, t->leave, t->enter - t->arrive );
+    }
+    return fclose( fp );
+  }
+
+  struct run_summary r;
+  metricsSummarize( &r );
+
+  fprintf( fp, "{\n  \"trains\": %u,\n  \"unfinished\": %u,\n", metrics.ntrains, metrics.unfinished );
+  fprintf( fp, "  \"wait\": {\n" );
+  for( int d = NORTH; d <= NUM_DIRECTIONS; d++ )
+  {
+    int                  i = d == NUM_DIRECTIONS ? UNKNOWN : d;
+    struct wait_summary *s = &r.wait[ i ];
+    fprintf( fp, "    \"%s\": { \"trains\": %u, \"p50\": %u, \"p95\": %u, \"p99\": %u, \"max\": %u, "
+                 "\"mean\": %.3f }%s\n", i == UNKNOWN ? "all" : directionAsString[ i ],
+             s->trains, s->p50, s->p95, s->p99, s->max, s->mean, d == NUM_DIRECTIONS ? "" : "," );
+  }
+  fprintf( fp, "  },\n" );
+  fprintf( fp, "  \"start\": %u,\n  \"end\": %u,\n  \"busy\": %llu,\n  \"utilization\": %.6f,\n",
+           r.start, r.end, (unsigned long long) r.busy, r.utilization );
+  fprintf( fp, "  \"trains_per_hour\": %.3f,\n  \"peak_hour\": %u,\n  \"peak_hour_trains\": %u,\n",
+           r.per_hour, r.peak_hour, r.peak_hour_trains );
+  fprintf( fp, "  \"jain_index\": %.6f\n}\n", r.jain );
+  return fclose( fp );
+}
+
+#endif
@@ -0,0 +1,117 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+/*
+ *
+ * Checks that metricsCollect() puts each train back together from its
+ * own records, even when trains share an id.
+ *
+ * Build and run:
+ *   gcc -O2 -o metricstest metricstest.c
+ *   ./metricstest
+ *
+ * Replays the three trains with id 2 in schedule.txt: South at 3, North
+ * at 5 and South at 7.  North 2 crosses first, so the records come in the
+ * order mavon -d writes them, and once more in reverse, the way no single
+ * run would but threads could.  A fourth train arrives and never leaves.
+ * Prints every mismatch and exits with failure if there was one.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "metrics.h"
+
+struct expected
+{
+  uint32_t             arrival;
+  uint32_t             train_id;
+  enum TRAIN_DIRECTION direction;
+  uint32_t             arrive, enter, leave;
+};
+
+// What the three trains with id 2 do in mavon -d schedule.txt
+struct expected trains[ 3 ] =
+{
+  { 0, 2, SOUTH, 3, 61, 70 },
+  { 1, 2, NORTH, 5, 11, 20 },
+  { 2, 2, SOUTH, 7, 71, 80 },
+};
+
+struct metric_record order[ 10 ] =
+{
+  { 3,  2, 0, METRIC_ARRIVE, SOUTH },
+  { 5,  2, 1, METRIC_ARRIVE, NORTH },
+  { 7,  2, 2, METRIC_ARRIVE, SOUTH },
+  { 9,  4, 3, METRIC_ARRIVE, EAST  },
+  { 11, 2, 1, METRIC_ENTER,  NORTH },
+  { 20, 2, 1, METRIC_LEAVE,  NORTH },
+  { 61, 2, 0, METRIC_ENTER,  SOUTH },
+  { 70, 2, 0, METRIC_LEAVE,  SOUTH },
+  { 71, 2, 2, METRIC_ENTER,  SOUTH },
+  { 80, 2, 2, METRIC_LEAVE,  SOUTH },
+};
+
+int check( const char * name, int reverse )
+{
+  int failed = 0;
+
+  metricsInit( 4 );
+  for( int i = 0; i < 10; i++ )
+  {
+    struct metric_record *r = &order[ reverse ? 9 - i : i ];
+    metricsRecord( r->kind, r->time, r->arrival, r->train_id, r->direction );
+  }
+  metricsCollect( );
+
+  if( metrics.ntrains != 3 || metrics.unfinished != 1 )
+  {
+    printf( "%s: %u trains and %u unfinished, wanted 3 and 1\n", name, metrics.ntrains, metrics.unfinished );
+    failed = 1;
+  }
+
+  for( uint32_t i = 0; i < metrics.ntrains && i < 3; i++ )
+  {
+    struct train_metrics *t = &metrics.trains[ i ];
+    struct expected      *e = &trains[ i ];
+    if( t->train_id != e->train_id || t->direction != e->direction || t->arrive != e->arrive ||
+        t->enter != e->enter || t->leave != e->leave )
+    {
+      printf( "%s: train %u is %u %s %u-%u-%u, wanted %u %s %u-%u-%u\n", name, e->arrival,
+              t->train_id, directionAsString[ t->direction ], t->arrive, t->enter, t->leave,
+              e->train_id, directionAsString[ e->direction ], e->arrive, e->enter, e->leave );
+      failed = 1;
+    }
+  }
+
+  free( metrics.records );
+  free( metrics.trains );
+  return failed;
+}
+
+int main( )
+{
+  int failed = check( "in order", 0 ) | check( "reversed", 1 );
+
+  printf( "metricstest: %s\n", failed ? "FAILED" : "ok" );
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
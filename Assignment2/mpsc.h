@@ -0,0 +1,135 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __MPSC_H__
+#define __MPSC_H__
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ *
+ * Lock-free multi-producer single-consumer FIFO (Vyukov's intrusive
+ * queue) and the futex calls the intersection grant is built on.
+ *
+ * Any thread may push; only one thread, the one running mediate(), may
+ * pop.  A push is one atomic exchange and one store.  A pop that finds a
+ * push half done returns NULL, the same as an empty queue, and the item
+ * shows up on a later pop.
+ *
+ */
+
+struct train_node
+{
+  struct train_node *next;
+  uint32_t           train_id;
+  uint32_t           direction;
+  uint32_t           arrival;      // its number in order of arrival, for the metrics
+  uint64_t           grant_ns;     // when mediate() granted this train
+};
+
+struct mpsc_queue
+{
+  struct train_node *head;         // last pushed, producers swap themselves in here
+  char               pad[ 64 - sizeof( struct train_node * ) ];
+  struct train_node *tail;         // next to pop, consumer only
+  struct train_node  stub;
+};
+
+void               mpscInit( struct mpsc_queue *q );
+void               mpscPush( struct mpsc_queue *q, struct train_node *node );
+struct train_node *mpscPop ( struct mpsc_queue *q );
+
+// Sleeps while *addr is still val
+void futexWait( uint32_t *addr, uint32_t val );
+void futexWaitFor( uint32_t *addr, uint32_t val, long ns );   // gives up after ns
+void futexWake( uint32_t *addr );
+
+void mpscInit( struct mpsc_queue *q )
+{
+  q->stub.next = NULL;
+  q->head      = &q->stub;
+  q->tail      = &q->stub;
+}
+
+void mpscPush( struct mpsc_queue *q, struct train_node *node )
+{
+  __atomic_store_n( &node->next, NULL, __ATOMIC_RELAXED );
+  struct train_node *prev = __atomic_exchange_n( &q->head, node, __ATOMIC_ACQ_REL );
+  __atomic_store_n( &prev->next, node, __ATOMIC_RELEASE );
+}
+
+struct train_node *mpscPop( struct mpsc_queue *q )
+{
+  struct train_node *tail = q->tail;
+  struct train_node *next = __atomic_load_n( &tail->next, __ATOMIC_ACQUIRE );
+
+  // Step over the stub
+  if( tail == &q->stub )
+  {
+    if( next == NULL ) return NULL;
+    q->tail = next;
+    tail    = next;
+    next    = __atomic_load_n( &next->next, __ATOMIC_ACQUIRE );
+  }
+
+  if( next != NULL )
+  {
+    q->tail = next;
+    return tail;
+  }
+
+  // tail is the last node only if no push is half done behind it
+  if( tail != __atomic_load_n( &q->head, __ATOMIC_ACQUIRE ) ) return NULL;
+
+  // Put the stub back behind it so tail can be handed out
+  mpscPush( q, &q->stub );
+  next = __atomic_load_n( &tail->next, __ATOMIC_ACQUIRE );
+  if( next != NULL )
+  {
+    q->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+void futexWait( uint32_t *addr, uint32_t val )
+{
+  syscall( SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0 );
+}
+
+void futexWaitFor( uint32_t *addr, uint32_t val, long ns )
+{
+  struct timespec timeout = { ns / 1000000000, ns % 1000000000 };
+  syscall( SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &timeout, NULL, 0 );
+}
+
+void futexWake( uint32_t *addr )
+{
+  syscall( SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0 );
+}
+
+#endif
@@ -0,0 +1,279 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "intersection.h"
+#include "train.h"
+
+/*
+ *
+ * Policies for which direction mediate() lets into the intersection next.
+ *
+ *   rules          the original rules: starvation check, then the N-S and
+ *                  E-W cases, then right of way
+ *   fifo           the train that has waited longest, whatever direction
+ *   round-robin    the next direction after the last one, N E S W
+ *   longest-queue  the direction with the most trains waiting
+ *   platoon        up to PLATOON_SIZE trains from one direction back to
+ *                  back, then round robin to the next
+ *   edf            the rules' starvation check, then the direction holding
+ *                  the train with the earliest deadline, then the rules
+ *
+ * mavon -p and gridsim -p choose one when they start, and an
+ * intersection's own policy field, if set, overrides it for that one.
+ * Building with -DMEDIATE_POLICY=POLICY_FIFO (or any other) fixes it
+ * instead, so the compiler drops the others from mediateChoose().
+ *
+ */
+
+#ifndef PLATOON_SIZE
+#define PLATOON_SIZE 4
+#endif
+
+enum MEDIATE_POLICY
+{
+  POLICY_RULES = 0,
+  POLICY_FIFO,
+  POLICY_ROUND_ROBIN,
+  POLICY_LONGEST_QUEUE,
+  POLICY_PLATOON,
+  POLICY_EDF,
+  NUM_POLICIES
+};
+
+static const char * policyNames[ NUM_POLICIES ] =
+{
+  "rules",
+  "fifo",
+  "round-robin",
+  "longest-queue",
+  "platoon",
+  "edf"
+};
+
+#ifdef MEDIATE_POLICY
+#define mediatePolicy MEDIATE_POLICY
+#else
+enum MEDIATE_POLICY mediatePolicy = POLICY_RULES;
+#endif
+
+// The policy called name, or -1
+int policyFromName( const char * name );
+
+// Picks a policy by name, failing if it is unknown or the build fixed another
+int policySet( const char * name );
+
+// Which direction should get the intersection next, or UNKNOWN if it is
+// taken or nobody is waiting.  Call on the thread trains arrive on.
+enum TRAIN_DIRECTION mediateChoose( struct intersection * x );
+
+int policyFromName( const char * name )
+{
+  for( int p = 0; p < NUM_POLICIES; p++ )
+    if( strcmp( name, policyNames[ p ] ) == 0 ) return p;
+  return -1;
+}
+
+int policySet( const char * name )
+{
+  int p = policyFromName( name );
+  if( p < 0 ) return -1;
+#ifdef MEDIATE_POLICY
+  return p == MEDIATE_POLICY ? 0 : -1;
+#else
+  mediatePolicy = p;
+  return 0;
+#endif
+}
+
+static inline enum TRAIN_DIRECTION policyStarvation( struct intersection * x )
+{
+  int *trainCount  = x->trainCount;
+  int *consecCount = x->consecCount;
+  int  limit       = x->starvation_limit;
+
+  // This takes care of starvation cases.
+  if(consecCount[NORTH]==limit && trainCount[EAST]!=0){
+    consecCount[NORTH]=0;
+    return EAST;
+  }
+
+  if(consecCount[EAST]==limit && trainCount[SOUTH]!=0){
+    consecCount[EAST]=0;
+    return SOUTH;
+  }
+
+  if(consecCount[SOUTH]==limit && trainCount[WEST]!=0){
+    consecCount[SOUTH]=0;
+    return WEST;
+  }
+
+  if(consecCount[WEST]==limit && trainCount[NORTH]!=0){
+    consecCount[WEST]=0;
+    return NORTH;
+  }
+  return UNKNOWN;
+}
+
+static inline enum TRAIN_DIRECTION policyRightOfWay( struct intersection * x )
+{
+  int *trainCount = x->trainCount;
+
+  // Checks for N-S and E-W cases.
+  if(trainCount[NORTH]!=0 && trainCount[SOUTH]!=0 && trainCount[EAST]==0 && trainCount[WEST]==0){
+    return NORTH;
+  }
+  if(trainCount[NORTH]==0 && trainCount[SOUTH]==0 && trainCount[EAST]!=0 && trainCount[WEST]!=0){
+    return EAST;
+  }
+
+  // Check for 4-way intersection.
+  if(trainCount[NORTH]!=0 && trainCount[SOUTH]!=0 && trainCount[EAST]!=0 && trainCount[WEST]!=0){
+    return NORTH;
+  }
+
+  // Right of way conditions.
+  if(trainCount[NORTH]!=0 && trainCount[WEST]==0){
+    return NORTH;
+  }
+  if(trainCount[WEST]!=0 && trainCount[SOUTH]==0){
+    return WEST;
+  }
+  if(trainCount[SOUTH]!=0 && trainCount[EAST]==0){
+    return SOUTH;
+  }
+  if(trainCount[EAST]!=0 && trainCount[NORTH]==0){
+    return EAST;
+  }
+  return UNKNOWN;
+}
+
+static inline enum TRAIN_DIRECTION policyRules( struct intersection * x )
+{
+  enum TRAIN_DIRECTION d = policyStarvation( x );
+  return d != UNKNOWN ? d : policyRightOfWay( x );
+}
+
+static inline enum TRAIN_DIRECTION policyFifo( struct intersection * x )
+{
+  enum TRAIN_DIRECTION best = UNKNOWN;
+  uint32_t             oldest = UINT32_MAX;
+
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+  {
+    uint32_t seq = intersectionOldest( x, d );
+    if( seq != UINT32_MAX && ( best == UNKNOWN || (int32_t) ( seq - oldest ) < 0 ) )
+    {
+      best   = d;
+      oldest = seq;
+    }
+  }
+  return best;
+}
+
+// The direction the last train came from, from the in-a-row counts
+static inline enum TRAIN_DIRECTION policyLast( struct intersection * x )
+{
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+    if( x->consecCount[ d ] ) return d;
+  return WEST;   // so round robin starts at NORTH
+}
+
+static inline enum TRAIN_DIRECTION policyRoundRobin( struct intersection * x )
+{
+  enum TRAIN_DIRECTION last = policyLast( x );
+
+  for( int i = 1; i <= 4; i++ )
+  {
+    enum TRAIN_DIRECTION d = NORTH + ( last - NORTH + i ) % 4;
+    if( x->trainCount[ d ] ) return d;
+  }
+  return UNKNOWN;
+}
+
+static inline enum TRAIN_DIRECTION policyLongestQueue( struct intersection * x )
+{
+  enum TRAIN_DIRECTION best = UNKNOWN;
+
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+    if( x->trainCount[ d ] && ( best == UNKNOWN || x->trainCount[ d ] > x->trainCount[ best ] ) )
+      best = d;
+  return best;
+}
+
+static inline enum TRAIN_DIRECTION policyPlatoon( struct intersection * x )
+{
+  enum TRAIN_DIRECTION last = policyLast( x );
+
+  // Keep the platoon going without looking at anyone else
+  if( x->consecCount[ last ] && x->consecCount[ last ] < PLATOON_SIZE && x->trainCount[ last ] )
+    return last;
+  return policyRoundRobin( x );
+}
+
+// Trains in one direction go in order, so a direction is as urgent as
+// the most urgent train anywhere in its queue
+static inline enum TRAIN_DIRECTION policyEdf( struct intersection * x )
+{
+  enum TRAIN_DIRECTION best     = policyStarvation( x );
+  uint32_t             earliest = NO_DEADLINE;
+
+  if( best != UNKNOWN ) return best;
+
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+  {
+    uint32_t deadline = intersectionEarliest( x, d );
+    if( deadline < earliest )
+    {
+      best     = d;
+      earliest = deadline;
+    }
+  }
+  return best != UNKNOWN ? best : policyRightOfWay( x );
+}
+
+enum TRAIN_DIRECTION mediateChoose( struct intersection * x )
+{
+  // The intersection is empty here, so every train counted is waiting
+  if( x->in_intersection != INTERSECTION_EMPTY ) return UNKNOWN;
+
+#ifdef MEDIATE_POLICY
+  switch( MEDIATE_POLICY )
+#else
+  switch( x->policy != POLICY_DEFAULT ? (enum MEDIATE_POLICY) x->policy : mediatePolicy )
+#endif
+  {
+    case POLICY_FIFO:          return policyFifo( x );
+    case POLICY_ROUND_ROBIN:   return policyRoundRobin( x );
+    case POLICY_LONGEST_QUEUE: return policyLongestQueue( x );
+    case POLICY_PLATOON:       return policyPlatoon( x );
+    case POLICY_EDF:           return policyEdf( x );
+    default:                   return policyRules( x );
+  }
+}
+
+#endif
@@ -0,0 +1,212 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hist.h"
+#include "mpsc.h"
+#include "train.h"
+
+/*
+ *
+ * Train worker pool.  An arriving train no longer gets a thread of its
+ * own: it is pushed on its direction's lock-free run queue.  mediate()
+ * grants by popping the oldest train of the direction it picked and
+ * giving it the next ticket.  A fixed set of workers, one per core by
+ * default, each claims the next ticket, sleeps on a futex until
+ * mediate() issues it, and takes that train through trainCross() once
+ * the intersection is serving its ticket.  No locks are taken anywhere
+ * on the way, and the number of threads stays the same however many
+ * trains are waiting.
+ *
+ * mavon -t still makes a thread per train, to compare against.
+ *
+ */
+
+#define POOL_SLOTS      64   // tickets issued but not yet claimed, at most one in practice
+
+// Time from mediate() granting a direction to the train holding the intersection
+struct dispatch_stats
+{
+  struct hist latency;
+  int         threads;        // running threads, main included
+  int         peak_threads;
+};
+
+struct train_pool
+{
+  pthread_t         *workers;
+  int                nworkers;
+  struct mpsc_queue  run[ NUM_DIRECTIONS ];
+  uint32_t           issued;     // futex: tickets mediate() has handed out
+  uint32_t           claimed;    // tickets workers have taken on
+  uint32_t           serving;    // futex: the ticket allowed in the intersection
+  struct train_node *slots[ POOL_SLOTS ];   // the train holding each ticket
+  uint64_t           grant_ns[ NUM_DIRECTIONS ];   // for -t, when each direction was last signalled
+};
+
+int thread_per_train = 0;   // -t
+int pool_workers     = 0;   // -w, 0 for one per core
+int show_stats       = 0;   // -s
+
+struct train_pool     pool;
+struct dispatch_stats dispatch;
+
+void trainCross( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t arrival );
+
+void poolInit  ( );
+void poolArrive( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t arrival );
+void poolGrant ( enum TRAIN_DIRECTION train_direction );
+int  poolBusy  ( );
+void poolReport( );
+
+uint64_t nowNs( )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Called by the one train in the intersection, which keeps the stats consistent
+void dispatchRecord( uint64_t grant_ns )
+{
+  histAdd( &dispatch.latency, nowNs( ) - grant_ns );
+}
+
+void threadsAdd( int delta )
+{
+  int now  = __atomic_add_fetch( &dispatch.threads, delta, __ATOMIC_RELAXED );
+  int peak = __atomic_load_n( &dispatch.peak_threads, __ATOMIC_RELAXED );
+  while( now > peak &&
+         !__atomic_compare_exchange_n( &dispatch.peak_threads, &peak, now, 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+}
+
+void * poolWorker( void * val )
+{
+  (void) val;
+  while( 1 )
+  {
+    uint32_t ticket = __atomic_fetch_add( &pool.claimed, 1, __ATOMIC_RELAXED );
+    uint32_t seen;
+
+    // Until mediate() gets as far as our ticket
+    while( (int32_t) ( ( seen = __atomic_load_n( &pool.issued, __ATOMIC_ACQUIRE ) ) - ticket ) <= 0 )
+      futexWait( &pool.issued, seen );
+    struct train_node *train = pool.slots[ ticket % POOL_SLOTS ];
+
+    // Until the intersection is serving it
+    while( ( seen = __atomic_load_n( &pool.serving, __ATOMIC_ACQUIRE ) ) != ticket )
+      futexWait( &pool.serving, seen );
+
+    dispatchRecord( train->grant_ns );
+    trainCross( train->train_id, train->direction, train->arrival );
+    free( train );
+
+    __atomic_store_n( &pool.serving, ticket + 1, __ATOMIC_RELEASE );
+    futexWake( &pool.serving );
+  }
+  return NULL;
+}
+
+void poolInit( )
+{
+  int n = pool_workers;
+
+  // One worker is usually crossing, so keep at least one more to pick up the next grant
+  if( n <= 0 ) n = sysconf( _SC_NPROCESSORS_ONLN );
+  if( n < 2 )  n = 2;
+
+  for( int d = 0; d < NUM_DIRECTIONS; d++ )
+    mpscInit( &pool.run[ d ] );
+
+  pool.workers  = malloc( n * sizeof( pthread_t ) );
+  pool.nworkers = n;
+  if( pool.workers == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for the worker pool.\n");
+    exit( EXIT_FAILURE );
+  }
+  for( int i = 0; i < n; i++ )
+  {
+    pthread_create( &pool.workers[ i ], NULL, poolWorker, NULL );
+    threadsAdd( 1 );
+  }
+}
+
+void poolArrive( uint32_t train_id, enum TRAIN_DIRECTION train_direction, uint32_t arrival )
+{
+  struct train_node *train = malloc( sizeof( struct train_node ) );
+  if( train == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for an arriving train.\n");
+    exit( EXIT_FAILURE );
+  }
+  train->train_id  = train_id;
+  train->direction = train_direction;
+  train->arrival   = arrival;
+  mpscPush( &pool.run[ train_direction ], train );
+}
+
+// Only ever called from mediate(), which makes it the queues' one consumer
+void poolGrant( enum TRAIN_DIRECTION train_direction )
+{
+  // A grant with no train to take it is lost, as a signal with no waiter would be.
+  struct train_node *train = mpscPop( &pool.run[ train_direction ] );
+  if( train == NULL ) return;
+
+  train->grant_ns = nowNs( );
+  pool.slots[ pool.issued % POOL_SLOTS ] = train;
+  __atomic_store_n( &pool.issued, pool.issued + 1, __ATOMIC_RELEASE );
+  futexWake( &pool.issued );
+}
+
+// A granted train that has not left yet still owns the intersection
+int poolBusy( )
+{
+  return __atomic_load_n( &pool.serving, __ATOMIC_ACQUIRE ) != pool.issued;
+}
+
+void poolReport( )
+{
+  struct rusage ru;
+  getrusage( RUSAGE_SELF, &ru );
+
+  fprintf( stderr, "threads: %d peak (%s)\n", dispatch.peak_threads,
+           thread_per_train ? "one per train" : "worker pool" );
+  fprintf( stderr, "max rss: %ld KB\n", ru.ru_maxrss );
+  if( dispatch.latency.count )
+    fprintf( stderr, "dispatch: %llu trains, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+             (unsigned long long) dispatch.latency.count, histPercentile( &dispatch.latency, 0.5 ) / 1e3,
+             histPercentile( &dispatch.latency, 0.99 ) / 1e3, dispatch.latency.max_ns / 1e3 );
+}
+
+#endif
@@ -0,0 +1,177 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/*
+ *
+ * Stress benchmark for the train worker pool.
+ *
+ * Build and run:
+ *   gcc -O2 -pthread -o mavon mavon.c
+ *   gcc -O2 -o poolbench poolbench.c
+ *   ./poolbench [-m path/to/mavon] [-n trains] [-k tick] [-w workers]
+ *
+ * Writes a schedule where n trains (8000 by default) arrive ten a second
+ * from midnight, far faster than the intersection clears them, plus one
+ * last train just before the end of the day so the simulation runs the
+ * whole backlog.  Runs it through mavon at tick rate k (100000 by
+ * default) once with a thread per train (-t) and once with the worker
+ * pool, sampling /proc for the peak thread count and resident memory.
+ * mavon -s adds the dispatch latency from mediate() to the train holding
+ * the intersection.
+ *
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+double nowS( )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void writeSchedule( const char * path, int n )
+{
+  FILE * fp = fopen( path, "w" );
+  if( fp == NULL )
+  {
+    perror( path );
+    exit( EXIT_FAILURE );
+  }
+  for( int i = 0; i < n - 1; i++ )
+    fprintf( fp, "%d %d %c\n", i / 10, i, "NESW"[ rand( ) % 4 ] );
+  fprintf( fp, "%d %d N\n", 86399, n - 1 );
+  fclose( fp );
+}
+
+// Reads Threads and VmRSS (in KB) from /proc/pid/status
+int sampleProc( pid_t pid, long * threads, long * rss_kb )
+{
+  char path[ 64 ];
+  char line[ 256 ];
+  snprintf( path, sizeof( path ), "/proc/%d/status", (int) pid );
+
+  FILE * fp = fopen( path, "r" );
+  if( fp == NULL ) return 0;
+  while( fgets( line, sizeof( line ), fp ) )
+  {
+    sscanf( line, "Threads: %ld", threads );
+    sscanf( line, "VmRSS: %ld", rss_kb );
+  }
+  fclose( fp );
+  return 1;
+}
+
+void runMode( const char * mavon, const char * schedule, const char * tick, const char * workers,
+              int per_train )
+{
+  long   peak_threads = 0;
+  long   peak_rss     = 0;
+  double start        = nowS( );
+
+  fflush( stdout );
+  pid_t pid = fork( );
+  if( pid == 0 )
+  {
+    // The simulator's own lines are not what we are measuring
+    if( freopen( "/dev/null", "w", stdout ) == NULL ) _exit( 127 );
+    if( per_train )
+      execl( mavon, mavon, "-s", "-t", schedule, tick, (char *) NULL );
+    else if( workers )
+      execl( mavon, mavon, "-s", "-w", workers, schedule, tick, (char *) NULL );
+    else
+      execl( mavon, mavon, "-s", schedule, tick, (char *) NULL );
+    perror( mavon );
+    _exit( 127 );
+  }
+
+  int status;
+  while( waitpid( pid, &status, WNOHANG ) == 0 )
+  {
+    long threads = 0, rss = 0;
+    if( sampleProc( pid, &threads, &rss ) )
+    {
+      if( threads > peak_threads ) peak_threads = threads;
+      if( rss > peak_rss )         peak_rss     = rss;
+    }
+    usleep( 2000 );
+  }
+
+  printf( "%-14s threads %6ld peak   rss %8.1f MB peak   wall %6.2f s   %s\n",
+          per_train ? "thread/train" : "worker pool", peak_threads, peak_rss / 1024.0,
+          nowS( ) - start, WIFEXITED( status ) && WEXITSTATUS( status ) == 0 ? "ok" : "FAILED" );
+}
+
+int main( int argc, char * argv[] )
+{
+  char * mavon   = "./mavon";
+  char * tick    = "100000";
+  char * workers = NULL;
+  int    n       = 8000;
+  int    opt;
+
+  while( ( opt = getopt( argc, argv, "m:n:k:w:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'm':
+        mavon = optarg;
+        break;
+      case 'n':
+        n = atoi( optarg );
+        break;
+      case 'k':
+        tick = optarg;
+        break;
+      case 'w':
+        workers = optarg;
+        break;
+      default:
+        fprintf( stderr, "usage: %s [-m mavon] [-n trains] [-k tick] [-w workers]\n", argv[0] );
+        exit( EXIT_FAILURE );
+    }
+  }
+  if( n < 2 || n > 8640 )
+  {
+    // mavon's schedule holds a day's worth of trains at most
+    fprintf( stderr, "ERROR: trains must be between 2 and 8640.\n");
+    exit( EXIT_FAILURE );
+  }
+
+  char schedule[ 64 ];
+  snprintf( schedule, sizeof( schedule ), "/tmp/poolbench.%d.txt", (int) getpid( ) );
+  srand( 1 );
+  writeSchedule( schedule, n );
+
+  printf( "%d trains, tick rate %s\n", n, tick );
+  runMode( mavon, schedule, tick, workers, 1 );
+  runMode( mavon, schedule, tick, workers, 0 );
+
+  unlink( schedule );
+  return 0;
+}
@@ -0,0 +1,197 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/*
+ *
+ * Load-time benchmark for train schedules.
+ *
+ * Build and run:
+ *   gcc -O2 -o schedbench schedbench.c
+ *   ./schedbench [-n entries] [-d dir]
+ *
+ * Writes a text schedule of n entries (100 million by default) under dir,
+ * converts it to the binary format, drops both from the page cache, then
+ * times loading the text file the old way (fscanf, into a growing
+ * array since the old fixed one holds only a day), with the
+ * buildTrainSchedule() text loader, and with buildTrainSchedule() on the
+ * binary file.  Each load is followed by a pass over every entry, so
+ * the binary file's pages are really read, and the passes must agree.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "train.h"
+
+double nowS( )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Asks the kernel to forget the file's cached pages so every load starts cold
+void dropCache( const char * path )
+{
+  int fd = open( path, O_RDONLY );
+  if( fd < 0 ) return;
+  fdatasync( fd );
+  posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+  close( fd );
+}
+
+uint64_t checksum( ScheduleEntry * entries, uint64_t n )
+{
+  uint64_t sum = 0;
+  for( uint64_t i = 0; i < n; i++ )
+    sum = sum * 31 + entries[ i ].arrival_time * 7 + entries[ i ].train_id * 3 + entries[ i ].train_direction;
+  return sum;
+}
+
+// The loader as it was, minus the fixed array
+uint64_t loadWithFscanf( const char * path, uint64_t * count )
+{
+  FILE * fp = fopen( path, "r" );
+  uint32_t arrival_time, train_id;
+  char     destination_direction;
+  uint64_t n = 0, cap = 1024;
+  ScheduleEntry * entries = malloc( cap * sizeof( ScheduleEntry ) );
+
+  if( fp == NULL || entries == NULL )
+  {
+    perror( path );
+    exit( EXIT_FAILURE );
+  }
+  while( fscanf( fp, "%d %d %c", &arrival_time, &train_id, &destination_direction ) != EOF )
+  {
+    if( n == cap )
+    {
+      cap *= 2;
+      entries = realloc( entries, cap * sizeof( ScheduleEntry ) );
+      if( entries == NULL )
+      {
+        fprintf( stderr, "ERROR: Out of memory.\n");
+        exit( EXIT_FAILURE );
+      }
+    }
+    entries[ n ].arrival_time    = arrival_time;
+    entries[ n ].train_id        = train_id;
+    entries[ n ].train_direction = directionFromChar( destination_direction );
+    n++;
+  }
+  fclose( fp );
+
+  uint64_t sum = checksum( entries, n );
+  free( entries );
+  *count = n;
+  return sum;
+}
+
+int main( int argc, char * argv[] )
+{
+  long   n   = 100000000;
+  char * dir = "/tmp";
+  int    opt;
+
+  while( ( opt = getopt( argc, argv, "n:d:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'n':
+        n = atol( optarg );
+        break;
+      case 'd':
+        dir = optarg;
+        break;
+      default:
+        fprintf( stderr, "usage: %s [-n entries] [-d dir]\n", argv[0] );
+        exit( EXIT_FAILURE );
+    }
+  }
+  if( n <= 0 || n > UINT32_MAX )
+  {
+    fprintf( stderr, "ERROR: entries must be between 1 and %u.\n", UINT32_MAX );
+    exit( EXIT_FAILURE );
+  }
+
+  char text[ 4096 ], binary[ 4096 ];
+  snprintf( text, sizeof( text ), "%s/schedbench.%d.txt", dir, (int) getpid( ) );
+  snprintf( binary, sizeof( binary ), "%s/schedbench.%d.bin", dir, (int) getpid( ) );
+
+  // A day's worth of arrival times over and over, ids going up
+  FILE * fp = fopen( text, "w" );
+  if( fp == NULL )
+  {
+    perror( text );
+    exit( EXIT_FAILURE );
+  }
+  srand( 1 );
+  for( long i = 0; i < n; i++ )
+    fprintf( fp, "%ld %ld %c\n", i % SECONDS_IN_A_DAY, i, "NESWnesw"[ rand( ) % 8 ] );
+  fclose( fp );
+
+  buildTrainSchedule( text );
+  if( writeBinarySchedule( binary ) != 0 )
+  {
+    perror( binary );
+    exit( EXIT_FAILURE );
+  }
+  scheduleInit( );
+
+  struct stat st_text, st_binary;
+  stat( text, &st_text );
+  stat( binary, &st_binary );
+  printf( "%ld entries, text %.1f MB, binary %.1f MB\n", n, st_text.st_size / 1e6, st_binary.st_size / 1e6 );
+
+  uint64_t count;
+  dropCache( text );
+  double   start    = nowS( );
+  uint64_t expected = loadWithFscanf( text, &count );
+  printf( "fscanf        %8.2f s   %10.1f M entries/s\n", nowS( ) - start, count / ( nowS( ) - start ) / 1e6 );
+
+  dropCache( text );
+  start = nowS( );
+  buildTrainSchedule( text );
+  uint64_t sum_text = checksum( schedule, schedule_back );
+  double   t        = nowS( ) - start;
+  printf( "text loader   %8.2f s   %10.1f M entries/s   %s\n", t, schedule_back / t / 1e6,
+          sum_text == expected && schedule_back == count ? "same entries" : "ENTRIES DIFFER" );
+  scheduleInit( );
+
+  dropCache( binary );
+  start = nowS( );
+  buildTrainSchedule( binary );
+  double   t_map      = nowS( ) - start;
+  uint64_t sum_binary = checksum( schedule, schedule_back );
+  t = nowS( ) - start;
+  printf( "binary mmap   %8.2f s   %10.1f M entries/s   %s, %.1f us to map\n", t, schedule_back / t / 1e6,
+          sum_binary == expected && schedule_back == count ? "same entries" : "ENTRIES DIFFER", t_map * 1e6 );
+  scheduleInit( );
+
+  unlink( text );
+  unlink( binary );
+  return sum_text == expected && sum_binary == expected ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/*
+ *
+ * Converts train schedules between the text format and the binary one
+ * mavon maps without parsing.
+ *
+ * Build and run:
+ *   gcc -O2 -o schedconv schedconv.c
+ *   ./schedconv schedule.txt schedule.bin     text (or binary) to binary
+ *   ./schedconv -t schedule.bin schedule.txt  binary (or text) to text
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "train.h"
+
+int writeTextSchedule( char * filename )
+{
+  static const char letter[ NUM_DIRECTIONS ] = { '?', 'N', 'E', 'S', 'W' };
+
+  FILE * fp = fopen( filename, "w" );
+  if( fp == NULL ) return -1;
+
+  for( uint32_t i = schedule_front; i < schedule_back; i++ )
+  {
+    uint32_t d = schedule[ i ].train_direction;
+    fprintf( fp, "%u %u %c", schedule[ i ].arrival_time, schedule[ i ].train_id,
+             d < NUM_DIRECTIONS ? letter[ d ] : '?' );
+    if( schedule[ i ].max_wait ) fprintf( fp, " %u", schedule[ i ].max_wait );
+    fputc( '\n', fp );
+  }
+  return fclose( fp );
+}
+
+int main( int argc, char * argv[] )
+{
+  int text = 0;
+  int opt;
+
+  while( ( opt = getopt( argc, argv, "t" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 't':
+        text = 1;
+        break;
+      default:
+        fprintf( stderr, "usage: %s [-t] input output\n", argv[0] );
+        exit( EXIT_FAILURE );
+    }
+  }
+  if( argc - optind != 2 )
+  {
+    fprintf( stderr, "usage: %s [-t] input output\n", argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  buildTrainSchedule( argv[ optind ] );
+
+  if( ( text ? writeTextSchedule( argv[ optind + 1 ] ) : writeBinarySchedule( argv[ optind + 1 ] ) ) != 0 )
+  {
+    perror( argv[ optind + 1 ] );
+    exit( EXIT_FAILURE );
+  }
+  fprintf( stderr, "%u entries written to %s\n", schedule_back - schedule_front, argv[ optind + 1 ] );
+  return 0;
+}
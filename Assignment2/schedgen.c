@@ -0,0 +1,135 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/*
+ *
+ * Writes a synthetic train schedule (see schedgen.h).
+ *
+ * Build and run:
+ *   gcc -O2 -o schedgen schedgen.c -lm
+ *   ./schedgen [-p poisson|bursty|rush] [-n trains] [-m N:E:S:W] [-s seed]
+ *              [-x percent] [-b] [output]
+ *
+ * n trains (8640, a full intersection's day, by default) arrive in the
+ * pattern given, from directions weighted by the mix (1:1:1:1).  -x makes
+ * that percentage of them expresses with a 30 second max wait.  The
+ * schedule goes to output, or stdout, as text; -b writes the binary
+ * format instead, which needs an output file.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "schedgen.h"
+
+void emitPush( void * ctx, ScheduleEntry entry )
+{
+  (void) ctx;
+  schedulePush( entry );
+}
+
+int main( int argc, char * argv[] )
+{
+  struct schedule_spec spec;
+  int    binary = 0;
+  int    opt;
+
+  genDefaults( &spec );
+  while( ( opt = getopt( argc, argv, "p:n:m:s:x:b" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'p':
+        if( genPatternFromName( optarg ) < 0 )
+        {
+          fprintf( stderr, "ERROR: Unknown pattern %s; try poisson, bursty or rush.\n", optarg );
+          exit( EXIT_FAILURE );
+        }
+        spec.pattern = genPatternFromName( optarg );
+        break;
+      case 'n':
+        spec.trains = strtoull( optarg, NULL, 10 );
+        break;
+      case 'm':
+        if( genParseMix( optarg, &spec ) != 0 )
+        {
+          fprintf( stderr, "ERROR: -m wants four weights, like 4:1:1:1.\n");
+          exit( EXIT_FAILURE );
+        }
+        break;
+      case 's':
+        spec.seed = strtoull( optarg, NULL, 10 );
+        break;
+      case 'x':
+        spec.express_percent = atoi( optarg );
+        break;
+      case 'b':
+        binary = 1;
+        break;
+      default:
+        fprintf( stderr, "usage: %s [-p pattern] [-n trains] [-m N:E:S:W] [-s seed] [-x percent] [-b] [output]\n",
+                 argv[0] );
+        exit( EXIT_FAILURE );
+    }
+  }
+  if( spec.trains == 0 || spec.trains > UINT32_MAX )
+  {
+    fprintf( stderr, "ERROR: trains must be between 1 and %u.\n", UINT32_MAX );
+    exit( EXIT_FAILURE );
+  }
+
+  char * output = optind < argc ? argv[ optind ] : NULL;
+
+  if( binary )
+  {
+    if( output == NULL )
+    {
+      fprintf( stderr, "ERROR: -b needs an output file.\n");
+      exit( EXIT_FAILURE );
+    }
+    scheduleInit( );
+    scheduleReserve( spec.trains );
+    genSchedule( &spec, emitPush, NULL );
+    if( writeBinarySchedule( output ) != 0 )
+    {
+      perror( output );
+      exit( EXIT_FAILURE );
+    }
+    return 0;
+  }
+
+  FILE * fp = output ? fopen( output, "w" ) : stdout;
+  if( fp == NULL )
+  {
+    perror( output );
+    exit( EXIT_FAILURE );
+  }
+  genSchedule( &spec, genEmitText, fp );
+  if( fclose( fp ) != 0 )
+  {
+    perror( output ? output : "stdout" );
+    exit( EXIT_FAILURE );
+  }
+  return 0;
+}
@@ -0,0 +1,249 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __SCHEDGEN_H__
+#define __SCHEDGEN_H__
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "train.h"
+
+/*
+ *
+ * Synthetic train schedules for a day.
+ *
+ * Each pattern is a relative arrival rate for every second of the day:
+ *
+ *   poisson   the same all day
+ *   bursty    quiet spells with bursts twenty times as busy, both of
+ *             random length
+ *   rush      a quiet base with a morning peak around 08:00 and a longer
+ *             evening one around 17:30
+ *
+ * Exactly n arrivals are spread over the day by that rate: n sorted
+ * points of a unit Poisson process are scaled to the day's total rate
+ * and each lands in the second whose share of the total it falls in.
+ * The exponential gaps are drawn twice from the same seed, once to add
+ * them up and once to place them, so a schedule of any size streams out
+ * in constant memory.  Directions are drawn from a weighted mix and a
+ * percentage of trains can be expresses with a max wait.
+ *
+ * The same seed and options always give the same schedule.
+ *
+ */
+
+enum ARRIVAL_PATTERN
+{
+  PATTERN_POISSON = 0,
+  PATTERN_BURSTY,
+  PATTERN_RUSH,
+  NUM_PATTERNS
+};
+
+static const char * patternNames[ NUM_PATTERNS ] = { "poisson", "bursty", "rush" };
+
+struct schedule_spec
+{
+  enum ARRIVAL_PATTERN pattern;
+  uint64_t             trains;
+  double               mix[ NUM_DIRECTIONS ];   // weight of each direction, UNKNOWN's unused
+  uint64_t             seed;
+  int                  express_percent;
+  uint32_t             express_wait;
+};
+
+// Called with each entry, in order of arrival
+typedef void ( *schedule_emit )( void * ctx, ScheduleEntry entry );
+
+void genDefaults    ( struct schedule_spec * spec );
+int  genPatternFromName( const char * name );
+
+// Parses "N:E:S:W" weights, such as 4:1:1:1; returns 0 if it can
+int  genParseMix    ( const char * text, struct schedule_spec * spec );
+
+void genSchedule    ( struct schedule_spec * spec, schedule_emit emit, void * ctx );
+
+// Writes the format buildTrainSchedule() reads
+void genEmitText    ( void * fp, ScheduleEntry entry );
+
+void genDefaults( struct schedule_spec * spec )
+{
+  memset( spec, 0, sizeof( struct schedule_spec ) );
+  spec->pattern      = PATTERN_POISSON;
+  spec->trains       = 8640;
+  spec->seed         = 1;
+  spec->express_wait = 30;
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+    spec->mix[ d ] = 1;
+}
+
+int genPatternFromName( const char * name )
+{
+  for( int p = 0; p < NUM_PATTERNS; p++ )
+    if( strcmp( name, patternNames[ p ] ) == 0 ) return p;
+  return -1;
+}
+
+int genParseMix( const char * text, struct schedule_spec * spec )
+{
+  double w[ 4 ];
+  if( sscanf( text, "%lf:%lf:%lf:%lf", &w[ 0 ], &w[ 1 ], &w[ 2 ], &w[ 3 ] ) != 4 ) return -1;
+  if( w[ 0 ] < 0 || w[ 1 ] < 0 || w[ 2 ] < 0 || w[ 3 ] < 0 || w[ 0 ] + w[ 1 ] + w[ 2 ] + w[ 3 ] <= 0 )
+    return -1;
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+    spec->mix[ d ] = w[ d - NORTH ];
+  return 0;
+}
+
+// xorshift64*, one per stream so the passes over the gaps repeat exactly
+uint64_t genNext( uint64_t * state )
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+// Uniform on (0, 1]
+double genUniform( uint64_t * state )
+{
+  return ( ( genNext( state ) >> 11 ) + 1 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+double genExponential( uint64_t * state )
+{
+  return -log( genUniform( state ) );
+}
+
+uint64_t genSeed( uint64_t seed, uint64_t stream )
+{
+  uint64_t s = seed * 0x9E3779B97F4A7C15ULL + stream * 0xD1B54A32D192ED03ULL;
+  return s ? s : 1;
+}
+
+// Relative arrival rate of every second of the day
+void genRates( struct schedule_spec * spec, double * rate )
+{
+  uint64_t state = genSeed( spec->seed, 3 );
+
+  switch( spec->pattern )
+  {
+    case PATTERN_BURSTY:
+    {
+      // Quiet spells averaging 15 minutes, bursts averaging 2
+      int burst = 0;
+      for( int s = 0; s < SECONDS_IN_A_DAY; )
+      {
+        int length = 1 + (int) ( genExponential( &state ) * ( burst ? 120 : 900 ) );
+        for( int i = 0; i < length && s < SECONDS_IN_A_DAY; i++ )
+          rate[ s++ ] = burst ? 20 : 1;
+        burst = !burst;
+      }
+      break;
+    }
+
+    case PATTERN_RUSH:
+      for( int s = 0; s < SECONDS_IN_A_DAY; s++ )
+      {
+        double morning = ( s - 8.0 * 3600 ) / ( 45 * 60 );
+        double evening = ( s - 17.5 * 3600 ) / ( 60 * 60 );
+        rate[ s ] = 1 + 8 * exp( -morning * morning / 2 ) + 6 * exp( -evening * evening / 2 );
+      }
+      break;
+
+    default:
+      for( int s = 0; s < SECONDS_IN_A_DAY; s++ )
+        rate[ s ] = 1;
+      break;
+  }
+}
+
+enum TRAIN_DIRECTION genDirection( struct schedule_spec * spec, uint64_t * state )
+{
+  double total = 0;
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ ) total += spec->mix[ d ];
+
+  double pick = genUniform( state ) * total;
+  for( int d = NORTH; d < NUM_DIRECTIONS - 1; d++ )
+  {
+    if( pick <= spec->mix[ d ] && spec->mix[ d ] > 0 ) return d;
+    pick -= spec->mix[ d ];
+  }
+  return WEST;
+}
+
+void genSchedule( struct schedule_spec * spec, schedule_emit emit, void * ctx )
+{
+  double *cumulative = malloc( ( SECONDS_IN_A_DAY + 1 ) * sizeof( double ) );
+  if( cumulative == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for the arrival rates.\n");
+    exit( EXIT_FAILURE );
+  }
+
+  // cumulative[ s ] is the rate summed over the seconds before s
+  genRates( spec, cumulative + 1 );
+  cumulative[ 0 ] = 0;
+  for( int s = 1; s <= SECONDS_IN_A_DAY; s++ )
+    cumulative[ s ] += cumulative[ s - 1 ];
+
+  // n points need n + 1 gaps to spread them evenly over the whole day
+  uint64_t gaps = genSeed( spec->seed, 1 );
+  double   sum  = 0;
+  for( uint64_t i = 0; i <= spec->trains; i++ )
+    sum += genExponential( &gaps );
+
+  double   scale = cumulative[ SECONDS_IN_A_DAY ] / sum;
+  double   point = 0;
+  uint32_t s     = 0;
+  uint64_t other = genSeed( spec->seed, 2 );
+
+  gaps = genSeed( spec->seed, 1 );
+  for( uint64_t i = 0; i < spec->trains; i++ )
+  {
+    point += genExponential( &gaps ) * scale;
+    while( s < SECONDS_IN_A_DAY - 1 && cumulative[ s + 1 ] <= point ) s++;
+
+    ScheduleEntry entry = { s, i, genDirection( spec, &other ), 0 };
+    if( spec->express_percent && genUniform( &other ) * 100 < spec->express_percent )
+      entry.max_wait = spec->express_wait;
+    emit( ctx, entry );
+  }
+  free( cumulative );
+}
+
+void genEmitText( void * fp, ScheduleEntry entry )
+{
+  static const char letter[ NUM_DIRECTIONS ] = { '?', 'N', 'E', 'S', 'W' };
+
+  if( entry.max_wait )
+    fprintf( fp, "%u %u %c %u\n", entry.arrival_time, entry.train_id, letter[ entry.train_direction ],
+             entry.max_wait );
+  else
+    fprintf( fp, "%u %u %c\n", entry.arrival_time, entry.train_id, letter[ entry.train_direction ] );
+}
+
+#endif
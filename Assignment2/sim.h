@@ -0,0 +1,258 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eventq.h"
+#include "intersection.h"
+#include "policy.h"
+#include "train.h"
+
+/*
+ *
+ * One intersection simulated on a virtual clock, with all of its state
+ * in a struct sim.  Any number can run at once, on any threads, as long
+ * as each is only used by one at a time; the schedule they read is never
+ * written, so runs can share it.
+ *
+ * This is the discrete event mode of mavon -d.  Instead of a thread per
+ * train and a real second per tick, the simulation keeps a priority
+ * queue of arrival, cross and leave events and jumps straight from one
+ * event to the next.  Nothing sleeps, so a whole day's schedule runs in
+ * milliseconds.
+ *
+ * Each tick goes the way it does in the real-time modes: mediate() picks
+ * a direction, the tick's arrivals come in, the granted train enters, and
+ * a train that has been crossing for CROSSING_TIME seconds leaves at the
+ * end of its last second.  The real-time modes print the same lines in
+ * the same seconds, but there the granted train enters on a thread of its
+ * own, so its line can come before or after that second's arrivals.
+ * Compare sorted output.
+ *
+ * The policy and starvation limit are the ones in s->crossing, which
+ * can be changed between simInit() and simRun().  An optional trace
+ * function sees every arrival, entry and leave as it happens.
+ *
+ */
+
+#define SIM_WAIT_BUCKETS 4096   // one second each, the last for anything longer
+
+enum SIM_EVENT
+{
+  SIM_ARRIVE = 0,
+  SIM_ENTER  = 1,
+  SIM_LEAVE  = 2
+};
+
+struct sim;
+
+// Called before the intersection's state changes, so it still shows who
+// was in it when a train enters.  entry is the train's index in
+// s->schedule, which is also its number in order of arrival.
+typedef void ( *sim_trace )( struct sim * s, enum SIM_EVENT kind, uint32_t entry );
+
+struct sim
+{
+  const ScheduleEntry   *schedule;
+  uint32_t               n;
+  uint32_t               next;                        // first entry that has not arrived
+  int32_t                current_time;
+  struct intersection    crossing;
+  struct event_queue     events;                      // cross and leave events name schedule entries
+  struct direction_queue waiting[ NUM_DIRECTIONS ];   // schedule entries waiting in each direction
+  sim_trace              trace;
+  void                  *ctx;                         // for the trace
+
+  // What happened, for the sweep
+  uint64_t               arrived;
+  uint64_t               crossed[ NUM_DIRECTIONS ];
+  uint64_t               waited[ NUM_DIRECTIONS ];    // seconds between arriving and entering
+  uint32_t               worst_wait;
+  uint32_t               wait_count[ SIM_WAIT_BUCKETS ];
+};
+
+void simInit( struct sim * s, const ScheduleEntry * schedule, uint32_t n );
+void simRun ( struct sim * s );
+void simFree( struct sim * s );
+
+// The wait that fraction p of the trains that crossed did not go over
+uint32_t simPercentile( struct sim * s, double p );
+
+void simInit( struct sim * s, const ScheduleEntry * schedule, uint32_t n )
+{
+  memset( s, 0, sizeof( struct sim ) );
+  s->schedule = schedule;
+  s->n        = n;
+  intersectionInit( &s->crossing );
+}
+
+void simFree( struct sim * s )
+{
+  intersectionFree( &s->crossing );
+  free( s->events.heap );
+  for( int d = 0; d < NUM_DIRECTIONS; d++ )
+    free( s->waiting[ d ].ids );
+}
+
+void simPush( struct sim * s, uint32_t time, enum SIM_EVENT kind, uint32_t entry, uint32_t direction )
+{
+  struct event ev = { .time = time, .kind = kind, .order = s->events.seq++, .train_id = entry,
+                      .direction = direction };
+  eventPush( &s->events, ev );
+}
+
+// The next schedule entry becomes an arrival event, due no earlier than now
+void simPushArrival( struct sim * s )
+{
+  if( s->next >= s->n ) return;
+
+  const ScheduleEntry *next = &s->schedule[ s->next ];
+  uint32_t now  = s->current_time;
+  uint32_t time = next->arrival_time > now ? next->arrival_time : now;
+  simPush( s, time, SIM_ARRIVE, s->next, next->train_direction );
+}
+
+void simArrive( struct sim * s, uint32_t entry )
+{
+  const ScheduleEntry *e = &s->schedule[ entry ];
+
+  if( s->trace ) s->trace( s, SIM_ARRIVE, entry );
+  s->arrived++;
+
+  intersectionArrive( &s->crossing, e->train_direction,
+                      e->max_wait ? s->current_time + e->max_wait : NO_DEADLINE );
+  queuePush( &s->waiting[ e->train_direction ], entry );
+}
+
+void simEnter( struct sim * s, uint32_t entry )
+{
+  const ScheduleEntry *e = &s->schedule[ entry ];
+  uint32_t wait = s->current_time - e->arrival_time;
+
+  if( s->trace ) s->trace( s, SIM_ENTER, entry );
+
+  s->crossed[ e->train_direction ]++;
+  s->waited[ e->train_direction ] += wait;
+  if( wait > s->worst_wait ) s->worst_wait = wait;
+  s->wait_count[ wait < SIM_WAIT_BUCKETS ? wait : SIM_WAIT_BUCKETS - 1 ]++;
+
+  intersectionEnter( &s->crossing, e->train_id, e->train_direction );
+}
+
+void simLeave( struct sim * s, uint32_t entry )
+{
+  const ScheduleEntry *e = &s->schedule[ entry ];
+
+  if( s->trace ) s->trace( s, SIM_LEAVE, entry );
+  intersectionLeave( &s->crossing, e->train_direction );
+}
+
+void simMediate( struct sim * s )
+{
+  enum TRAIN_DIRECTION direction = mediateChoose( &s->crossing );
+  if( direction == UNKNOWN ) return;
+
+  intersectionGranted( &s->crossing, direction, s->current_time );
+
+  // Like a signal with nobody waiting on the condition, a grant to an empty direction is lost.
+  if( s->waiting[ direction ].n == 0 ) return;
+  simPush( s, s->current_time, SIM_ENTER, queuePop( &s->waiting[ direction ] ), direction );
+}
+
+int simTrainsWaiting( struct sim * s )
+{
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+    if( s->waiting[ d ].n ) return 1;
+  return 0;
+}
+
+void simRun( struct sim * s )
+{
+  simPushArrival( s );
+
+  // The same stopping rules as mavon's process()
+  while( s->next < s->n && s->current_time <= SECONDS_IN_A_DAY )
+  {
+    simMediate( s );
+
+    while( s->events.n > 0 && s->events.heap[ 0 ].time <= (uint32_t) s->current_time )
+    {
+      struct event ev = eventPop( &s->events );
+
+      switch( ev.kind )
+      {
+        case SIM_ARRIVE:
+#ifdef DEBUG
+          fprintf( stdout, "Dispatching schedule event: time: %d train: %d direction: %s\n",
+                            s->schedule[ ev.train_id ].arrival_time, s->schedule[ ev.train_id ].train_id,
+                            directionAsString[ ev.direction ] );
+#endif
+          simArrive( s, ev.train_id );
+          s->next++;
+          simPushArrival( s );
+          break;
+
+        case SIM_ENTER:
+          simEnter( s, ev.train_id );
+          simPush( s, s->current_time + CROSSING_TIME - 1, SIM_LEAVE, ev.train_id, ev.direction );
+          break;
+
+        case SIM_LEAVE:
+          simLeave( s, ev.train_id );
+          break;
+      }
+    }
+
+    // An empty intersection with trains waiting gets a grant on the next tick.
+    // Otherwise nothing happens until the next event, so skip the idle seconds.
+    if( !( s->crossing.in_intersection == INTERSECTION_EMPTY && simTrainsWaiting( s ) ) &&
+        s->events.n > 0 && s->events.heap[ 0 ].time > (uint32_t) s->current_time + 1 )
+      s->current_time = s->events.heap[ 0 ].time;
+    else
+      s->current_time++;
+  }
+}
+
+uint32_t simPercentile( struct sim * s, double p )
+{
+  uint64_t total = 0;
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ ) total += s->crossed[ d ];
+  if( total == 0 ) return 0;
+
+  uint64_t want = (uint64_t) ( p * total + 0.5 );
+  uint64_t seen = 0;
+  if( want == 0 ) want = 1;
+  for( uint32_t w = 0; w < SIM_WAIT_BUCKETS; w++ )
+  {
+    seen += s->wait_count[ w ];
+    if( seen >= want ) return w;
+  }
+  return s->worst_wait;
+}
+
+#endif
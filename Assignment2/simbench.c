@@ -0,0 +1,336 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/*
+ *
+ * End to end benchmark of mavon over generated schedules.
+ *
+ * Build and run:
+ *   gcc -O2 -pthread -o mavon mavon.c
+ *   gcc -O2 -o simbench simbench.c -lm
+ *   ./simbench [-m path/to/mavon] [-n trains] [-k tick] [-t] [-i runs]
+ *              [-o results.csv] [-c baseline.csv] [-r percent]
+ *
+ * Writes a schedule of n trains (100000 by default) for each scenario
+ * below with schedgen.h, and runs each through mavon in discrete event
+ * mode (-d) and with the worker pool at tick rate k (100000 by default);
+ * -t adds a thread per train, which at this size means tens of thousands
+ * of threads.  For every run it records the wall time, the lines mavon
+ * printed (an arrival, entry or leave each) per second, the peak thread
+ * count sampled from /proc and the peak resident memory, keeping the
+ * fastest of i runs (3 by default) to keep the noise down.
+ *
+ * Both modes stop once the last train has arrived, and a real-time run
+ * that keeps up with its tick rate prints the same lines as -d, though
+ * not always in the same order within a second.  Past
+ * the rate mavon can keep up with, some seconds run late and the lines
+ * start to differ.
+ *
+ * -o appends the results to a CSV file.  -c compares against one written
+ * earlier and fails if any run's events per second dropped by more than
+ * r percent (20 by default), so it can guard against regressions.  Runs
+ * that took under MIN_COMPARE_S either time are too noisy to judge and
+ * are only printed; raise n to bring -d into range.
+ *
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "schedgen.h"
+
+struct scenario
+{
+  const char          *name;
+  enum ARRIVAL_PATTERN pattern;
+  const char          *mix;
+};
+
+static struct scenario scenarios[] =
+{
+  { "poisson",      PATTERN_POISSON, "1:1:1:1" },
+  { "bursty",       PATTERN_BURSTY,  "1:1:1:1" },
+  { "rush",         PATTERN_RUSH,    "1:1:1:1" },
+  { "rush-skewed",  PATTERN_RUSH,    "6:2:1:1" },
+};
+
+#define MIN_COMPARE_S 1.0
+
+#define NUM_SCENARIOS ( sizeof( scenarios ) / sizeof( scenarios[ 0 ] ) )
+
+struct result
+{
+  double wall;
+  long   events;
+  long   peak_threads;
+  long   peak_rss_kb;
+  int    ok;
+};
+
+double nowS( )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Reads Threads from /proc/pid/status
+long sampleThreads( pid_t pid )
+{
+  char path[ 64 ];
+  char line[ 256 ];
+  long threads = 0;
+  snprintf( path, sizeof( path ), "/proc/%d/status", (int) pid );
+
+  FILE * fp = fopen( path, "r" );
+  if( fp == NULL ) return 0;
+  while( fgets( line, sizeof( line ), fp ) )
+    sscanf( line, "Threads: %ld", &threads );
+  fclose( fp );
+  return threads;
+}
+
+// Runs mavon with args, counting the lines it prints while it goes
+struct result runMavon( char * const args[] )
+{
+  struct result r = { 0 };
+  int           out[ 2 ];
+
+  if( pipe( out ) != 0 )
+  {
+    perror( "pipe" );
+    exit( EXIT_FAILURE );
+  }
+
+  double start = nowS( );
+  fflush( stdout );
+  pid_t pid = fork( );
+  if( pid == 0 )
+  {
+    dup2( out[ 1 ], STDOUT_FILENO );
+    close( out[ 0 ] );
+    close( out[ 1 ] );
+    if( freopen( "/dev/null", "w", stderr ) == NULL ) _exit( 127 );
+    execv( args[ 0 ], args );
+    _exit( 127 );
+  }
+  close( out[ 1 ] );
+
+  static char   buf[ 1 << 16 ];
+  struct pollfd pfd = { out[ 0 ], POLLIN, 0 };
+  while( 1 )
+  {
+    long threads = sampleThreads( pid );
+    if( threads > r.peak_threads ) r.peak_threads = threads;
+
+    if( poll( &pfd, 1, 2 ) <= 0 ) continue;
+    ssize_t n = read( out[ 0 ], buf, sizeof( buf ) );
+    if( n <= 0 ) break;
+    for( char *p = buf; ( p = memchr( p, '\n', buf + n - p ) ) != NULL; p++ )
+      r.events++;
+  }
+  close( out[ 0 ] );
+
+  int           status;
+  struct rusage ru;
+  wait4( pid, &status, 0, &ru );
+  r.wall        = nowS( ) - start;
+  r.peak_rss_kb = ru.ru_maxrss;
+  r.ok          = WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+  return r;
+}
+
+// events per second of scenario and mode in a CSV written by -o, or 0
+double baselineRate( const char * path, const char * scenario, const char * mode, long trains,
+                     double * took )
+{
+  char   line[ 512 ], name[ 64 ], run[ 64 ];
+  long   n;
+  double wall, rate, found = 0;
+
+  FILE * fp = fopen( path, "r" );
+  if( fp == NULL )
+  {
+    perror( path );
+    exit( EXIT_FAILURE );
+  }
+  // The last matching row wins, so a file can collect many runs
+  while( fgets( line, sizeof( line ), fp ) )
+    if( sscanf( line, "%63[^,],%63[^,],%ld,%lf,%*d,%lf", name, run, &n, &wall, &rate ) == 5 &&
+        strcmp( name, scenario ) == 0 && strcmp( run, mode ) == 0 && n == trains )
+    {
+      found = rate;
+      *took = wall;
+    }
+  fclose( fp );
+  return found;
+}
+
+int main( int argc, char * argv[] )
+{
+  char * mavon     = "./mavon";
+  char * tick      = "100000";
+  char * csv       = NULL;
+  char * baseline  = NULL;
+  long   trains    = 100000;
+  int    per_train = 0;
+  int    tolerance = 20;
+  int    runs      = 3;
+  int    opt;
+
+  while( ( opt = getopt( argc, argv, "m:n:k:ti:o:c:r:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'm':
+        mavon = optarg;
+        break;
+      case 'n':
+        trains = atol( optarg );
+        break;
+      case 'k':
+        tick = optarg;
+        break;
+      case 't':
+        per_train = 1;
+        break;
+      case 'i':
+        runs = atoi( optarg );
+        break;
+      case 'o':
+        csv = optarg;
+        break;
+      case 'c':
+        baseline = optarg;
+        break;
+      case 'r':
+        tolerance = atoi( optarg );
+        break;
+      default:
+        fprintf( stderr, "usage: %s [-m mavon] [-n trains] [-k tick] [-t] [-i runs] [-o results.csv] "
+                         "[-c baseline.csv] [-r percent]\n", argv[0] );
+        exit( EXIT_FAILURE );
+    }
+  }
+  if( trains <= 0 || trains > UINT32_MAX )
+  {
+    fprintf( stderr, "ERROR: trains must be between 1 and %u.\n", UINT32_MAX );
+    exit( EXIT_FAILURE );
+  }
+  if( runs < 1 ) runs = 1;
+  if( access( mavon, X_OK ) != 0 )
+  {
+    perror( mavon );
+    exit( EXIT_FAILURE );
+  }
+
+  FILE * results = NULL;
+  if( csv )
+  {
+    int fresh = access( csv, F_OK ) != 0;
+    results = fopen( csv, "a" );
+    if( results == NULL )
+    {
+      perror( csv );
+      exit( EXIT_FAILURE );
+    }
+    if( fresh )
+      fprintf( results, "scenario,mode,trains,wall_s,events,events_per_s,peak_threads,peak_rss_kb\n" );
+  }
+
+  printf( "%ld trains, tick rate %s for the real-time runs\n", trains, tick );
+  printf( "%-12s %-8s %9s %10s %12s %8s %9s\n", "scenario", "mode", "wall s", "events", "events/s",
+          "threads", "rss MB" );
+
+  int regressed = 0;
+  for( size_t i = 0; i < NUM_SCENARIOS; i++ )
+  {
+    struct schedule_spec spec;
+    genDefaults( &spec );
+    spec.pattern = scenarios[ i ].pattern;
+    spec.trains  = trains;
+    genParseMix( scenarios[ i ].mix, &spec );
+
+    char schedule[ 64 ];
+    snprintf( schedule, sizeof( schedule ), "/tmp/simbench.%d.txt", (int) getpid( ) );
+    FILE * fp = fopen( schedule, "w" );
+    if( fp == NULL )
+    {
+      perror( schedule );
+      exit( EXIT_FAILURE );
+    }
+    genSchedule( &spec, genEmitText, fp );
+    fclose( fp );
+
+    const char *modes[] = { "des", "pool", "thread" };
+    for( int m = 0; m < 3; m++ )
+    {
+      if( m == 2 && !per_train ) continue;
+
+      char * const des[]    = { mavon, "-d", schedule, NULL };
+      char * const pool[]   = { mavon, schedule, tick, NULL };
+      char * const thread[] = { mavon, "-t", schedule, tick, NULL };
+      struct result r = runMavon( m == 0 ? des : m == 1 ? pool : thread );
+      for( int k = 1; k < runs && r.ok; k++ )
+      {
+        struct result again = runMavon( m == 0 ? des : m == 1 ? pool : thread );
+        if( !again.ok || again.wall < r.wall ) r = again;
+      }
+      double rate = r.events / r.wall;
+
+      printf( "%-12s %-8s %9.2f %10ld %12.0f %8ld %9.1f   %s", scenarios[ i ].name, modes[ m ], r.wall,
+              r.events, rate, r.peak_threads, r.peak_rss_kb / 1024.0, r.ok ? "ok" : "FAILED" );
+      if( !r.ok ) regressed = 1;
+
+      if( baseline )
+      {
+        double took;
+        double before = baselineRate( baseline, scenarios[ i ].name, modes[ m ], trains, &took );
+        if( before > 0 && ( r.wall < MIN_COMPARE_S || took < MIN_COMPARE_S ) )
+          printf( "   too short to compare" );
+        else if( before > 0 )
+        {
+          double change = 100 * ( rate - before ) / before;
+          printf( "   %+6.1f%%%s", change, change < -tolerance ? " REGRESSION" : "" );
+          if( change < -tolerance ) regressed = 1;
+        }
+      }
+      printf( "\n" );
+
+      if( results )
+        fprintf( results, "%s,%s,%ld,%.4f,%ld,%.1f,%ld,%ld\n", scenarios[ i ].name, modes[ m ], trains,
+                 r.wall, r.events, rate, r.peak_threads, r.peak_rss_kb );
+    }
+    unlink( schedule );
+  }
+
+  if( results ) fclose( results );
+  return regressed;
+}
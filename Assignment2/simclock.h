@@ -0,0 +1,147 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __SIMCLOCK_H__
+#define __SIMCLOCK_H__
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <time.h>
+
+#include "hist.h"
+
+/*
+ *
+ * The real-time modes' clock.  Simulated second s starts s periods after
+ * the epoch taken when the clock starts, and everything sleeps with
+ * clock_nanosleep( TIMER_ABSTIME ) until the moment it wants on that one
+ * timeline.  Time spent between sleeps comes out of the next sleep
+ * instead of adding to it, so the simulation does not drift however long
+ * it runs, and a period of under a microsecond is still a real sleep
+ * rather than usleep( 0 ).  A moment that has already passed is not
+ * slept for at all: the clock catches up by running the seconds back to
+ * back and is on time again as soon as it can be.
+ *
+ * The tick rate is simulated seconds per real second and need not be a
+ * whole number.
+ *
+ * clockStart() asks for the finest timer slack the kernel gives, for the
+ * thread calling it and so for every thread it goes on to create.
+ * clockTick() records how late the main loop woke each second, which
+ * clockReport() prints.
+ *
+ */
+
+struct sim_clock
+{
+  double      rate;          // simulated seconds per real second
+  double      period_ns;     // real nanoseconds per simulated second
+  uint64_t    epoch_ns;
+
+  // How late clockTick() woke: its jitter, and the lag it had left at the end
+  struct hist late;          // one a tick
+  uint64_t    overruns;      // seconds that were over before the loop got to them
+  uint64_t    late_sum_ns;
+  uint64_t    late_last_ns;
+};
+
+struct sim_clock sim_clock;
+
+void     clockStart     ( struct sim_clock * c, double rate );
+uint64_t clockNow       ( );
+
+// The real time simulated time t (fractions allowed) falls at
+uint64_t clockDeadline  ( struct sim_clock * c, double t );
+
+// Sleeps until simulated time t; returns how late it woke, in ns
+uint64_t clockSleepUntil( struct sim_clock * c, double t );
+
+// clockSleepUntil() for the main loop, recording how late it woke
+void     clockTick      ( struct sim_clock * c, double t );
+void     clockReport    ( struct sim_clock * c, FILE * fp );
+
+uint64_t clockNow( )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void clockStart( struct sim_clock * c, double rate )
+{
+  memset( c, 0, sizeof( struct sim_clock ) );
+  c->rate      = rate;
+  c->period_ns = 1e9 / rate;
+
+  // 50 us by default, which is most of a simulated second at high tick rates
+  prctl( PR_SET_TIMERSLACK, 1UL, 0, 0, 0 );
+  c->epoch_ns = clockNow( );
+}
+
+uint64_t clockDeadline( struct sim_clock * c, double t )
+{
+  return c->epoch_ns + (uint64_t) ( t * c->period_ns );
+}
+
+uint64_t clockSleepUntil( struct sim_clock * c, double t )
+{
+  uint64_t        deadline = clockDeadline( c, t );
+  uint64_t        now      = clockNow( );
+  struct timespec ts       = { deadline / 1000000000, deadline % 1000000000 };
+
+  if( now >= deadline ) return now - deadline;
+
+  while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR );
+  now = clockNow( );
+  return now > deadline ? now - deadline : 0;
+}
+
+void clockTick( struct sim_clock * c, double t )
+{
+  uint64_t deadline = clockDeadline( c, t );
+  uint64_t late;
+
+  if( clockNow( ) > deadline ) c->overruns++;
+  late = clockSleepUntil( c, t );
+
+  histAdd( &c->late, late );
+  c->late_sum_ns  += late;
+  c->late_last_ns  = late;
+}
+
+void clockReport( struct sim_clock * c, FILE * fp )
+{
+  if( c->late.count == 0 ) return;
+
+  fprintf( fp, "clock: %llu seconds at %g per second, %.3f us each\n", (unsigned long long) c->late.count,
+           c->rate, c->period_ns / 1e3 );
+  fprintf( fp, "clock: woke late by p50 %.1f us, p99 %.1f us, max %.1f us, mean %.1f us\n",
+           histPercentile( &c->late, 0.5 ) / 1e3, histPercentile( &c->late, 0.99 ) / 1e3, c->late.max_ns / 1e3,
+           c->late_sum_ns / 1e3 / c->late.count );
+  fprintf( fp, "clock: %llu seconds overran, %.1f us behind at the end (%.2f seconds)\n",
+           (unsigned long long) c->overruns, c->late_last_ns / 1e3, c->late_last_ns / c->period_ns );
+}
+
+#endif
@@ -0,0 +1,134 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __STEAL_H__
+#define __STEAL_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ *
+ * A work-stealing deque of job numbers (Chase and Lev).
+ *
+ * Its owner pushes and takes at the bottom with no atomic read-modify-
+ * write except when racing a thief for the last job; any other thread
+ * may steal from the top.  Workers keep to their own deque until it runs
+ * dry and then take the oldest job from someone else's, so the work
+ * evens out without a shared queue every worker would fight over.
+ *
+ * The capacity is fixed when it is made.
+ *
+ */
+
+struct work_deque
+{
+  int64_t   top;        // next to steal
+  char      pad[ 56 ];  // thieves write top, the owner bottom
+  int64_t   bottom;     // next free slot
+  uint32_t *jobs;
+  uint32_t  mask;
+};
+
+void workInit ( struct work_deque * q, uint32_t capacity );
+void workFree ( struct work_deque * q );
+
+// Only the owner pushes and takes.  Each returns 1 with a job, 0 if there is none.
+void workPush ( struct work_deque * q, uint32_t job );
+int  workTake ( struct work_deque * q, uint32_t * job );
+
+// Any thread; 0 if it was empty, -1 if another thread got there first
+int  workSteal( struct work_deque * q, uint32_t * job );
+
+void workInit( struct work_deque * q, uint32_t capacity )
+{
+  uint32_t cap = 16;
+  while( cap < capacity ) cap *= 2;
+
+  q->top    = 0;
+  q->bottom = 0;
+  q->mask   = cap - 1;
+  q->jobs   = malloc( cap * sizeof( uint32_t ) );
+  if( q->jobs == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for the work queue.\n");
+    exit( EXIT_FAILURE );
+  }
+}
+
+void workFree( struct work_deque * q )
+{
+  free( q->jobs );
+}
+
+void workPush( struct work_deque * q, uint32_t job )
+{
+  int64_t b = __atomic_load_n( &q->bottom, __ATOMIC_RELAXED );
+  int64_t t = __atomic_load_n( &q->top, __ATOMIC_ACQUIRE );
+
+  if( b - t > q->mask )
+  {
+    fprintf( stderr, "ERROR: The work queue is full.\n");
+    exit( EXIT_FAILURE );
+  }
+  __atomic_store_n( &q->jobs[ b & q->mask ], job, __ATOMIC_RELAXED );
+  __atomic_store_n( &q->bottom, b + 1, __ATOMIC_RELEASE );
+}
+
+int workTake( struct work_deque * q, uint32_t * job )
+{
+  int64_t b = __atomic_load_n( &q->bottom, __ATOMIC_RELAXED ) - 1;
+
+  // Claim the bottom job before looking at top, so a thief sees the claim
+  __atomic_store_n( &q->bottom, b, __ATOMIC_RELAXED );
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+  int64_t t = __atomic_load_n( &q->top, __ATOMIC_RELAXED );
+
+  if( t > b )
+  {
+    __atomic_store_n( &q->bottom, b + 1, __ATOMIC_RELAXED );
+    return 0;
+  }
+
+  *job = __atomic_load_n( &q->jobs[ b & q->mask ], __ATOMIC_RELAXED );
+  if( t < b ) return 1;
+
+  // The last one: whoever moves top on first has it
+  int won = __atomic_compare_exchange_n( &q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED );
+  __atomic_store_n( &q->bottom, b + 1, __ATOMIC_RELAXED );
+  return won;
+}
+
+int workSteal( struct work_deque * q, uint32_t * job )
+{
+  int64_t t = __atomic_load_n( &q->top, __ATOMIC_ACQUIRE );
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+  int64_t b = __atomic_load_n( &q->bottom, __ATOMIC_ACQUIRE );
+
+  if( t >= b ) return 0;
+
+  *job = __atomic_load_n( &q->jobs[ t & q->mask ], __ATOMIC_RELAXED );
+  return __atomic_compare_exchange_n( &q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) ? 1 : -1;
+}
+
+#endif
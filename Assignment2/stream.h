@@ -0,0 +1,240 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "train.h"
+
+/*
+ *
+ * A text schedule read a little at a time while the simulation runs,
+ * from stdin ("-"), a FIFO, or with -f a file that is still being
+ * appended to.
+ *
+ * process() calls streamFill() once a simulated second.  It takes in
+ * whatever lines have arrived without blocking, so a quiet source just
+ * means no trains, and holds at most STREAM_WINDOW entries that have not
+ * arrived yet.  When the window is full it stops reading, and a writer
+ * on a pipe waits for it to catch up.  Memory stays the same however
+ * long the stream runs.
+ *
+ * Times are seconds into the day.  A time earlier than the one before it
+ * starts the next day, so a feed can go on from one midnight to the next
+ * and the simulation's clock just keeps counting: day d's second t is
+ * d * SECONDS_IN_A_DAY + t.  An entry that comes in after its time has
+ * passed arrives at once.
+ *
+ * A stream ends when its writer closes it.  With -f it never does: a
+ * file is waited on at its end, and a FIFO is held open for writing too
+ * so that writers can come and go.  Lines that do not parse are skipped
+ * and counted.
+ *
+ */
+
+#define STREAM_WINDOW 65536       // schedule entries held at once
+#define STREAM_BUFFER ( 64 * 1024 )
+
+struct schedule_stream
+{
+  int      fd;
+  int      follow;                // -f
+  int      done;                  // nothing more will come
+  int      skipping;              // dropping the rest of a line too long to hold
+  char     buf[ STREAM_BUFFER ];  // read but not yet parsed
+  size_t   len;
+  uint32_t day;
+  uint32_t last;                  // time of day of the last entry
+  uint64_t entries;
+  uint64_t skipped;
+};
+
+int                    streaming = 0;
+struct schedule_stream stream;
+
+// Whether filename should be streamed rather than read whole
+int  streamWanted( const char * filename, int follow );
+
+void streamOpen  ( struct schedule_stream * s, const char * filename, int follow );
+
+// Takes in what has arrived, as far as the window has room
+void streamFill  ( struct schedule_stream * s );
+
+// No more entries will come and all that came have been taken
+int  streamEnded ( struct schedule_stream * s );
+
+int streamWanted( const char * filename, int follow )
+{
+  struct stat st;
+
+  if( follow || strcmp( filename, "-" ) == 0 ) return 1;
+  return stat( filename, &st ) == 0 && ( S_ISFIFO( st.st_mode ) || S_ISCHR( st.st_mode ) );
+}
+
+void streamOpen( struct schedule_stream * s, const char * filename, int follow )
+{
+  struct stat st;
+
+  memset( s, 0, sizeof( struct schedule_stream ) );
+  s->follow = follow;
+
+  if( strcmp( filename, "-" ) == 0 )
+  {
+    s->fd = STDIN_FILENO;
+  }
+  else
+  {
+    // Reading and writing a FIFO keeps it from ever reaching the end
+    int fifo = stat( filename, &st ) == 0 && S_ISFIFO( st.st_mode );
+    s->fd = open( filename, fifo && follow ? O_RDWR : O_RDONLY );
+  }
+  if( s->fd < 0 )
+  {
+    perror("Can't not open train schedule data file:");
+    exit( EXIT_FAILURE );
+  }
+
+  scheduleInit( );
+  scheduleReserve( STREAM_WINDOW );
+  streaming = 1;
+}
+
+// Parses one "time id direction [max_wait]" line; returns 0 if it can
+int streamParse( const char * p, const char * end, ScheduleEntry * val )
+{
+  while( p < end && scheduleSpace( *p ) ) p++;
+  if( p == end || ( p = parseNumber( p, end, &val->arrival_time ) ) == NULL ) return -1;
+  while( p < end && scheduleSpace( *p ) ) p++;
+  if( p == end || ( p = parseNumber( p, end, &val->train_id ) ) == NULL ) return -1;
+  while( p < end && scheduleSpace( *p ) ) p++;
+  if( p == end || ( val->train_direction = directionFromChar( *p++ ) ) == UNKNOWN ) return -1;
+
+  val->max_wait = 0;
+  while( p < end && scheduleSpace( *p ) ) p++;
+  if( p < end && ( p = parseNumber( p, end, &val->max_wait ) ) == NULL ) return -1;
+  return 0;
+}
+
+// Parses the whole lines in the buffer, as many as the window takes
+void streamParseLines( struct schedule_stream * s )
+{
+  char *p   = s->buf;
+  char *end = s->buf + s->len;
+
+  while( p < end )
+  {
+    char *nl = memchr( p, '\n', end - p );
+
+    // The last line counts once nothing more can be added to it
+    if( nl == NULL && !s->done ) break;
+    char *line_end = nl ? nl : end;
+
+    if( s->skipping )
+    {
+      s->skipping = nl == NULL;
+      p = line_end + ( nl != NULL );
+      continue;
+    }
+
+    // Leave it for when pops have made room
+    if( schedule_back == schedule_cap ) break;
+
+    const char *q = p;
+    while( q < line_end && scheduleSpace( *q ) ) q++;
+    if( q < line_end )
+    {
+      ScheduleEntry val;
+      if( streamParse( q, line_end, &val ) != 0 )
+      {
+        s->skipped++;
+      }
+      else
+      {
+        if( val.arrival_time < s->last ) s->day++;
+        s->last = val.arrival_time;
+        val.arrival_time += s->day * SECONDS_IN_A_DAY;
+        schedulePush( val );
+        s->entries++;
+      }
+    }
+    p = line_end + ( nl != NULL );
+  }
+
+  s->len = end - p;
+  memmove( s->buf, p, s->len );
+
+  // A line that fills the whole buffer can never be parsed
+  if( s->len == STREAM_BUFFER && memchr( s->buf, '\n', s->len ) == NULL )
+  {
+    s->skipped++;
+    s->skipping = 1;
+    s->len      = 0;
+  }
+}
+
+void streamFill( struct schedule_stream * s )
+{
+  // The window is reused once half of it has gone through
+  if( schedule_front >= STREAM_WINDOW / 2 ) scheduleCompact( );
+
+  streamParseLines( s );
+  while( !s->done && schedule_back < schedule_cap && s->len < STREAM_BUFFER )
+  {
+    struct pollfd pfd = { s->fd, POLLIN, 0 };
+    if( poll( &pfd, 1, 0 ) <= 0 ) break;
+
+    ssize_t n = read( s->fd, s->buf + s->len, STREAM_BUFFER - s->len );
+    if( n < 0 && ( errno == EINTR || errno == EAGAIN ) ) break;
+    if( n < 0 )
+    {
+      perror( "Can't read the train schedule stream" );
+      exit( EXIT_FAILURE );
+    }
+
+    // A followed file may yet grow; anything else has ended
+    if( n == 0 )
+    {
+      s->done = !s->follow;
+      streamParseLines( s );
+      break;
+    }
+    s->len += n;
+    streamParseLines( s );
+  }
+}
+
+int streamEnded( struct schedule_stream * s )
+{
+  return s->done && s->len == 0 && scheduleEmpty( );
+}
+
+#endif
@@ -0,0 +1,439 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Trevor Bakker
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+/*
+ *
+ * Monte Carlo sweep of mediate() policies and starvation limits.
+ *
+ * Build and run:
+ *   gcc -O2 -pthread -o sweep sweep.c -lm
+ *   ./sweep [-p policy,...] [-l limit,...] [-r runs] [-n trains] [-g pattern]
+ *           [-m N:E:S:W] [-x percent] [-s seed] [-j threads] [-o results.csv]
+ *
+ * Every policy (all of them by default) is tried with every starvation
+ * limit (just STARVATION_LIMIT by default) on r days (100 by default) of
+ * n trains (7000, about 80% busy) generated by schedgen.h, 15% of them
+ * expresses.  Day k has the same trains for every combination, so they
+ * are compared on equal terms.  A build with -DMEDIATE_POLICY fixed runs
+ * just that policy whatever -p says.
+ *
+ * Each run is a struct sim of its own, so they all go in one process on
+ * j threads (one per core by default).  Runs are dealt out to the threads
+ * in blocks, each thread working through its own block and stealing from
+ * the far end of another's when it runs out.  A thread keeps the last
+ * day it generated, and a block goes day by day, so most runs reuse one.
+ *
+ * For each combination it prints the mean wait with a 95% confidence
+ * interval over the days, the mean 95th percentile and the worst wait,
+ * Jain's fairness index over the directions' mean waits and the share
+ * of deadlines missed.  -o writes one CSV row per run.
+ *
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "schedgen.h"
+#include "sim.h"
+#include "steal.h"
+
+#define MAX_CONFIGS 256
+
+struct config
+{
+  enum MEDIATE_POLICY policy;
+  int                 starvation_limit;
+};
+
+struct run_result
+{
+  double   mean_wait;
+  uint32_t p95;
+  uint32_t worst_wait;
+  double   fairness;
+  uint64_t crossed;
+  uint64_t deadlines_met;
+  uint64_t deadlines_missed;
+};
+
+struct worker
+{
+  pthread_t         thread;
+  int               index;
+  struct work_deque jobs;
+  ScheduleEntry    *day;        // the last day generated
+  uint32_t          day_n;
+  uint32_t          day_cap;
+  int64_t           day_seed;   // -1 before the first
+  uint64_t          runs;
+  uint64_t          stolen;
+  uint64_t          generated;
+};
+
+struct config         configs[ MAX_CONFIGS ];
+int                   nconfigs;
+struct schedule_spec  spec;
+struct run_result    *results;
+struct worker        *workers;
+int                   nworkers;
+
+double nowS( )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void emitDay( void * ctx, ScheduleEntry entry )
+{
+  struct worker *w = ctx;
+  if( w->day_n == w->day_cap )
+  {
+    w->day_cap = w->day_cap ? w->day_cap * 2 : 1024;
+    w->day     = realloc( w->day, w->day_cap * sizeof( ScheduleEntry ) );
+    if( w->day == NULL )
+    {
+      fprintf( stderr, "ERROR: Out of memory for a day's schedule.\n");
+      exit( EXIT_FAILURE );
+    }
+  }
+  w->day[ w->day_n++ ] = entry;
+}
+
+// Jain's index over the mean waits of the directions trains came from
+double fairness( struct sim * s )
+{
+  double sum = 0, squares = 0;
+  int    n   = 0;
+
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+  {
+    if( s->crossed[ d ] == 0 ) continue;
+    double mean = (double) s->waited[ d ] / s->crossed[ d ];
+    sum     += mean;
+    squares += mean * mean;
+    n++;
+  }
+  return squares > 0 ? sum * sum / ( n * squares ) : 1;
+}
+
+// Job j is day j / nconfigs with configuration j % nconfigs
+void runJob( struct worker * w, uint32_t job )
+{
+  struct config *c   = &configs[ job % nconfigs ];
+  int64_t        day = job / nconfigs;
+
+  if( day != w->day_seed )
+  {
+    struct schedule_spec today = spec;
+    today.seed  = spec.seed + day;
+    w->day_n    = 0;
+    w->day_seed = day;
+    genSchedule( &today, emitDay, w );
+    w->generated++;
+  }
+
+  struct sim s;
+  simInit( &s, w->day, w->day_n );
+  s.crossing.policy           = c->policy;
+  s.crossing.starvation_limit = c->starvation_limit;
+  simRun( &s );
+
+  struct run_result *r = &results[ job ];
+  uint64_t waited = 0;
+  for( int d = NORTH; d < NUM_DIRECTIONS; d++ )
+  {
+    r->crossed += s.crossed[ d ];
+    waited     += s.waited[ d ];
+  }
+  r->mean_wait        = r->crossed ? (double) waited / r->crossed : 0;
+  r->p95              = simPercentile( &s, 0.95 );
+  r->worst_wait       = s.worst_wait;
+  r->fairness         = fairness( &s );
+  r->deadlines_met    = s.crossing.deadlines_met;
+  r->deadlines_missed = s.crossing.deadlines_missed;
+  simFree( &s );
+  w->runs++;
+}
+
+void * sweepWorker( void * val )
+{
+  struct worker *w = val;
+  uint32_t       job;
+
+  while( 1 )
+  {
+    if( workTake( &w->jobs, &job ) )
+    {
+      runJob( w, job );
+      continue;
+    }
+
+    // Out of work: look round the others, starting with the next one along
+    int busy = 0, got = 0;
+    for( int i = 1; i < nworkers && !got; i++ )
+    {
+      int stolen = workSteal( &workers[ ( w->index + i ) % nworkers ].jobs, &job );
+      if( stolen < 0 ) busy = 1;
+      got = stolen > 0;
+    }
+    if( got )
+    {
+      w->stolen++;
+      runJob( w, job );
+    }
+    else if( !busy )
+    {
+      // Nobody pushes once the sweep starts, so empty everywhere means done
+      return NULL;
+    }
+  }
+}
+
+// Splits a comma separated list, calling parse on each item; returns the count
+int parseList( char * text, int * values, int max, int ( *parse )( const char * ) )
+{
+  int n = 0;
+  for( char *item = strtok( text, "," ); item != NULL; item = strtok( NULL, "," ) )
+  {
+    if( n == max ) return -1;
+    values[ n ] = parse( item );
+    if( values[ n ] < 0 ) return -1;
+    n++;
+  }
+  return n;
+}
+
+int parseLimit( const char * text )
+{
+  int limit = atoi( text );
+  return limit > 0 ? limit : -1;
+}
+
+int main( int argc, char * argv[] )
+{
+  int    policies[ NUM_POLICIES ];
+  int    npolicies = NUM_POLICIES;
+  int    limits[ 16 ] = { STARVATION_LIMIT };
+  int    nlimits = 1;
+  long   runs    = 100;
+  char * csv     = NULL;
+  int    opt;
+
+  genDefaults( &spec );
+  spec.trains          = 7000;
+  spec.express_percent = 15;
+  nworkers             = sysconf( _SC_NPROCESSORS_ONLN );
+  for( int p = 0; p < NUM_POLICIES; p++ ) policies[ p ] = p;
+
+  while( ( opt = getopt( argc, argv, "p:l:r:n:g:m:x:s:j:o:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'p':
+        npolicies = parseList( optarg, policies, NUM_POLICIES, policyFromName );
+        if( npolicies <= 0 )
+        {
+          fprintf( stderr, "ERROR: -p wants policies from policy.h, like rules,fifo,edf.\n");
+          exit( EXIT_FAILURE );
+        }
+        break;
+      case 'l':
+        nlimits = parseList( optarg, limits, 16, parseLimit );
+        if( nlimits <= 0 )
+        {
+          fprintf( stderr, "ERROR: -l wants up to 16 positive limits, like 3,5,8.\n");
+          exit( EXIT_FAILURE );
+        }
+        break;
+      case 'r':
+        runs = atol( optarg );
+        break;
+      case 'n':
+        spec.trains = strtoull( optarg, NULL, 10 );
+        break;
+      case 'g':
+        if( genPatternFromName( optarg ) < 0 )
+        {
+          fprintf( stderr, "ERROR: Unknown pattern %s; try poisson, bursty or rush.\n", optarg );
+          exit( EXIT_FAILURE );
+        }
+        spec.pattern = genPatternFromName( optarg );
+        break;
+      case 'm':
+        if( genParseMix( optarg, &spec ) != 0 )
+        {
+          fprintf( stderr, "ERROR: -m wants four weights, like 4:1:1:1.\n");
+          exit( EXIT_FAILURE );
+        }
+        break;
+      case 'x':
+        spec.express_percent = atoi( optarg );
+        break;
+      case 's':
+        spec.seed = strtoull( optarg, NULL, 10 );
+        break;
+      case 'j':
+        nworkers = atoi( optarg );
+        break;
+      case 'o':
+        csv = optarg;
+        break;
+      default:
+        fprintf( stderr, "usage: %s [-p policy,...] [-l limit,...] [-r runs] [-n trains] [-g pattern] "
+                         "[-m N:E:S:W] [-x percent] [-s seed] [-j threads] [-o results.csv]\n", argv[0] );
+        exit( EXIT_FAILURE );
+    }
+  }
+  if( spec.trains == 0 || spec.trains > UINT32_MAX )
+  {
+    fprintf( stderr, "ERROR: trains must be between 1 and %u.\n", UINT32_MAX );
+    exit( EXIT_FAILURE );
+  }
+  if( nworkers < 1 ) nworkers = 1;
+
+#ifdef MEDIATE_POLICY
+  // Every run uses the built in policy, so there is only that one to compare
+  policies[ 0 ] = MEDIATE_POLICY;
+  npolicies = 1;
+#endif
+
+  for( int p = 0; p < npolicies; p++ )
+    for( int l = 0; l < nlimits; l++ )
+      configs[ nconfigs++ ] = (struct config) { policies[ p ], limits[ l ] };
+
+  uint64_t jobs = (uint64_t) runs * nconfigs;
+  if( runs <= 0 || jobs > UINT32_MAX )
+  {
+    fprintf( stderr, "ERROR: runs must be positive and runs times combinations fit in 32 bits.\n");
+    exit( EXIT_FAILURE );
+  }
+
+  results = calloc( jobs, sizeof( struct run_result ) );
+  workers = calloc( nworkers, sizeof( struct worker ) );
+  if( results == NULL || workers == NULL )
+  {
+    fprintf( stderr, "ERROR: Out of memory for %llu runs.\n", (unsigned long long) jobs );
+    exit( EXIT_FAILURE );
+  }
+
+  // Each worker gets a block of jobs in order, pushed last first so it takes
+  // them first to last and a thief takes the end furthest from it
+  for( int i = 0; i < nworkers; i++ )
+  {
+    uint64_t first = jobs * i / nworkers;
+    uint64_t last  = jobs * ( i + 1 ) / nworkers;
+
+    workers[ i ].index    = i;
+    workers[ i ].day_seed = -1;
+    workInit( &workers[ i ].jobs, last - first );
+    for( uint64_t j = last; j > first; j-- )
+      workPush( &workers[ i ].jobs, j - 1 );
+  }
+
+  double start = nowS( );
+  for( int i = 0; i < nworkers; i++ )
+    pthread_create( &workers[ i ].thread, NULL, sweepWorker, &workers[ i ] );
+
+  uint64_t stolen = 0, generated = 0;
+  for( int i = 0; i < nworkers; i++ )
+  {
+    pthread_join( workers[ i ].thread, NULL );
+    stolen    += workers[ i ].stolen;
+    generated += workers[ i ].generated;
+  }
+  double elapsed = nowS( ) - start;
+
+  printf( "%llu runs of %llu trains on %d threads in %.2f s: %.0f runs/s, %.1f M trains/s\n",
+          (unsigned long long) jobs, (unsigned long long) spec.trains, nworkers, elapsed, jobs / elapsed,
+          jobs * (double) spec.trains / elapsed / 1e6 );
+  printf( "%llu stolen, %llu days generated\n\n", (unsigned long long) stolen, (unsigned long long) generated );
+
+  printf( "%-14s %5s %18s %8s %8s %8s %9s\n", "policy", "limit", "mean wait (95% CI)", "p95", "worst",
+          "fairness", "missed" );
+  for( int c = 0; c < nconfigs; c++ )
+  {
+    double   sum = 0, squares = 0, p95 = 0, fair = 0;
+    uint32_t worst = 0;
+    uint64_t met = 0, missed = 0;
+
+    for( long k = 0; k < runs; k++ )
+    {
+      struct run_result *r = &results[ k * nconfigs + c ];
+      sum     += r->mean_wait;
+      squares += r->mean_wait * r->mean_wait;
+      p95     += r->p95;
+      fair    += r->fairness;
+      met     += r->deadlines_met;
+      missed  += r->deadlines_missed;
+      if( r->worst_wait > worst ) worst = r->worst_wait;
+    }
+
+    double mean     = sum / runs;
+    double variance = runs > 1 ? ( squares - sum * mean ) / ( runs - 1 ) : 0;
+    double ci       = 1.96 * sqrt( variance > 0 ? variance : 0 ) / sqrt( runs );
+    printf( "%-14s %5d %9.1f +- %5.1f %8.1f %8u %8.3f %8.1f%%\n", policyNames[ configs[ c ].policy ],
+            configs[ c ].starvation_limit, mean, ci, p95 / runs, worst, fair / runs,
+            met + missed ? 100.0 * missed / ( met + missed ) : 0 );
+  }
+
+  if( csv )
+  {
+    FILE * fp = fopen( csv, "w" );
+    if( fp == NULL )
+    {
+      perror( csv );
+      exit( EXIT_FAILURE );
+    }
+    fprintf( fp, "policy,starvation_limit,day,seed,crossed,mean_wait,p95,worst_wait,fairness,"
+                 "deadlines_met,deadlines_missed\n" );
+    for( uint64_t j = 0; j < jobs; j++ )
+    {
+      struct run_result *r = &results[ j ];
+      struct config     *c = &configs[ j % nconfigs ];
+      fprintf( fp, "%s,%d,%llu,%llu,%llu,%.3f,%u,%u,%.4f,%llu,%llu\n", policyNames[ c->policy ],
+               c->starvation_limit, (unsigned long long) ( j / nconfigs ),
+               (unsigned long long) ( spec.seed + j / nconfigs ), (unsigned long long) r->crossed,
+               r->mean_wait, r->p95, r->worst_wait, r->fairness, (unsigned long long) r->deadlines_met,
+               (unsigned long long) r->deadlines_missed );
+    }
+    if( fclose( fp ) != 0 )
+    {
+      perror( csv );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  for( int i = 0; i < nworkers; i++ )
+  {
+    workFree( &workers[ i ].jobs );
+    free( workers[ i ].day );
+  }
+  free( workers );
+  free( results );
+  return 0;
+}
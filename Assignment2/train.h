@@ -24,7 +24,15 @@
 #define __TRAIN_H__
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /*
  *
@@ -37,7 +45,15 @@
 #define SECONDS_IN_A_DAY 86400
 #define MAX_TRAIN_EVENTS SECONDS_IN_A_DAY / 10
 
-#define INTERSECTION_EMPTY -1
+// Binary schedules start with this header and go straight on with
+// header.count ScheduleEntry records, in the byte order of the machine
+// that wrote them.  See schedconv.c.  Version 1 files, from before
+// max_wait, are still read, by copying them.
+#define SCHEDULE_MAGIC   "MAVS"
+#define SCHEDULE_VERSION 2
+
+// No train id: in_intersection is a uint32_t
+#define INTERSECTION_EMPTY UINT32_MAX
 
 enum TRAIN_DIRECTION
 {
@@ -63,30 +79,99 @@ struct ScheduleEntry
   uint32_t arrival_time;
   uint32_t train_id;
   uint32_t train_direction;
+  uint32_t max_wait;          // seconds it may wait at an intersection, 0 for no limit
 };
 
 typedef struct ScheduleEntry ScheduleEntry;
 
-static ScheduleEntry schedule[ MAX_TRAIN_EVENTS ];
-static uint32_t      schedule_front = 0;
-static uint32_t      schedule_back  = 0;
+// How entries were laid out in version 1 binary schedules
+struct ScheduleEntryV1
+{
+  uint32_t arrival_time;
+  uint32_t train_id;
+  uint32_t train_direction;
+};
+
+struct ScheduleHeader
+{
+  char     magic[ 4 ];
+  uint32_t version;
+  uint64_t count;
+};
+
+typedef struct ScheduleHeader ScheduleHeader;
+
+// The schedule grows as entries are pushed.  A binary schedule is used
+// where it is mapped, and only copied if something is pushed onto it.
+static ScheduleEntry *schedule       = NULL;
+static uint32_t       schedule_cap   = 0;     // 0 while schedule points into a mapped file
+static uint32_t       schedule_front = 0;
+static uint32_t       schedule_back  = 0;
+static void          *schedule_map   = NULL;
+static size_t         schedule_map_len = 0;
 
 void scheduleInit( )
 {
-  int i = 0;
-  for( i = 0; i < MAX_TRAIN_EVENTS; ++i )
+  if( schedule_map != NULL )
+    munmap( schedule_map, schedule_map_len );
+  else
+    free( schedule );
+
+  schedule         = NULL;
+  schedule_cap     = 0;
+  schedule_front   = 0;
+  schedule_back    = 0;
+  schedule_map     = NULL;
+  schedule_map_len = 0;
+}
+
+// Makes room for n more entries
+void scheduleReserve( uint64_t n )
+{
+  uint64_t want = (uint64_t) schedule_back + n;
+
+  if( want > UINT32_MAX )
+  {
+    fprintf( stderr, "Error: Too many schedule entries.\n");
+    exit( EXIT_FAILURE );
+  }
+  if( want <= schedule_cap ) return;
+
+  uint64_t cap = schedule_cap ? schedule_cap : 1024;
+  while( cap < want ) cap *= 2;
+  if( cap > UINT32_MAX ) cap = UINT32_MAX;
+
+  ScheduleEntry *grown;
+  if( schedule_map != NULL )
   {
-    schedule[ i ] . arrival_time    = INT_MAX;
-    schedule[ i ] . train_id        = -1;
-    schedule[ i ] . train_direction = UNKNOWN;
+    // Pushing onto a mapped schedule: move it to the heap first
+    grown = malloc( cap * sizeof( ScheduleEntry ) );
+    if( grown != NULL )
+      memcpy( grown, schedule, (size_t) schedule_back * sizeof( ScheduleEntry ) );
+    munmap( schedule_map, schedule_map_len );
+    schedule_map = NULL;
   }
+  else
+  {
+    grown = realloc( schedule, cap * sizeof( ScheduleEntry ) );
+  }
+  if( grown == NULL )
+  {
+    fprintf( stderr, "Error: Out of memory for %llu schedule entries.\n", (unsigned long long) cap );
+    exit( EXIT_FAILURE );
+  }
+  schedule     = grown;
+  schedule_cap = cap;
 }
 
 void schedulePush( ScheduleEntry newEntry )
 {
+  if( schedule_back == schedule_cap ) scheduleReserve( 1 );
+
   schedule[ schedule_back ] . arrival_time    = newEntry . arrival_time;
   schedule[ schedule_back ] . train_id        = newEntry . train_id;
   schedule[ schedule_back ] . train_direction = newEntry . train_direction;
+  schedule[ schedule_back ] . max_wait        = newEntry . max_wait;
 
   schedule_back ++;
 }
@@ -108,6 +193,113 @@ void schedulePop( )
   schedule_front ++;
 }
 
+// Moves the entries still to come back to the start of a heap schedule,
+// so a stream can go on reusing the same space
+void scheduleCompact( )
+{
+  if( schedule_front == 0 || schedule_cap == 0 ) return;
+
+  memmove( schedule, schedule + schedule_front, ( schedule_back - schedule_front ) * sizeof( ScheduleEntry ) );
+  schedule_back -= schedule_front;
+  schedule_front = 0;
+}
+
+enum TRAIN_DIRECTION directionFromChar( char c )
+{
+  switch ( tolower( c )  )
+  {
+    case 'n'  : return NORTH;
+    case 'e'  : return EAST;
+    case 's'  : return SOUTH;
+    case 'w'  : return WEST;
+    default   : return UNKNOWN;
+  };
+}
+
+int scheduleSpace( char c )
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Reads the decimal number at p into *value and returns where it ended, or
+// NULL if there is no number there.  Eight digits at a time are checked and
+// converted inside one 64-bit word.
+const char * parseNumber( const char * p, const char * end, uint32_t * value )
+{
+  int      negative = 0;
+  uint32_t v        = 0;
+  const char *start;
+
+  if( p < end && ( *p == '-' || *p == '+' ) )
+    negative = *p++ == '-';
+  start = p;
+
+  while( end - p >= 8 )
+  {
+    uint64_t x;
+    memcpy( &x, p, 8 );
+
+    // A byte is a digit if its high nibble is 3 and its low nibble is at most 9
+    uint64_t high = ( x & 0xF0F0F0F0F0F0F0F0ULL ) ^ 0x3030303030303030ULL;
+    uint64_t low  = ( ( x & 0x0F0F0F0F0F0F0F0FULL ) + 0x0606060606060606ULL ) & 0x1010101010101010ULL;
+    uint64_t bad  = high | low;
+    int      n    = bad ? __builtin_ctzll( bad ) / 8 : 8;
+
+    if( n == 0 ) break;
+
+    // The n digits to the top of the word, then pairs, fours and eights of them
+    uint64_t d = ( x & 0x0F0F0F0F0F0F0F0FULL ) << ( 8 * ( 8 - n ) );
+    d = ( d * 10 + ( d >> 8 ) ) & 0x00FF00FF00FF00FFULL;
+    d = ( d * 100 + ( d >> 16 ) ) & 0x0000FFFF0000FFFFULL;
+    d = ( d * 10000 + ( d >> 32 ) ) & 0x00000000FFFFFFFFULL;
+
+    static const uint32_t scale[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+    v  = v * scale[ n ] + (uint32_t) d;
+    p += n;
+    if( n < 8 ) break;
+  }
+  while( p < end && *p >= '0' && *p <= '9' )
+    v = v * 10 + ( *p++ - '0' );
+
+  if( p == start ) return NULL;
+  *value = negative ? -v : v;
+  return p;
+}
+
+// Parses "time id direction" triples the way fscanf( "%d %d %c" ) would,
+// stopping at the first one that does not parse.  A number after the
+// direction on the same line is the train's max_wait.
+void parseLegacySchedule( const char * p, const char * end )
+{
+  // Roughly one entry per 12 bytes, so most files never grow the schedule
+  scheduleReserve( ( end - p ) / 12 + 1 );
+
+  while( 1 )
+  {
+    ScheduleEntry val;
+
+    while( p < end && scheduleSpace( *p ) ) p++;
+    if( p == end || ( p = parseNumber( p, end, &val.arrival_time ) ) == NULL ) break;
+    while( p < end && scheduleSpace( *p ) ) p++;
+    if( p == end || ( p = parseNumber( p, end, &val.train_id ) ) == NULL ) break;
+    while( p < end && scheduleSpace( *p ) ) p++;
+    if( p == end ) break;
+    val.train_direction = directionFromChar( *p++ );
+
+    val.max_wait = 0;
+    const char *q = p;
+    while( q < end && ( *q == ' ' || *q == '\t' ) ) q++;
+    if( q < end && *q >= '0' && *q <= '9' ) p = parseNumber( q, end, &val.max_wait );
+
+    schedulePush( val );
+
+#ifdef DEBUG
+    fprintf(stdout, "Scheduled: Time: %d Train: %d Direction: %d\n", val.arrival_time, val.train_id,
+            val.train_direction );
+#endif
+  }
+}
+
 void buildTrainSchedule( char * filename )
 {
   // Check that the file exists.  If not then print an error
@@ -122,53 +314,68 @@ void buildTrainSchedule( char * filename )
     exit( EXIT_FAILURE );
   }
 
-  // open the data file and read the train schedule
-  FILE * fp = fopen( filename, "r" );
+  // open the data file and map the train schedule
+  int fd = open( filename, O_RDONLY );
 
-  if( fp == NULL )
+  if( fd < 0 || fstat( fd, &statbuf ) < 0 )
   {
     perror("Can't not open train schedule data file:");
     exit( EXIT_FAILURE );
   }
 
-  uint32_t             arrival_time;
-  uint32_t             train_id;
-  enum TRAIN_DIRECTION direction;
-  char                 destination_direction;
+  scheduleInit( );
 
-  // Read the data file and populate the train schedule.
-  while( fscanf( fp, "%d %d %c", &arrival_time, &train_id, &destination_direction ) != EOF )
+  size_t len = statbuf.st_size;
+  char * map = len ? mmap( NULL, len, PROT_READ, MAP_PRIVATE, fd, 0 ) : NULL;
+  if( len && map == MAP_FAILED )
   {
-    ScheduleEntry val;
-    enum TRAIN_DIRECTION direction;
-
-    switch ( tolower( destination_direction )  )
-    {
-      case 'n'  : direction = NORTH;
-                  break;
-
-      case 'e'  : direction = EAST;
-                  break;
-
-      case 's'  : direction = SOUTH;
-                  break;
-
-      case 'w'  : direction = WEST;
-                  break;
+    perror("Can't not map train schedule data file:");
+    exit( EXIT_FAILURE );
+  }
+  close( fd );
 
-      default   : direction = UNKNOWN;
-                  break;
-    };
+  ScheduleHeader header;
+  if( len >= sizeof( header ) )
+    memcpy( &header, map, sizeof( header ) );
 
-    val.arrival_time     = arrival_time;
-    val.train_id         = train_id;
-    val.train_direction  = direction;
+  if( len >= sizeof( header ) && memcmp( header.magic, SCHEDULE_MAGIC, 4 ) == 0 )
+  {
+    size_t entry_size = header.version == 1 ? sizeof( struct ScheduleEntryV1 ) : sizeof( ScheduleEntry );
 
-    schedulePush( val );
+    if( ( header.version != 1 && header.version != SCHEDULE_VERSION ) || header.count > UINT32_MAX ||
+        header.count > ( len - sizeof( header ) ) / entry_size )
+    {
+      fprintf( stderr, "Error: %s is not a schedule this version can read.\n", filename );
+      exit( EXIT_FAILURE );
+    }
+    madvise( map, len, MADV_SEQUENTIAL );
 
-#ifdef DEBUG
-    fprintf(stdout, "Scheduled: Time: %d Train: %d Direction: %d\n", arrival_time, train_id, direction );
-#endif
+    if( header.version == SCHEDULE_VERSION )
+    {
+      // A binary schedule is used right where it is mapped
+      schedule         = (ScheduleEntry *) ( map + sizeof( header ) );
+      schedule_back    = header.count;
+      schedule_map     = map;
+      schedule_map_len = len;
+    }
+    else
+    {
+      struct ScheduleEntryV1 * old = (struct ScheduleEntryV1 *) ( map + sizeof( header ) );
+
+      scheduleReserve( header.count );
+      for( uint64_t i = 0; i < header.count; i++ )
+      {
+        ScheduleEntry val = { old[ i ].arrival_time, old[ i ].train_id, old[ i ].train_direction, 0 };
+        schedulePush( val );
+      }
+      munmap( map, len );
+    }
+  }
+  else if( len > 0 )
+  {
+    madvise( map, len, MADV_SEQUENTIAL );
+    parseLegacySchedule( map, map + len );
+    munmap( map, len );
   }
 
   // Verify there was relevant scheduling data in the file, otherwise exit out
@@ -177,11 +384,22 @@ void buildTrainSchedule( char * filename )
     fprintf( stderr, "Error: Could not parse any schedule data from %s.\n", filename );
     exit( EXIT_FAILURE );
   }
+}
 
+// Writes the schedule, from its front, as a binary schedule file
+int writeBinarySchedule( char * filename )
+{
+  ScheduleHeader header;
+  memcpy( header.magic, SCHEDULE_MAGIC, 4 );
+  header.version = SCHEDULE_VERSION;
+  header.count   = schedule_back - schedule_front;
 
-  // Done with the schedule file so close it
-  fclose( fp );
+  FILE * fp = fopen( filename, "wb" );
+  if( fp == NULL ) return -1;
+
+  int ok = fwrite( &header, sizeof( header ), 1, fp ) == 1 &&
+           fwrite( schedule + schedule_front, sizeof( ScheduleEntry ), header.count, fp ) == header.count;
+  return fclose( fp ) == 0 && ok ? 0 : -1;
 }
 
 #endif
-